@@ -11,6 +11,8 @@ PROJECTS=(
     "./examples/FreeTypeFont/"
     "./examples/X11/"
     "./examples/alpha-blend/"
+    "./examples/BlendModeTest/"
+    "./examples/PoolTest/"
 )
 
 for t in ${PROJECTS[@]}; do
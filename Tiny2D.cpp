@@ -21,6 +21,11 @@
 #include <fcntl.h>
 #include <cstdarg>
 #include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <type_traits>
+#include <limits.h>
+#include <list>
 
 #include <linux/fb.h>
 #include <linux/videodev2.h>
@@ -29,6 +34,9 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 
+#include <pthread.h>
+#include <sched.h>
+
 #ifdef USE_X11_EMULATION
 	#include <X11/Xlib.h>
 	#include <X11/Xutil.h>
@@ -37,6 +45,21 @@
 
 #include "Tiny2D.h"
 
+/**
+ * @brief The alpha blending row kernels use SSE2 or NEON when the compiler says they are available.
+ * On x86_64 and aarch64 that is always, for 32bit arm build with -mfpu=neon to get them.
+ * Define DISABLE_SIMD_KERNELS to force the portable code, handy for checking results on odd tool chains.
+ */
+#ifndef DISABLE_SIMD_KERNELS
+	#if defined(__SSE2__)
+		#define TINY2D_USE_SSE2
+		#include <emmintrin.h>
+	#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		#define TINY2D_USE_NEON
+		#include <arm_neon.h>
+	#endif
+#endif
+
 namespace tiny2d{	// Using a namespace to try to prevent name clashes as my class name is kind of obvious. :)
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -198,407 +221,862 @@ void TweenColoursRGB(uint8_t pFromRed,uint8_t pFromGreen, uint8_t pFromBlue,uint
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
-// DrawBuffer Implementation.
+// Row span helpers.
+// These work on a run of pixels that has already been clipped, so there is no bounds checking in here.
+// Keeps the per pixel work in the blits down to just the maths.
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
-DrawBuffer::DrawBuffer(int pWidth, int pHeight,bool pHasAlpha,bool pPreMultipliedAlpha)
+/**
+ * @brief Reads three bytes per pixel R G B data as passed to DrawBuffer::BlitRGB.
+ */
+struct PixelFormatRGB888Source
 {
-	Resize(pWidth,pHeight,pHasAlpha,pPreMultipliedAlpha);
-}
+	typedef uint32_t PixelType;
+	static constexpr size_t PIXEL_SIZE = 3;
+	static inline PixelType Read(const uint8_t* pPixel){return (pPixel[0] << 16) | (pPixel[1] << 8) | pPixel[2];}
+	static inline void Unpack(PixelType pPixel,uint8_t& rRed,uint8_t& rGreen,uint8_t& rBlue,uint8_t& rAlpha){rRed = pPixel >> 16;rGreen = pPixel >> 8;rBlue = pPixel;rAlpha = 255;}
+};
 
-DrawBuffer::DrawBuffer(const FrameBuffer* pFB)
+/**
+ * @brief Reads four bytes per pixel R G B A data as passed to DrawBuffer::BlitRGBA.
+ */
+struct PixelFormatRGBA8888Source
 {
-	assert( pFB );
-	Resize(pFB->GetWidth(),pFB->GetHeight(),false,false);
-}
+	typedef uint32_t PixelType;
+	static constexpr size_t PIXEL_SIZE = 4;
+	static inline PixelType Read(const uint8_t* pPixel){PixelType v;memcpy(&v,pPixel,sizeof(v));return v;}
+	static inline void Unpack(PixelType pPixel,uint8_t& rRed,uint8_t& rGreen,uint8_t& rBlue,uint8_t& rAlpha){rRed = pPixel;rGreen = pPixel >> 8;rBlue = pPixel >> 16;rAlpha = pPixel >> 24;}
+};
 
-DrawBuffer::DrawBuffer() :
-	mWidth(0),
-	mHeight(0),
-	mPixelSize(0),
-	mStride(0),
-	mHasAlpha(false),
-	mPreMultipliedAlpha(false)
+/**
+ * @brief True for the formats that are eight bits per channel in B G R order, these can use the vector blend kernels.
+ */
+template<class FORMAT> static constexpr bool IsBGRFormat()
 {
+	return std::is_same<FORMAT,PixelFormatBGR888>::value || std::is_same<FORMAT,PixelFormatBGRX8888>::value || std::is_same<FORMAT,PixelFormatBGRA8888>::value;
 }
 
-void DrawBuffer::Resize(int pWidth, int pHeight, size_t pPixelSize,bool pHasAlpha,bool pPreMultipliedAlpha)
+/**
+ * @brief Copies a row of pixels from one format to another.
+ * If the dest has alpha and the source does not the dest alpha is set to 255.
+ */
+template<class SOURCE,class DEST> static void ConvertRow(uint8_t* pDest,const uint8_t* pSource,int pCount)
 {
-	assert( pWidth > 0 );
-	assert( pHeight > 0 );
-	assert( pPixelSize > 2 );
-
-	mWidth = pWidth;
-	mHeight = pHeight;
-	mPixelSize = pPixelSize;
-	mStride = pWidth * pPixelSize;
-	mLastlineOffset = mStride * (mHeight - 1);
-	mHasAlpha = pHasAlpha;
-	mPreMultipliedAlpha = pPreMultipliedAlpha;
-	mPixels.resize(mHeight * mStride);
+	for( int n = 0 ; n < pCount ; n++, pDest += DEST::PIXEL_SIZE, pSource += SOURCE::PIXEL_SIZE )
+	{
+		uint8_t r,g,b,a;
+		SOURCE::Unpack(SOURCE::Read(pSource),r,g,b,a);
+		DEST::Write(pDest,DEST::Pack(r,g,b,a));
+	}
 }
 
-void DrawBuffer::BlendPixel(int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+/**
+ * @brief The size of the repeating pattern used to fill rows, a whole number of pixels for all the formats and three vector registers.
+ */
+static constexpr size_t FILL_PATTERN_SIZE = 48;
+
+/**
+ * @brief Fills pPattern with the pixel repeated.
+ */
+template<class FORMAT> static inline void MakeFillPattern(uint8_t pPattern[FILL_PATTERN_SIZE],typename FORMAT::PixelType pPixel)
 {
-	if( pX >= 0 && pX < mWidth && pY >= 0 && pY < mHeight )
+	static_assert( FILL_PATTERN_SIZE % FORMAT::PIXEL_SIZE == 0, "Fill pattern must be a whole number of pixels" );
+	for( size_t n = 0 ; n < FILL_PATTERN_SIZE ; n += FORMAT::PIXEL_SIZE )
 	{
-		// When optimized by compiler these const vars will
-		// all move to generate the same code as if I made it all one line and unreadable!
-		// Trust your optimizer. :)
-		const size_t index = GetPixelIndex(pX,pY);
-		uint8_t* dst = mPixels.data() + index;
-
-		AssertPixelIsInBuffer(dst);
-
-		const uint32_t sA = pAlpha;
-		const uint32_t dA = 255 - sA;
-
-		const uint32_t sR = (pRed * sA) / 255;
-		const uint32_t sG = (pGreen * sA) / 255;
-		const uint32_t sB = (pBlue * sA) / 255;
+		FORMAT::Write(pPattern + n,pPixel);
+	}
+}
 
-		const uint32_t dR = (dst[RED_PIXEL_INDEX] * dA) / 255;
-		const uint32_t dG = (dst[GREEN_PIXEL_INDEX] * dA) / 255;
-		const uint32_t dB = (dst[BLUE_PIXEL_INDEX] * dA) / 255;
+/**
+ * @brief Writes the same packed pixel pCount times along a row.
+ * Long runs are written from a pattern of the pixel repeated, the fixed size memcpy is done by the compiler with wide stores.
+ */
+template<class FORMAT> static inline void FillRow(uint8_t* pDest,int pCount,typename FORMAT::PixelType pPixel)
+{
+	if( pCount <= 0 )
+	{// Callers can work out empty spans, like the ends of a thick line, same as a loop would just do nothing.
+		return;
+	}
 
-		WRITE_RGB_TO_PIXEL(dst,( sR + dR ),( sG + dG ),( sB + dB ));
+	if( FORMAT::PIXEL_SIZE == 1 )
+	{
+		memset(pDest,(uint8_t)pPixel,pCount);
+	}
+	else if( pCount < (int)(FILL_PATTERN_SIZE / FORMAT::PIXEL_SIZE) )
+	{// Short, like the spans of a small circle, quicker to just write them.
+		for( int n = 0 ; n < pCount ; n++, pDest += FORMAT::PIXEL_SIZE )
+		{
+			FORMAT::Write(pDest,pPixel);
+		}
+	}
+	else
+	{
+		uint8_t pattern[FILL_PATTERN_SIZE];
+		MakeFillPattern<FORMAT>(pattern,pPixel);
 
-		// If dest has alpha, we need to pic the max value. Blending will just make everything vanish.
-		if( mHasAlpha && dst[3] < sA )
+		size_t numBytes = pCount * FORMAT::PIXEL_SIZE;
+		for( ; numBytes >= FILL_PATTERN_SIZE ; numBytes -= FILL_PATTERN_SIZE, pDest += FILL_PATTERN_SIZE )
 		{
-			dst[3] = sA;
+			memcpy(pDest,pattern,FILL_PATTERN_SIZE);
 		}
+		memcpy(pDest,pattern,numBytes);
 	}
 }
 
-void DrawBuffer::BlendPreAlphaPixel(int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+#if defined(USE_NON_TEMPORAL_FILLS) && defined(TINY2D_USE_SSE2)
+/**
+ * @brief Fills pNumBytes with pPattern using stores that go around the cache. pPattern is the pattern for the pixel at pDest.
+ * For areas much bigger than the cache, that would only push out everything else and then be written back anyway.
+ */
+static void FillRowNonTemporal(uint8_t* pDest,size_t pNumBytes,const uint8_t pPattern[FILL_PATTERN_SIZE])
 {
-	if( pX >= 0 && pX < mWidth && pY >= 0 && pY < mHeight )
+	// Normal stores up to the first 16 byte boundary, then the pattern is used from that far in so it stays in step.
+	const size_t head = std::min(pNumBytes,(size_t)((16 - ((uintptr_t)pDest & 15)) & 15));
+	memcpy(pDest,pPattern,head);
+	pDest += head;
+	pNumBytes -= head;
+
+	alignas(16) uint8_t pattern[FILL_PATTERN_SIZE];
+	for( size_t n = 0 ; n < FILL_PATTERN_SIZE ; n++ )
 	{
-		// When optimized by compiler these const vars will
-		// all move to generate the same code as if I made it all one line and unreadable!
-		// Trust your optimizer. :)
-		const size_t index = GetPixelIndex(pX,pY);
-		uint8_t* dst = mPixels.data() + index;
+		pattern[n] = pPattern[(n + head) % FILL_PATTERN_SIZE];
+	}
 
-		AssertPixelIsInBuffer(dst);
+	const __m128i a = _mm_load_si128((const __m128i*)pattern);
+	const __m128i b = _mm_load_si128((const __m128i*)(pattern + 16));
+	const __m128i c = _mm_load_si128((const __m128i*)(pattern + 32));
+	for( ; pNumBytes >= FILL_PATTERN_SIZE ; pNumBytes -= FILL_PATTERN_SIZE, pDest += FILL_PATTERN_SIZE )
+	{
+		_mm_stream_si128((__m128i*)pDest,a);
+		_mm_stream_si128((__m128i*)(pDest + 16),b);
+		_mm_stream_si128((__m128i*)(pDest + 32),c);
+	}
+	memcpy(pDest,pattern,pNumBytes);
 
-		const uint32_t dA = pAlpha;	// Will already have been subtracted from 255. So just use value.
+	// Streamed stores are weakly ordered, make sure they are all out before anyone else looks.
+	_mm_sfence();
+}
+#endif
+
+/**
+ * @brief Writes the same packed pixel pCount times down a column.
+ */
+template<class FORMAT> static inline void FillColumn(uint8_t* pDest,ptrdiff_t pStride,int pCount,typename FORMAT::PixelType pPixel)
+{
+	for( int n = 0 ; n < pCount ; n++, pDest += pStride )
+	{
+		FORMAT::Write(pDest,pPixel);
+	}
+}
 
-		// Already had Alpha applied, just grab values.
-		const uint32_t sR = pRed;
-		const uint32_t sG = pGreen;
-		const uint32_t sB = pBlue;
+/**
+ * @brief Writes a pixel if it is inside the clip rect. For the primitives that plot points, like circles, so the format is resolved once per call.
+ * When the whole shape is inside the clip rect they pass std::false_type for CLIPPED and the test goes away.
+ */
+template<class FORMAT,class CLIPPED> static inline void PlotPixel(DrawBuffer& pBuffer,int pX,int pY,typename FORMAT::PixelType pPixel)
+{
+	if( CLIPPED::value == false || pBuffer.GetClipRect().GetContains(pX,pY) )
+	{
+		FORMAT::Write(pBuffer.GetPixelAddress(pX,pY),pPixel);
+	}
+}
 
-		// Apply alpha to unpredictable colour values.
-		const uint32_t dR = (dst[RED_PIXEL_INDEX] * dA) / 255;
-		const uint32_t dG = (dst[GREEN_PIXEL_INDEX] * dA) / 255;
-		const uint32_t dB = (dst[BLUE_PIXEL_INDEX] * dA) / 255;
+/**
+ * @brief Calls pFunction with std::false_type if pBounds is all inside pClip, so no clipping needed, else std::true_type.
+ * Use with a generic lambda and PlotPixel. [&](auto pClipped){PlotPixel<FORMAT,decltype(pClipped)>(....);}
+ */
+template<class FUNCTION> static inline void DispatchClipped(const Rect& pClip,const Rect& pBounds,FUNCTION&& pFunction)
+{
+	if( pClip.GetContains(pBounds) )
+		pFunction(std::false_type());
+	else if( pClip.Intersect(pBounds).GetIsEmpty() == false )
+		pFunction(std::true_type());
+}
 
-		// Write new values
-		WRITE_RGB_TO_PIXEL(dst,( sR + dR ),( sG + dG ),( sB + dB ));
+/**
+ * @brief Calls pFunction(fromY,toY) for the rows of pArea. If there is a job system and the area is big enough to be worth waking
+ * the threads the rows are split over them, else it's one call on this thread. The rows must not depend on each other.
+ */
+static void ForRows(JobSystem* pJobs,const Rect& pArea,const std::function<void(int pFromY,int pToY)>& pFunction)
+{
+	// Less than this and the threads take longer to start than the work.
+	const int64_t MIN_PARALLEL_PIXELS = 256 * 256;
+	// About how many pixels a thread does at a time, small enough that there are plenty to go round.
+	const int PIXELS_PER_JOB = 16 * 1024;
 
-		// For pre calculated alpha there is no good choice for combining the source and dest alpha. So we just ignore it.
+	if( pArea.GetIsEmpty() )
+		return;
+
+	if( pJobs && pJobs->GetNumThreads() > 1 && (int64_t)pArea.GetWidth() * pArea.GetHeight() >= MIN_PARALLEL_PIXELS )
+	{
+		pJobs->ParallelFor(pArea.top,pArea.bottom,std::max(1,PIXELS_PER_JOB / pArea.GetWidth()),pFunction);
+	}
+	else
+	{
+		pFunction(pArea.top,pArea.bottom);
 	}
 }
 
-void DrawBuffer::Clear(uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+/**
+ * @brief Fills pArea of pBuffer with the pixel. Used by Clear and FillRectangle.
+ * If the rows follow on from each other, full width and no padding, they are filled as one long row.
+ * With USE_NON_TEMPORAL_FILLS areas bigger than the cache are written around it.
+ */
+template<class FORMAT> static void FillArea(DrawBuffer& pBuffer,const Rect& pArea,typename FORMAT::PixelType pPixel)
 {
-	uint8_t *dest = mPixels.data();
-	for( int y = 0 ; y < mHeight ; y++ )
+	const int width = pArea.GetWidth();
+	const bool oneRow = pBuffer.GetStride() == (ptrdiff_t)(width * FORMAT::PIXEL_SIZE);
+
+	auto fill = [&](uint8_t* pDest,int pCount)
 	{
-		for( int x = 0 ; x < mWidth ; x++, dest += mPixelSize )
+#if defined(USE_NON_TEMPORAL_FILLS) && defined(TINY2D_USE_SSE2)
+		// A bit more than a Pi 4's L2 cache, smaller areas are better left in the cache for what's drawn over them next.
+		const size_t NON_TEMPORAL_MIN_BYTES = 2 * 1024 * 1024;
+		if( (size_t)width * pArea.GetHeight() * FORMAT::PIXEL_SIZE >= NON_TEMPORAL_MIN_BYTES )
 		{
-			WRITE_RGB_TO_PIXEL(dest,pRed,pGreen,pBlue);
+			uint8_t pattern[FILL_PATTERN_SIZE];
+			MakeFillPattern<FORMAT>(pattern,pPixel);
+			FillRowNonTemporal(pDest,pCount * FORMAT::PIXEL_SIZE,pattern);
+			return;
 		}
-	}
+#endif
+		FillRow<FORMAT>(pDest,pCount,pPixel);
+	};
 
-	if( mHasAlpha )
+	ForRows(pBuffer.GetJobSystem(),pArea,[&](int pFromY,int pToY)
 	{
-		uint8_t *dest = mPixels.data();
-		for( int y = 0 ; y < mHeight ; y++ )
+		if( oneRow )
+		{
+			fill(pBuffer.GetPixelAddress(pArea.left,pFromY),width * (pToY - pFromY));
+		}
+		else
 		{
-			for( int x = 0 ; x < mWidth ; x++, dest += mPixelSize )
+			for( int y = pFromY ; y < pToY ; y++ )
 			{
-				dest[3] = pAlpha;
+				fill(pBuffer.GetPixelAddress(pArea.left,y),width);
 			}
 		}
-	}
+	});
 }
 
-void DrawBuffer::Clear(uint8_t pValue)
+/**
+ * @brief A box at any angle, used to find the part of each row a thick line covers.
+ */
+struct RotatedBox
 {
-	memset(mPixels.data(),pValue,mPixels.size());
-}
+	float mX[4],mY[4];	//!< The corners in order around the box.
+	float mDXDY[4];		//!< How far x moves for each step down the edge from corner n to corner n+1.
 
-void DrawBuffer::BlitRGB(const uint8_t* pSourcePixels,int pX,int pY,int pSourceWidth,int pSourceHeight)
-{
-	int EndX = pSourceWidth + pX; 
-	int EndY = pSourceHeight + pY;
-	for( int y = pY ; y < mHeight && y < EndY ; y++, pSourcePixels += pSourceWidth * 3 )
+	/**
+	 * @brief A box centred on pCentreX,pCentreY with its length along pDirX,pDirY, which must be one long.
+	 */
+	RotatedBox(float pCentreX,float pCentreY,float pDirX,float pDirY,float pHalfLength,float pHalfWidth)
 	{
-		const uint8_t* pixel = pSourcePixels;
-		for( int x = pX ; x < mWidth && x < EndX ; x++, pixel += 3 )
+		for( int n = 0 ; n < 4 ; n++ )
 		{
-			WritePixel(x,y,pixel[0],pixel[1],pixel[2]);
+			const float along = (n == 0 || n == 3) ? -pHalfLength : pHalfLength;
+			const float across = n < 2 ? -pHalfWidth : pHalfWidth;
+			mX[n] = pCentreX + (pDirX * along) - (pDirY * across);
+			mY[n] = pCentreY + (pDirY * along) + (pDirX * across);
 		}
-	}
-}
-	
-void DrawBuffer::BlitRGB(const uint8_t* pSourcePixels,int pX,int pY,int pWidth,int pHeight,int pSourceX,int pSourceY,int pSourceStride)
-{
-	pWidth += pX; 
-	pHeight += pY;
-	pSourcePixels += (pSourceX*3) + (pSourceY * pSourceStride);
-	for( int y = pY ; y < mHeight && y < pHeight ; y++, pSourcePixels += pSourceStride )
-	{
-		const uint8_t* pixel = pSourcePixels;
-		for( int x = pX ; x < mWidth && x < pWidth ; x++, pixel += 3 )
+
+		for( int n = 0 ; n < 4 ; n++ )
 		{
-			WritePixel(x,y,pixel[0],pixel[1],pixel[2]);
+			const float dy = mY[(n+1)&3] - mY[n];
+			mDXDY[n] = dy != 0.0f ? (mX[(n+1)&3] - mX[n]) / dy : 0.0f;
 		}
 	}
-}
 
-void DrawBuffer::BlitRGBA(const uint8_t* pSourcePixels,int pX,int pY,int pSourceWidth,int pSourceHeight,bool pPreMultipliedAlpha)
-{
-	int EndX = pSourceWidth + pX; 
-	int EndY = pSourceHeight + pY;
-	if( pPreMultipliedAlpha )
+	/**
+	 * @brief The left and right of the part of the box between pTop and pBottom.
+	 * As the box is convex that is the left and right of the parts of its edges that are between them.
+	 * @return false if none of the box is there.
+	 */
+	bool GetRowSpan(float pTop,float pBottom,float& rLeft,float& rRight)const
 	{
-		for( int y = pY ; y < mHeight && y < EndY ; y++, pSourcePixels += pSourceWidth * 4 )
+		bool found = false;
+		for( int n = 0 ; n < 4 ; n++ )
 		{
-			const uint8_t* pixel = pSourcePixels;
-			for( int x = pX ; x < mWidth && x < EndX ; x++, pixel += 4 )
+			const float y0 = mY[n], y1 = mY[(n+1)&3];
+			const float top = std::max(pTop,std::min(y0,y1));
+			const float bottom = std::min(pBottom,std::max(y0,y1));
+			if( top > bottom )
+				continue;
+
+			float xa = mX[n], xb = mX[(n+1)&3];
+			if( y0 != y1 )
 			{
-				BlendPreAlphaPixel(x,y,pixel);
+				xa = mX[n] + ((top - y0) * mDXDY[n]);
+				xb = mX[n] + ((bottom - y0) * mDXDY[n]);
 			}
+			rLeft = found ? std::min(rLeft,std::min(xa,xb)) : std::min(xa,xb);
+			rRight = found ? std::max(rRight,std::max(xa,xb)) : std::max(xa,xb);
+			found = true;
 		}
+		return found;
 	}
-	else
+};
+
+/**
+ * @brief An ellipse, or the ring between two ellipses, that can be cut down to the part between two angles. Used to draw circles, ellipses and arcs.
+ * For each row it works out the runs of pixels it covers, at most a few, so every row is drawn once.
+ * Everything is worked out from the centre and the row, never the clip rect, so drawing in tiles gives the same pixels.
+ */
+struct EllipseArcShape
+{
+	/**
+	 * @brief Runs of pixels in a row, from[n] up to but not including to[n]. In order and not overlapping.
+	 */
+	struct Runs
 	{
-		for( int y = pY ; y < mHeight && y < EndY ; y++, pSourcePixels += pSourceWidth * 4 )
+		int count = 0;
+		int from[4],to[4];
+
+		void Add(int pFrom,int pTo)
 		{
-			const uint8_t* pixel = pSourcePixels;
-			for( int x = pX ; x < mWidth && x < EndX ; x++, pixel += 4 )
+			if( pFrom < pTo )
 			{
-				BlendPixel(x,y,pixel);
+				assert(count < 4);
+				from[count] = pFrom;
+				to[count] = pTo;
+				count++;
 			}
 		}
-	}
-}
 
-void DrawBuffer::BlitRGBA(const uint8_t* pSourcePixels,int pX,int pY,int pWidth,int pHeight,int pSourceX,int pSourceY,int pSourceStride,bool pPreMultipliedAlpha)
-{
-	pWidth += pX; 
-	pHeight += pY;
-	pSourcePixels += (pSourceX*4) + (pSourceY * pSourceStride);
-	if( pPreMultipliedAlpha )
-	{
-		for( int y = pY ; y < mHeight && y < pHeight ; y++, pSourcePixels += pSourceStride )
+		static Runs Intersect(const Runs& pA,const Runs& pB)
 		{
-			const uint8_t* pixel = pSourcePixels;
-			for( int x = pX ; x < mWidth && x < pWidth ; x++, pixel += 4 )
+			Runs both;
+			for( int a = 0 ; a < pA.count ; a++ )
 			{
-				BlendPreAlphaPixel(x,y,pixel);
+				for( int b = 0 ; b < pB.count ; b++ )
+				{
+					both.Add(std::max(pA.from[a],pB.from[b]),std::min(pA.to[a],pB.to[b]));
+				}
 			}
+			return both;
 		}
+	};
+
+	float mCentreX,mCentreY;
+	float mRadiusX,mRadiusY;
+	float mInnerRadiusX,mInnerRadiusY;	//!< The hole in the middle, zero for none.
+
+	bool mHasWedge = false;
+	float mFromAngle = 0.0f,mSweep = 360.0f;	//!< In degrees, clockwise from pointing right.
+	float mStartNormal[2],mEndNormal[2],mMiddle[2];	//!< Point into the wedge from its two sides, and down the middle of it.
+
+	EllipseArcShape(float pCentreX,float pCentreY,float pRadiusX,float pRadiusY,float pInnerRadiusX = 0.0f,float pInnerRadiusY = 0.0f):
+		mCentreX(pCentreX),mCentreY(pCentreY),
+		mRadiusX(pRadiusX),mRadiusY(pRadiusY),
+		mInnerRadiusX(pInnerRadiusX > 0.0f && pInnerRadiusY > 0.0f ? pInnerRadiusX : 0.0f),
+		mInnerRadiusY(pInnerRadiusX > 0.0f && pInnerRadiusY > 0.0f ? pInnerRadiusY : 0.0f)
+	{
 	}
-	else
+
+	/**
+	 * @brief Keeps only the part from pFromAngle going clockwise round to pToAngle, in degrees with 0 pointing right.
+	 * At 360 degrees or more apart it's all kept.
+	 * @return false if there is nothing left to draw.
+	 */
+	bool SetWedge(float pFromAngle,float pToAngle)
+	{
+		mSweep = pToAngle - pFromAngle;
+		if( !(mSweep > 0.0f) )
+			return false;
+		if( mSweep >= 360.0f )
+			return true;
+
+		mHasWedge = true;
+		mFromAngle = pFromAngle;
+		float from[2],to[2];
+		GetDirection(pFromAngle,from);
+		GetDirection(pToAngle,to);
+		GetDirection(pFromAngle + (mSweep * 0.5f),mMiddle);
+		mStartNormal[0] = -from[1];
+		mStartNormal[1] = from[0];
+		mEndNormal[0] = to[1];
+		mEndNormal[1] = -to[0];
+		return true;
+	}
+
+	/**
+	 * @brief Which way pDegrees points. Exact for multiples of 90 so arcs that start or end on them are square with the pixels.
+	 */
+	static void GetDirection(float pDegrees,float rDirection[2])
 	{
-		for( int y = pY ; y < mHeight && y < pHeight ; y++, pSourcePixels += pSourceStride )
+		float degrees = fmodf(pDegrees,360.0f);
+		if( degrees < 0.0f )
+			degrees += 360.0f;
+
+		const float quarters = degrees / 90.0f;
+		if( quarters == floorf(quarters) )
 		{
-			const uint8_t* pixel = pSourcePixels;
-			for( int x = pX ; x < mWidth && x < pWidth ; x++, pixel += 4 )
-			{
-				BlendPixel(x,y,pixel);
-			}
+			const int quarter = (int)quarters & 3;
+			rDirection[0] = (float)(quarter == 0 ? 1 : (quarter == 2 ? -1 : 0));
+			rDirection[1] = (float)(quarter == 1 ? 1 : (quarter == 3 ? -1 : 0));
+			return;
 		}
+		rDirection[0] = cosf(degrees * 3.14159265358979f / 180.0f);
+		rDirection[1] = sinf(degrees * 3.14159265358979f / 180.0f);
 	}
-}
-
-void DrawBuffer::Blit(const DrawBuffer& pImage,int pX,int pY)
-{
-	// This is ripe for a big win using memcpy. But for now, just make it work!
-	const int width = pX + pImage.mWidth; 
-	const int height = pY + pImage.mHeight;
-	
-	const uint8_t* sourcePixels = pImage.mPixels.data();
 
-	if( pImage.mHasAlpha )
+	/**
+	 * @brief The pixels that can be drawn to, with pGrow pixels more all round.
+	 */
+	Rect GetBounds(float pGrow)const
 	{
-		for( int y = pY ; y < mHeight && y < height ; y++, sourcePixels += pImage.mStride )
+		float left = mCentreX - mRadiusX, right = mCentreX + mRadiusX;
+		float top = mCentreY - mRadiusY, bottom = mCentreY + mRadiusY;
+		if( mHasWedge )
 		{
-			const uint8_t* pixel = sourcePixels;
-			for( int x = pX ; x < mWidth && x < width ; x++, pixel += pImage.mPixelSize )
+			// The centre, the ends of the arc and the sides of the ellipse the arc goes past.
+			left = right = mCentreX;
+			top = bottom = mCentreY;
+			auto addAngle = [&](float pAngle)
+			{
+				float direction[2];
+				GetDirection(pAngle,direction);
+				const float x = mCentreX + (mRadiusX * direction[0]);
+				const float y = mCentreY + (mRadiusY * direction[1]);
+				left = std::min(left,x);
+				right = std::max(right,x);
+				top = std::min(top,y);
+				bottom = std::max(bottom,y);
+			};
+			addAngle(mFromAngle);
+			addAngle(mFromAngle + mSweep);
+			for( int n = 0 ; n < 4 ; n++ )
 			{
-				WritePixel(x,y,pixel[RED_PIXEL_INDEX],pixel[GREEN_PIXEL_INDEX],pixel[BLUE_PIXEL_INDEX],pixel[ALPHA_PIXEL_INDEX]);
+				float past = fmodf((n * 90.0f) - mFromAngle,360.0f);
+				if( past < 0.0f )
+					past += 360.0f;
+				if( past <= mSweep )
+					addAngle(n * 90.0f);
 			}
 		}
+		return Rect((int)floorf(left - pGrow),(int)floorf(top - pGrow),(int)floorf(right + pGrow) + 1,(int)floorf(bottom + pGrow) + 1);
 	}
-	else
+
+	/**
+	 * @brief The runs of pixels in row pY, between pLeft and pRight, whose centres are inside the shape after its edges are moved out by pGrow.
+	 * So a pGrow of a half gives every pixel with some of the shape in it, and minus a half the pixels that are all inside.
+	 */
+	Runs GetRuns(int pY,float pGrow,int pLeft,int pRight)const
 	{
-		for( int y = pY ; y < mHeight && y < height ; y++, sourcePixels += pImage.mStride )
+		Runs runs;
+		const float y = pY - mCentreY;
+		int from,to;
+		if( !GetEllipseRun(mRadiusX,mRadiusY,pGrow,y,from,to) )
+			return runs;
+		from = std::max(from,pLeft);
+		to = std::min(to,pRight);
+
+		int holeFrom,holeTo;
+		if( GetEllipseRun(mInnerRadiusX,mInnerRadiusY,-pGrow,y,holeFrom,holeTo) )
 		{
-			const uint8_t* pixel = sourcePixels;
-			for( int x = pX ; x < mWidth && x < width ; x++, pixel += pImage.mPixelSize )
-			{
-				WritePixel(x,y,pixel[RED_PIXEL_INDEX],pixel[GREEN_PIXEL_INDEX],pixel[BLUE_PIXEL_INDEX]);
-			}
+			runs.Add(from,std::min(to,holeFrom));
+			runs.Add(std::max(from,holeTo),to);
+		}
+		else
+		{
+			runs.Add(from,to);
 		}
-	}
-}
 
-void DrawBuffer::Blend(const DrawBuffer& pImage,int pX,int pY)
-{
-	// This is ripe for a big win using memcpy. But for now, just make it work!
-	const int width = pX + pImage.mWidth; 
-	const int height = pY + pImage.mHeight;
-	
-	const uint8_t* sourcePixels = pImage.mPixels.data();
+		if( mHasWedge )
+		{
+			runs = Runs::Intersect(runs,GetWedgeRuns(pY,pGrow));
+		}
+		return runs;
+	}
 
-	if( pImage.mPreMultipliedAlpha )
+	/**
+	 * @brief The runs of pixels in row pY inside the wedge, after its sides are moved out by pGrow.
+	 */
+	Runs GetWedgeRuns(int pY,float pGrow)const
 	{
-		for( int y = pY ; y < mHeight && y < height ; y++, sourcePixels += pImage.mStride )
+		assert(mHasWedge);
+		const float y = pY - mCentreY;
+
+		// Less than half way round it's inside both sides, more and it's inside either.
+		Runs wedge;
+		int startFrom,startTo,endFrom,endTo;
+		GetHalfPlaneRun(mStartNormal,y,pGrow,startFrom,startTo);
+		GetHalfPlaneRun(mEndNormal,y,pGrow,endFrom,endTo);
+		if( mSweep <= 180.0f )
 		{
-			const uint8_t* pixel = sourcePixels;
-			for( int x = pX ; x < mWidth && x < width ; x++, pixel += pImage.mPixelSize )
-			{
-				BlendPreAlphaPixel(x,y,pixel[RED_PIXEL_INDEX],pixel[GREEN_PIXEL_INDEX],pixel[BLUE_PIXEL_INDEX],pixel[ALPHA_PIXEL_INDEX]);
-			}
+			int middleFrom,middleTo;
+			GetHalfPlaneRun(mMiddle,y,pGrow,middleFrom,middleTo);
+			wedge.Add(std::max(std::max(startFrom,endFrom),middleFrom),std::min(std::min(startTo,endTo),middleTo));
 		}
+		else if( std::max(startFrom,endFrom) <= std::min(startTo,endTo) )
+		{
+			wedge.Add(std::min(startFrom,endFrom),std::max(startTo,endTo));
+		}
+		else
+		{
+			wedge.Add(std::min(startFrom,endFrom),std::min(startTo,endTo));
+			wedge.Add(std::max(startFrom,endFrom),std::max(startTo,endTo));
+		}
+		return wedge;
 	}
-	else if( pImage.mHasAlpha )
+
+	/**
+	 * @brief How much of the pixel is inside, from how far its centre is from each edge. Half a pixel either side of an edge is blended.
+	 */
+	float GetCoverage(int pX,int pY)const
 	{
-		for( int y = pY ; y < mHeight && y < height ; y++, sourcePixels += pImage.mStride )
+		const float x = pX - mCentreX;
+		const float y = pY - mCentreY;
+		float coverage = std::min(std::max(0.5f - GetEllipseDistance(mRadiusX,mRadiusY,x,y),0.0f),1.0f);
+		if( mInnerRadiusX > 0.0f )
 		{
-			const uint8_t* pixel = sourcePixels;
-			for( int x = pX ; x < mWidth && x < width ; x++, pixel += pImage.mPixelSize )
+			coverage = std::min(coverage,std::max(0.5f + GetEllipseDistance(mInnerRadiusX,mInnerRadiusY,x,y),0.0f));
+		}
+
+		if( mHasWedge )
+		{
+			const float start = std::min(std::max(0.5f + (mStartNormal[0] * x) + (mStartNormal[1] * y),0.0f),1.0f);
+			const float end = std::min(std::max(0.5f + (mEndNormal[0] * x) + (mEndNormal[1] * y),0.0f),1.0f);
+			if( mSweep <= 180.0f )
+			{
+				const float middle = std::min(std::max(0.5f + (mMiddle[0] * x) + (mMiddle[1] * y),0.0f),1.0f);
+				coverage = std::min(coverage,std::min(std::min(start,end),middle));
+			}
+			else
 			{
-				BlendPixel(x,y,pixel[RED_PIXEL_INDEX],pixel[GREEN_PIXEL_INDEX],pixel[BLUE_PIXEL_INDEX],pixel[ALPHA_PIXEL_INDEX]);
+				coverage = std::min(coverage,std::max(start,end));
 			}
 		}
+		return coverage;
 	}
-	else
+
+private:
+	/**
+	 * @brief The run of pixels on row pY, from the centre, inside and not on the edge of the ellipse grown by pGrow.
+	 * Scaling the ellipse so its smaller radius grows by pGrow moves every part of its edge at least that far.
+	 */
+	bool GetEllipseRun(float pRadiusX,float pRadiusY,float pGrow,float pY,int& rFrom,int& rTo)const
 	{
-		Blit(pImage,pX,pY);
+		const float smaller = std::min(pRadiusX,pRadiusY);
+		if( smaller <= 0.0f || smaller + pGrow <= 0.0f )
+			return false;
+
+		const float scale = (smaller + pGrow) / smaller;
+		const float radiusX = pRadiusX * scale;
+		const float radiusY = pRadiusY * scale;
+		if( fabsf(pY) > radiusY )
+			return false;
+
+		// Worked out this way whole number circles are exact, so pixels on the edge are left out the same every time.
+		const float halfWidth = radiusX * sqrtf((radiusY * radiusY) - (pY * pY)) / radiusY;
+		rFrom = (int)floorf(mCentreX - halfWidth) + 1;
+		rTo = (int)ceilf(mCentreX + halfWidth);
+		return rFrom < rTo;
 	}
-}
-
-
-void DrawBuffer::DrawLineH(int pFromX,int pFromY,int pToX,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
-{
-	if( pFromY < 0 || pFromY >= mHeight )
-		return;
 
-	pFromX = std::max(0,std::min(mWidth,pFromX));
-	pToX = std::max(0,std::min(mWidth,pToX));
-
-	if( pFromX == pToX )
-		return;
-	
-	if( pFromX > pToX )
-		std::swap(pFromX,pToX);
-
-	uint8_t *dest = mPixels.data() + (pFromX * mPixelSize) + (pFromY * mStride);
-	for( int x = pFromX ; x <= pToX && x < mWidth ; x++, dest += mPixelSize )
+	/**
+	 * @brief The run of pixels on row pY, from the centre, less than pGrow outside the edge through the centre facing pNormal.
+	 */
+	void GetHalfPlaneRun(const float pNormal[2],float pY,float pGrow,int& rFrom,int& rTo)const
 	{
-		WRITE_RGB_TO_PIXEL(dest,pRed,pGreen,pBlue);
-		if( mHasAlpha )
+		rFrom = -(1<<30);
+		rTo = 1<<30;
+
+		// Inside where pNormal[0] * x >= rest.
+		const float rest = -pGrow - (pNormal[1] * pY);
+		if( pNormal[0] == 0.0f )
 		{
-			dest[3] = pAlpha;
+			if( rest > 0.0f )
+				rTo = rFrom;
+			return;
 		}
+
+		const float limit = std::min(std::max(mCentreX + (rest / pNormal[0]),-1.0e9f),1.0e9f);
+		if( pNormal[0] > 0.0f )
+			rFrom = (int)ceilf(limit);
+		else
+			rTo = (int)floorf(limit) + 1;
 	}
 
-}
+	/**
+	 * @brief How far outside the ellipse the point is, negative inside.
+	 * How much the ellipse has to be scaled to go through the point, over how fast that changes. Exact for circles and very close near the edge of others.
+	 */
+	static float GetEllipseDistance(float pRadiusX,float pRadiusY,float pX,float pY)
+	{
+		const float gradientX = pX / (pRadiusX * pRadiusX);
+		const float gradientY = pY / (pRadiusY * pRadiusY);
+		const float gradient = sqrtf((gradientX * gradientX) + (gradientY * gradientY));
+		if( gradient < 1.0e-6f )
+			return -std::min(pRadiusX,pRadiusY);
+
+		const float scale = sqrtf((pX * gradientX) + (pY * gradientY));
+		return (scale - 1.0f) * scale / gradient;
+	}
+};
 
-void DrawBuffer::DrawLineV(int pFromX,int pFromY,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+/**
+ * @brief The half width of each row of an ellipse with whole number radii, the pixels whose centres are inside and not on its edge.
+ * Going from one row to the next it only moves a little, so it is stepped there with integer maths and no square root.
+ */
+struct EllipseHalfWidths
 {
-	if( pFromX < 0 || pFromX >= mWidth )
-		return;
-
-	pFromY = std::max(0,std::min(mHeight,pFromY));
-	pToY = std::max(0,std::min(mHeight,pToY));
-
-	if( pFromY == pToY )
-		return;
-
-	if( pFromY > pToY )
-		std::swap(pFromY,pToY);
-
+	const int64_t mRadiusXSquared,mRadiusYSquared;
+	const int64_t mLimit;
+	const int mRadiusY;
+	int mHalfWidth = 0;
+	int64_t mWidthPart = 0;	//!< mHalfWidth * mHalfWidth * mRadiusYSquared
+
+	EllipseHalfWidths(int pRadiusX,int pRadiusY):
+		mRadiusXSquared((int64_t)pRadiusX * pRadiusX),
+		mRadiusYSquared((int64_t)pRadiusY * pRadiusY),
+		mLimit(mRadiusXSquared * mRadiusYSquared),
+		mRadiusY(pRadiusY)
+	{
+	}
 
-	uint8_t *dest = mPixels.data() + (pFromX * mPixelSize) + (pFromY*mStride);
-	for( int y = pFromY ; y <= pToY && y < mHeight ; y++, dest += mStride )
+	/**
+	 * @brief The half width of row pY from the centre, -1 if the row is outside.
+	 */
+	int Get(int pY)
 	{
-		WRITE_RGB_TO_PIXEL(dest,pRed,pGreen,pBlue);
-		if( mHasAlpha )
+		if( pY <= -mRadiusY || pY >= mRadiusY )
+			return -1;
+
+		// Inside when x * x * ry * ry + y * y * rx * rx < rx * rx * ry * ry.
+		const int64_t room = mLimit - ((int64_t)pY * pY * mRadiusXSquared);
+		while( mWidthPart + (((2 * mHalfWidth) + 1) * mRadiusYSquared) < room )
+		{
+			mWidthPart += ((2 * mHalfWidth) + 1) * mRadiusYSquared;
+			mHalfWidth++;
+		}
+		while( mWidthPart >= room )
 		{
-			dest[3] = pAlpha;
+			mHalfWidth--;
+			mWidthPart -= ((2 * mHalfWidth) + 1) * mRadiusYSquared;
 		}
+		return mHalfWidth;
 	}
+};
 
-}
-
-void DrawBuffer::DrawLine(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
+/**
+ * @brief The shape for the ellipses and arcs that are not anti-aliased, a pWidth pixel outline or filled when pWidth is zero.
+ * Pixels with their centre on the edge are left out, so a radius of r is 2r - 1 pixels across as the circles always have been.
+ */
+static EllipseArcShape MakeEllipseShape(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,int pWidth)
 {
-	if( pFromX == pToX )
-		DrawLineV(pFromX,pFromY,pToY,pRed,pGreen,pBlue);
-	else if( pFromY == pToY )
-		DrawLineH(pFromX,pFromY,pToX,pRed,pGreen,pBlue);
-	else
-		DrawLineBresenham(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue);
+	if( pWidth > 0 )
+		return EllipseArcShape((float)pCenterX,(float)pCenterY,(float)pRadiusX,(float)pRadiusY,(float)(pRadiusX - pWidth),(float)(pRadiusY - pWidth));
+	return EllipseArcShape((float)pCenterX,(float)pCenterY,(float)pRadiusX,(float)pRadiusY);
 }
 
-void DrawBuffer::DrawLine(int pFromX,int pFromY,int pToX,int pToY,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
+/**
+ * @brief The shape for the anti-aliased ellipses and arcs, everything in fixed point. The outline is centred on the radii, filled when pWidth is zero.
+ */
+static EllipseArcShape MakeEllipseShapeAA(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,int pWidth)
 {
-	// If one or less pixel width then draw normal line quickly.
-	if( pWidth < 2 )
+	const float centreX = (float)pCenterX / FIXED_POINT_ONE;
+	const float centreY = (float)pCenterY / FIXED_POINT_ONE;
+	const float radiusX = (float)pRadiusX / FIXED_POINT_ONE;
+	const float radiusY = (float)pRadiusY / FIXED_POINT_ONE;
+	const float halfWidth = (float)pWidth / (FIXED_POINT_ONE * 2);
+	if( pWidth > 0 )
+		return EllipseArcShape(centreX,centreY,radiusX + halfWidth,radiusY + halfWidth,radiusX - halfWidth,radiusY - halfWidth);
+	return EllipseArcShape(centreX,centreY,radiusX,radiusY);
+}
+
+/**
+ * @brief A quarter circle for the corners of the rounded rectangles, worked out once for each radius and kept by GetRoundedCorner.
+ * The anti-aliased tables are by row and column in from the outside edges of the rectangle, the circle's centre being pRadius in along both.
+ * The midpoint tables are for the ones that are not anti-aliased, so they keep the shape they have always had.
+ */
+struct RoundedCorner
+{
+	const int mRadius;
+	std::vector<uint8_t> mCoverage;	//!< mRadius rows of mRadius, how much of each pixel is inside the circle.
+	std::vector<int> mFirstCovered;	//!< For each row the first column with some coverage.
+	std::vector<int> mFirstSolid;	//!< For each row the first column that is all covered, the ones after it are too.
+	std::vector<int> mMidpointFrom;	//!< By rows out from the circle's centre, the midpoint circle plotted from mMidpointFrom to mMidpointTo out from the centre.
+	std::vector<int> mMidpointTo;
+
+	RoundedCorner(int pRadius):
+		mRadius(pRadius),
+		mCoverage(pRadius * pRadius),
+		mFirstCovered(pRadius,pRadius),
+		mFirstSolid(pRadius,pRadius),
+		mMidpointFrom(pRadius,pRadius),
+		mMidpointTo(pRadius,-1)
 	{
-		DrawLine(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue);
+		// Each pixel is cut into thin columns and the circle covers each one from its edge down. That is only accurate where the edge is
+		// flatter than 45 degrees, but the corner is the same flipped along the diagonal so the other half is a copy.
+		const int SLICES = 16;
+		const float radius = (float)pRadius;
+		for( int row = 0 ; row < pRadius ; row++ )
+		{
+			for( int column = row ; column < pRadius ; column++ )
+			{
+				float area = 0.0f;
+				for( int s = 0 ; s < SLICES ; s++ )
+				{
+					const float x = radius - (column + ((s + 0.5f) / SLICES));
+					const float edge = radius - sqrtf((radius * radius) - (x * x));
+					area += std::min(std::max((row + 1) - edge,0.0f),1.0f);
+				}
+				const uint8_t coverage = (uint8_t)((area * 255.0f / SLICES) + 0.5f);
+				mCoverage[(row * pRadius) + column] = coverage;
+				mCoverage[(column * pRadius) + row] = coverage;
+			}
+		}
+
+		for( int row = 0 ; row < pRadius ; row++ )
+		{
+			const uint8_t* coverage = mCoverage.data() + (row * pRadius);
+			int column = 0;
+			while( column < pRadius && coverage[column] == 0 )
+				column++;
+			mFirstCovered[row] = column;
+			while( column < pRadius && coverage[column] < 255 )
+				column++;
+			mFirstSolid[row] = column;
+		}
+
+		auto plot = [this](int pOut,int pRow)
+		{
+			mMidpointFrom[pRow] = std::min(mMidpointFrom[pRow],pOut);
+			mMidpointTo[pRow] = std::max(mMidpointTo[pRow],pOut);
+		};
+
+		int x = pRadius-1;
+		int y = 0;
+		int dx = 1;
+		int dy = 1;
+		int err = dx - (pRadius << 1);
+		while (x >= y)
+		{
+			plot(x,y);
+			plot(y,x);
+			if (err <= 0)
+			{
+				y++;
+				err += dy;
+				dy += 2;
+			}
+			if (err > 0)
+			{
+				x--;
+				dx += 2;
+				err += dx - (pRadius << 1);
+			}
+		}
 	}
-	else if( pFromX == pToX )
+};
+
+/**
+ * @brief The RoundedCorner for a radius. The same few radii get used over and over, every button is one, so the last few are kept.
+ * Display list tiles are drawn on more than one thread, hence the lock, and the shared pointer keeps a corner alive while it is being used.
+ */
+static std::shared_ptr<const RoundedCorner> GetRoundedCorner(int pRadius)
+{
+	static constexpr size_t CACHE_SIZE = 16;
+	static std::mutex cacheLock;
+	static std::list<std::shared_ptr<const RoundedCorner>> cache;	// Most recently used at the front.
+
+	assert( pRadius > 0 );
+	std::lock_guard<std::mutex> lock(cacheLock);
+	for( auto found = cache.begin() ; found != cache.end() ; found++ )
 	{
-		// Just do a box.
-		FillRectangle(pFromX - (pWidth/2),pFromY,pToX + (pWidth/2),pToY,pRed,pGreen,pBlue);
+		if( (*found)->mRadius == pRadius )
+		{
+			cache.splice(cache.begin(),cache,found);
+			return cache.front();
+		}
 	}
-	else if( pFromY == pToY )
+
+	cache.push_front(std::make_shared<const RoundedCorner>(pRadius));
+	if( cache.size() > CACHE_SIZE )
+		cache.pop_back();
+	return cache.front();
+}
+
+/**
+ * @brief An anti-aliased rounded rectangle covering the pixels from left, top up to but not including right, bottom.
+ * The radius is made to fit, so the corners never meet.
+ */
+struct RoundedRectRows
+{
+	const int mLeft,mTop,mRight,mBottom;
+	const int mRadius;
+	const std::shared_ptr<const RoundedCorner> mCorner;
+
+	RoundedRectRows(int pLeft,int pTop,int pRight,int pBottom,int pRadius):
+		mLeft(pLeft),mTop(pTop),mRight(pRight),mBottom(pBottom),
+		mRadius(std::max(std::min(pRadius,std::min(pRight - pLeft,pBottom - pTop) / 2),0)),
+		mCorner(mRadius > 0 ? GetRoundedCorner(mRadius) : nullptr)
 	{
-		FillRectangle(pFromX,pFromY - (pWidth/2),pToX,pToY + (pWidth/2),pRed,pGreen,pBlue);
 	}
-	else
+
+	bool GetIsEmpty()const{return mLeft >= mRight || mTop >= mBottom;}
+
+	/**
+	 * @brief The pixels on row pY with some coverage and, inside those, the ones that are all covered. False if the row is outside.
+	 */
+	bool GetRow(int pY,int& rFrom,int& rTo,int& rSolidFrom,int& rSolidTo)const
+	{
+		if( pY < mTop || pY >= mBottom )
+			return false;
+
+		const int row = std::min(pY - mTop,mBottom - 1 - pY);
+		const int covered = row < mRadius ? mCorner->mFirstCovered[row] : 0;
+		const int solid = row < mRadius ? mCorner->mFirstSolid[row] : 0;
+		rFrom = mLeft + covered;
+		rTo = mRight - covered;
+		rSolidFrom = mLeft + solid;
+		rSolidTo = mRight - solid;
+		return true;
+	}
+
+	uint32_t GetCoverage(int pX,int pY)const
 	{
-		// Do it the hard way...
-		// Deals with all 8 quadrants.
-		int deltax = pToX - pFromX;	// The difference between the x's
-		int deltay = pToY - pFromY;	// The difference between the y's	
-		int x = pFromX;				// Start x off at the first pixel
-		int y = pFromY;				// Start y off at the first pixel
+		if( pX < mLeft || pX >= mRight || pY < mTop || pY >= mBottom )
+			return 0;
+
+		const int column = std::min(pX - mLeft,mRight - 1 - pX);
+		const int row = std::min(pY - mTop,mBottom - 1 - pY);
+		if( column < mRadius && row < mRadius )
+			return mCorner->mCoverage[(row * mRadius) + column];
+		return 255;
+	}
+};
 
-		int xinc1 = 1;
-		int xinc2 = 1;
-		int yinc1 = 1;
-		int yinc2 = 1;
+/**
+ * @brief The steps of a Bresenham line, so the thin and thick lines plot the same points and can both be clipped before drawing.
+ * Deals with all 8 quadrants. Each step moves one along the major axis and, when the numerator goes past the denominator, one along the minor.
+ * The deltas and the numerator are 64 bit, for ends far off screen they don't fit in an int. The point, x and y, is always on the line so does.
+ */
+struct LineSteps
+{
+	int x,y;		//!< The point the line is at.
+	int xinc1,yinc1;	//!< Change in x and y when numerator >= denominator, the minor axis.
+	int xinc2,yinc2;	//!< Change in x and y for every step, the major axis.
+	int64_t den,num,numadd;
+	int64_t numpixels;	//!< The last step, there are numpixels + 1 points.
 
-		if( deltax < 0 )
-		{// The x-values are decreasing
-			deltax = -deltax;
-			xinc1 = -1;
-			xinc2 = -1;
-		}
+	LineSteps(int pFromX,int pFromY,int pToX,int pToY)
+	{
+		int64_t deltax = (int64_t)pToX - pFromX;	// The difference between the x's
+		int64_t deltay = (int64_t)pToY - pFromY;	// The difference between the y's
+		x = pFromX;					// Start x off at the first pixel
+		y = pFromY;					// Start y off at the first pixel
 
-		if( deltay < 0 )
-		{// The y-values are decreasing
-			deltay = -deltay;
-			yinc1 = -1;
-			yinc2 = -1;
-		}
+		xinc1 = xinc2 = (deltax < 0 ? -1 : 1);
+		yinc1 = yinc2 = (deltay < 0 ? -1 : 1);
+		deltax = std::abs(deltax);
+		deltay = std::abs(deltay);
 
-		int den,num,numadd,numpixels,curpixel;
 		if( deltax >= deltay )
 		{// There is at least one x-value for every y-value
 			xinc1 = 0;	// Don't change the x when numerator >= denominator
 			yinc2 = 0;	// Don't change the y for every iteration
 			den = deltax;
-			num = deltax>>1;
 			numadd = deltay;
 			numpixels = deltax;// There are more x-values than y-values
 		}
@@ -607,537 +1085,5031 @@ void DrawBuffer::DrawLine(int pFromX,int pFromY,int pToX,int pToY,int pWidth,uin
 			xinc2 = 0;	// Don't change the x for every iteration
 			yinc1 = 0;	// Don't change the y when numerator >= denominator
 			den = deltay;
-			num = deltay>>1;
 			numadd = deltax;
 			numpixels = deltay;// There are more y-values than x-values
 		}
+		num = den>>1;
+	}
 
-		x -= pWidth/2;
-		y -= pWidth/2;
-		for( curpixel = 0 ; curpixel <= numpixels ; curpixel++ )
+	inline void Step()
+	{
+		num += numadd;	// Increase the numerator by the top of the fraction
+		if (num >= den)	// Check if numerator >= denominator
 		{
-			if( x > -1 && x < mWidth && y > -1 && y < mHeight )
-			{
-				for( int ly = 0 ; ly < pWidth ; ly++ )
-				{
-					uint8_t *dest = mPixels.data() + (x * mPixelSize) + ((y+ly) * mStride);
-					if( mHasAlpha )
-					{
-						for( int lx = 0 ; lx < pWidth ; lx++, dest += mPixelSize )
-						{
-							WRITE_RGB_TO_PIXEL(dest,pRed,pGreen,pBlue);
-							dest[ALPHA_PIXEL_INDEX] = 255;
-						}
-					}
-					else
-					{
-						for( int lx = 0 ; lx < pWidth ; lx++, dest += mPixelSize )
-						{
-							WRITE_RGB_TO_PIXEL(dest,pRed,pGreen,pBlue);
-						}
-					}
-				}
-			}
-
-			num += numadd;	// Increase the numerator by the top of the fraction
-			if (num >= den)	// Check if numerator >= denominator
-			{
-				num -= den;	// Calculate the new numerator value
-				x += xinc1;	// Change the x as appropriate
-				y += yinc1;	// Change the y as appropriate
-			}
-			x += xinc2;		// Change the x as appropriate
-			y += yinc2;		// Change the y as appropriate
+			num -= den;	// Calculate the new numerator value
+			x += xinc1;	// Change the x as appropriate
+			y += yinc1;	// Change the y as appropriate
 		}
+		x += xinc2;		// Change the x as appropriate
+		y += yinc2;		// Change the y as appropriate
 	}
-}
 
-void DrawBuffer::DrawLineList(const std::vector<std::array<int,2>>& pPoints,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
-{
-	for( size_t n = 0 ; n < pPoints.size() - 1 ; n++ )
+	/**
+	 * @brief Moves on pSteps in one go, ending up exactly where calling Step pSteps times would.
+	 */
+	void Skip(int64_t pSteps)
 	{
-		DrawLine(pPoints[n][0],pPoints[n][1],pPoints[n+1][0],pPoints[n+1][1],pWidth,pRed,pGreen,pBlue);
+		const int64_t total = num + (pSteps * numadd);
+		const int64_t minorSteps = total / den;
+		num = total % den;
+		x = (int)(x + (xinc2 * pSteps) + (xinc1 * minorSteps));
+		y = (int)(y + (yinc2 * pSteps) + (yinc1 * minorSteps));
 	}
-}
 
-void DrawBuffer::DrawCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
-{
-    int x = pRadius-1;
-    int y = 0;
-    int dx = 1;
-    int dy = 1;
-    int err = dx - (pRadius << 1);
+	/**
+	 * @brief Works out the first and last step, from here, where the point is inside pRect. Both axis only ever move one way,
+	 * so these are the steps that are inside in both, worked out from the numerator so they match the points Step gives.
+	 * The products fit in 64 bits while the ends are within 2^30 of the clip rect, a billion pixels off screen.
+	 * @return false if the line never goes in pRect.
+	 */
+	bool Clip(const Rect& pRect,int64_t& rFirst,int64_t& rLast)const
+	{
+		int64_t first = 0;
+		int64_t last = numpixels;
+		const bool xMajor = xinc2 != 0;
+
+		// The major axis moves one for each step.
+		const int64_t major = xMajor ? x : y;
+		const int majorInc = xMajor ? xinc2 : yinc2;
+		const int64_t majorMin = xMajor ? pRect.left : pRect.top;
+		const int64_t majorMax = (xMajor ? pRect.right : pRect.bottom) - 1;
+		first = std::max<int64_t>(first,majorInc > 0 ? majorMin - major : major - majorMax);
+		last = std::min<int64_t>(last,majorInc > 0 ? majorMax - major : major - majorMin);
+
+		// The minor axis has moved (num + step * numadd) / den after each step, find the steps that keep that in range.
+		const int64_t minor = xMajor ? y : x;
+		const int minorInc = xMajor ? yinc1 : xinc1;
+		const int64_t minorMin = xMajor ? pRect.top : pRect.left;
+		const int64_t minorMax = (xMajor ? pRect.bottom : pRect.right) - 1;
+		const int64_t movedMin = minorInc > 0 ? minorMin - minor : minor - minorMax;
+		const int64_t movedMax = minorInc > 0 ? minorMax - minor : minor - minorMin;
+		if( movedMax < 0 )
+			return false;
+		if( numadd == 0 )
+		{
+			if( movedMin > 0 )
+				return false;
+		}
+		else
+		{
+			if( movedMin > 0 )
+				first = std::max<int64_t>(first,((movedMin * den) - num + numadd - 1) / numadd);
+			last = std::min<int64_t>(last,(((movedMax + 1) * den) - num - 1) / numadd);
+		}
 
-    while (x >= y)
-    {
-		WritePixel(pCenterX + x, pCenterY + y,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(pCenterX + y, pCenterY + x,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(pCenterX - y, pCenterY + x,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(pCenterX - x, pCenterY + y,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(pCenterX - x, pCenterY - y,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(pCenterX - y, pCenterY - x,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(pCenterX + y, pCenterY - x,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(pCenterX + x, pCenterY - y,pRed,pGreen,pBlue,pAlpha);
-
-        if (err <= 0)
-        {
-            y++;
-            err += dy;
-            dy += 2;
-        }
-        if (err > 0)
-        {
-            x--;
-            dx += 2;
-            err += (-pRadius << 1) + dx;
-        }
-    }
-}
+		if( first > last )
+			return false;
 
-void DrawBuffer::FillCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
-{
-    int x = pRadius-1;
-    int y = 0;
-    int dx = 1;
-    int dy = 1;
-    int err = dx - (pRadius << 1);
+		rFirst = first;
+		rLast = last;
+		return true;
+	}
+};
 
-    while (x >= y)
-    {
-		DrawLineH(pCenterX - x, pCenterY + y,pCenterX + x,pRed,pGreen,pBlue,pAlpha);
-		DrawLineH(pCenterX - x, pCenterY - y,pCenterX + x,pRed,pGreen,pBlue,pAlpha);
-		DrawLineH(pCenterX - y, pCenterY + x,pCenterX + y,pRed,pGreen,pBlue,pAlpha);
-		DrawLineH(pCenterX - y, pCenterY - x,pCenterX + y,pRed,pGreen,pBlue,pAlpha);
-
-        if (err <= 0)
-        {
-            y++;
-            err += dy;
-            dy += 2;
-        }
-        if (err > 0)
-        {
-            x--;
-            dx += 2;
-            err += (-pRadius << 1) + dx;
-        }
-    }
+/**
+ * @brief Cohen Sutherland out code, which sides of pRect a point is past.
+ */
+static inline int GetOutCode(const Rect& pRect,int pX,int pY)
+{
+	return (pX < pRect.left ? 1 : 0) | (pX >= pRect.right ? 2 : 0) | (pY < pRect.top ? 4 : 0) | (pY >= pRect.bottom ? 8 : 0);
 }
 
-
-void DrawBuffer::DrawRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+/**
+ * @brief Divides rounding down, and up, for any sign of pValue. pDivisor must be more than zero.
+ */
+static inline int64_t FloorDivide(int64_t pValue,int64_t pDivisor)
 {
-	DrawLineH(pFromX,pFromY,pToX,pRed,pGreen,pBlue,pAlpha);
-	DrawLineH(pFromX,pToY,pToX,pRed,pGreen,pBlue,pAlpha);
-
-	DrawLineV(pFromX,pFromY,pToY,pRed,pGreen,pBlue);
-	DrawLineV(pToX,pFromY,pToY,pRed,pGreen,pBlue,pAlpha);
+	const int64_t quotient = pValue / pDivisor;
+	return (pValue % pDivisor) < 0 ? quotient - 1 : quotient;
 }
 
-void DrawBuffer::FillRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+static inline int64_t CeilDivide(int64_t pValue,int64_t pDivisor)
 {
-	pFromY = std::max(0,std::min(mHeight,pFromY));
-	pToY = std::max(0,std::min(mHeight,pToY));
-
-	if( pFromY == pToY )
-		return;
+	return -FloorDivide(-pValue,pDivisor);
+}
 
-	if( pFromY > pToY )
-		std::swap(pFromY,pToY);
+/**
+ * @brief One edge of a polygon for the scan line fill. The points are fixed point and pixel centres are whole numbers.
+ * The edge is kept as a column and remainder so it steps down the rows with integers only, and always from its top end.
+ * So two polygons that share an edge get exactly the same column on every row.
+ */
+struct PolygonEdge
+{
+	int x0,y0;			//!< The top end.
+	int dx,dy;			//!< To the bottom end, dy is more than zero.
+	int firstRow,lastRow;	//!< The rows whose centres the edge crosses, the top one but not the bottom one.
+	int winding;		//!< One if the polygon goes down this edge, minus one if it goes up.
 
-	pFromX = std::max(0,std::min(mWidth,pFromX));
-	pToX = std::max(0,std::min(mWidth,pToX));
+	int64_t column;		//!< The first pixel whose centre is on or to the right of the edge on the current row.
+	int64_t remainder;	//!< How far, in 1/denominator, the edge is to the left of column.
+	int64_t denominator;
+	int64_t stepColumns,stepRemainder;	//!< The change in column and remainder for one row.
 
-	if( pFromX == pToX )
-		return;
-	
-	if( pFromX > pToX )
-		std::swap(pFromX,pToX);
+	PolygonEdge(int pFromX,int pFromY,int pToX,int pToY)
+	{
+		winding = 1;
+		if( pFromY > pToY )
+		{
+			std::swap(pFromX,pToX);
+			std::swap(pFromY,pToY);
+			winding = -1;
+		}
+		x0 = pFromX;
+		y0 = pFromY;
+		dx = pToX - pFromX;
+		dy = pToY - pFromY;
+
+		// Top left rule, a row is in if its centre is on or below the top and above the bottom.
+		firstRow = (int)CeilDivide(pFromY,FIXED_POINT_ONE);
+		lastRow = (int)CeilDivide(pToY,FIXED_POINT_ONE) - 1;
+
+		// Flat edges cross no rows, so are never stepped.
+		denominator = std::max((int64_t)dy * FIXED_POINT_ONE,(int64_t)1);
+		stepColumns = FloorDivide((int64_t)dx * FIXED_POINT_ONE,denominator);
+		stepRemainder = ((int64_t)dx * FIXED_POINT_ONE) - (stepColumns * denominator);
+		column = remainder = 0;
+	}
 
-	for( int y = pFromY ; y <= pToY ; y++ )
+	/**
+	 * @brief Works out column for pRow from scratch, used for the first row drawn.
+	 */
+	void Start(int pRow)
 	{
-		DrawLineH(pFromX,y,pToX,pRed,pGreen,pBlue,pAlpha);
-	}	
-}
+		// The edge is at x0 + ((row centre - y0) * dx / dy), in pixels that's this over denominator.
+		const int64_t x = ((int64_t)x0 * dy) + ((((int64_t)pRow * FIXED_POINT_ONE) - y0) * dx);
+		column = CeilDivide(x,denominator);
+		remainder = (column * denominator) - x;
+	}
 
+	inline void Step()
+	{
+		column += stepColumns;
+		remainder -= stepRemainder;
+		if( remainder < 0 )
+		{
+			remainder += denominator;
+			column++;
+		}
+	}
+};
 
-void DrawBuffer::DrawRoundedRectangle(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+/**
+ * @brief Adds the edges of the closed outline to rEdges, leaving out those that don't cross the centre of a row.
+ */
+static void AddPolygonEdges(std::vector<PolygonEdge>& rEdges,const std::array<int,2>* pPoints,size_t pNumPoints)
 {
-	if( pRadius < 1 )
+	for( size_t n = 0 ; n < pNumPoints ; n++ )
 	{
-		DrawRectangle(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue,pAlpha);
-		return;
+		const std::array<int,2>& from = pPoints[n];
+		const std::array<int,2>& to = pPoints[(n + 1) % pNumPoints];
+		const PolygonEdge edge(from[0],from[1],to[0],to[1]);
+		if( edge.firstRow <= edge.lastRow )
+		{
+			rEdges.push_back(edge);
+		}
 	}
+}
 
-	if( pFromY == pToY )
-		return;
-
-	if( pFromY > pToY )
-		std::swap(pFromY,pToY);
+/**
+ * @brief The scan line fill for all the polygons, using an active edge table. Each span is clipped then filled with one FillRow.
+ * When pConvex is true each row is one span, from the left most to the right most edge, so no sorting.
+ * @return The area drawn to.
+ */
+template<class FORMAT> static Rect FillPolygonEdges(DrawBuffer& pBuffer,std::vector<PolygonEdge>& pEdges,FillRule pRule,bool pConvex,typename FORMAT::PixelType pPixel)
+{
+	const Rect& clip = pBuffer.GetClipRect();
+	Rect drawn;
+	if( pEdges.empty() )
+		return drawn;
 
-	if( pFromX == pToX )
-		return;
-	
-	if( pFromX > pToX )
-		std::swap(pFromX,pToX);
+	std::sort(pEdges.begin(),pEdges.end(),[](const PolygonEdge& pA,const PolygonEdge& pB){return pA.firstRow < pB.firstRow;});
 
-	if( pRadius > pToX - pFromX && pRadius > pToY - pFromY )
-	{
-		pRadius = (pToX - pFromX) / 2;
-		DrawCircle( (pFromX + pToX) / 2 , (pFromY + pToY) / 2 ,pRadius,pRed,pGreen,pBlue,pAlpha);
-		return;
-	}
-	else if( pRadius*2 > pToX - pFromX )
-	{
-		pRadius = (pToX - pFromX) / 2;
-	}
-	else if( pRadius*2 > pToY - pFromY )
+	int top = pEdges.front().firstRow;
+	int bottom = top;
+	for( const auto& edge : pEdges )
 	{
-		pRadius = (pToY - pFromY) / 2;
+		bottom = std::max(bottom,edge.lastRow);
 	}
+	top = std::max(top,clip.top);
+	bottom = std::min(bottom,clip.bottom - 1);
 
-    int x = pRadius-1;
-    int y = 0;
-    int dx = 1;
-    int dy = 1;
-    int err = dx - (pRadius << 1);
+	auto fillSpan = [&](int64_t pLeft,int64_t pRight,int pY)
+	{
+		const int left = (int)std::max<int64_t>(pLeft,clip.left);
+		const int right = (int)std::min<int64_t>(pRight,clip.right);
+		if( left < right )
+		{
+			FillRow<FORMAT>(pBuffer.GetPixelAddress(left,pY),right - left,pPixel);
+			drawn = drawn.Union(Rect(left,pY,right,pY + 1));
+		}
+	};
 
-	// Values I need so that the quadrants are positioned in the corners of the rectangle.
-	const int left = pFromX + pRadius; 
-	const int right = pToX - pRadius;
-	const int top = pFromY + pRadius;
-	const int bottom = pToY - pRadius;
+	std::vector<PolygonEdge*> active;
+	size_t next = 0;
+	for( int y = top ; y <= bottom ; y++ )
+	{
+		// Edges that end above this row leave, the ones that start on or above it join. Those started above the clip rect start here.
+		active.erase(std::remove_if(active.begin(),active.end(),[y](const PolygonEdge* pEdge){return pEdge->lastRow < y;}),active.end());
+		for( ; next < pEdges.size() && pEdges[next].firstRow <= y ; next++ )
+		{
+			if( pEdges[next].lastRow >= y )
+			{
+				pEdges[next].Start(y);
+				active.push_back(&pEdges[next]);
+			}
+		}
 
-    while (x >= y)
-    {
-		WritePixel(left - x, top - y,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(left - y, top - x,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(right + y, top - x,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(right + x, top - y,pRed,pGreen,pBlue,pAlpha);
-
-		WritePixel(right + x, bottom + y,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(right + y, bottom + x,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(left - y, bottom + x,pRed,pGreen,pBlue,pAlpha);
-		WritePixel(left - x, bottom + y,pRed,pGreen,pBlue,pAlpha);
-
-        if (err <= 0)
-        {
-            y++;
-            err += dy;
-            dy += 2;
-        }
-        if (err > 0)
-        {
-            x--;
-            dx += 2;
-            err += (-pRadius << 1) + dx;
-        }
-    }
+		if( pConvex )
+		{
+			if( active.size() >= 2 )
+			{
+				int64_t left = active[0]->column;
+				int64_t right = left;
+				for( const PolygonEdge* edge : active )
+				{
+					left = std::min(left,edge->column);
+					right = std::max(right,edge->column);
+				}
+				fillSpan(left,right,y);
+			}
+		}
+		else
+		{
+			// Insertion sort as the order changes little from one row to the next.
+			for( size_t n = 1 ; n < active.size() ; n++ )
+			{
+				PolygonEdge* edge = active[n];
+				size_t i = n;
+				for( ; i > 0 && active[i-1]->column > edge->column ; i-- )
+				{
+					active[i] = active[i-1];
+				}
+				active[i] = edge;
+			}
 
-	DrawLineH(left,pFromY,right,pRed,pGreen,pBlue,pAlpha);
-	DrawLineH(left,pToY,right,pRed,pGreen,pBlue,pAlpha);
+			// Walk along the row, a span starts when going from outside to inside and ends going back out.
+			int count = 0;
+			int64_t spanStart = 0;
+			for( const PolygonEdge* edge : active )
+			{
+				const bool wasInside = pRule == FILL_RULE_EVEN_ODD ? (count & 1) != 0 : count != 0;
+				count += pRule == FILL_RULE_EVEN_ODD ? 1 : edge->winding;
+				const bool isInside = pRule == FILL_RULE_EVEN_ODD ? (count & 1) != 0 : count != 0;
+				if( !wasInside && isInside )
+				{
+					spanStart = edge->column;
+				}
+				else if( wasInside && !isInside )
+				{
+					fillSpan(spanStart,edge->column,y);
+				}
+			}
+		}
 
-	DrawLineV(pFromX,top,bottom,pRed,pGreen,pBlue,pAlpha);
-	DrawLineV(pToX,top,bottom,pRed,pGreen,pBlue,pAlpha);
+		for( PolygonEdge* edge : active )
+		{
+			edge->Step();
+		}
+	}
+	return drawn;
 }
 
-void DrawBuffer::FillRoundedRectangle(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+/**
+ * @brief Adds up the signed area each edge of a path covers of each pixel, the way font-rs does.
+ * Running along a row adding them up then gives how much of each pixel is inside.
+ * Kept for the columns mLeft to mRight, edges past them are moved on to them which gives the same sums, and the rows mTop to mBottom.
+ * Positions are in the buffer with pixel x covering x to x + 1, and every row is worked out from the ends of the edge,
+ * so a pixel gets the same coverage whatever rows are asked for. That keeps a DisplayList the same as drawing straight to the buffer.
+ */
+struct CoverageAccumulator
 {
-	if( pRadius < 1 )
+	int mLeft,mTop,mRight,mBottom;
+	int mStride;	//!< Room for the column past the right, and the one past that which gets the left overs of edges on the right.
+	std::vector<float> mArea;
+
+	CoverageAccumulator(const Rect& pArea):mLeft(pArea.left),mTop(pArea.top),mRight(pArea.right),mBottom(pArea.bottom),mStride(pArea.GetWidth() + 2)
 	{
-		FillRectangle(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue,pAlpha);
-		return;
+		mArea.resize((size_t)mStride * pArea.GetHeight(),0.0f);
 	}
 
-	if( pFromY == pToY )
-		return;
-
-	if( pFromY > pToY )
-		std::swap(pFromY,pToY);
-
-	if( pFromX == pToX )
-		return;
-	
-	if( pFromX > pToX )
-		std::swap(pFromX,pToX);
+	float* GetRow(int pY){return mArea.data() + ((size_t)(pY - mTop) * mStride);}
 
-	if( pRadius > pToX - pFromX && pRadius > pToY - pFromY )
+	void AddLine(float pFromX,float pFromY,float pToX,float pToY)
 	{
-		pRadius = (pToX - pFromX) / 2;
+		if( pFromY == pToY )
+			return;
+
+		// Split where it crosses the left and the right, the parts outside are moved on to them.
+		float splits[4] = {0.0f};
+		int numSplits = 1;
+		for( const int edge : {mLeft,mRight} )
+		{
+			if( (pFromX < edge) != (pToX < edge) )
+			{
+				splits[numSplits++] = (edge - pFromX) / (pToX - pFromX);
+			}
+		}
+		if( numSplits == 3 && splits[1] > splits[2] )
+		{
+			std::swap(splits[1],splits[2]);
+		}
+		splits[numSplits++] = 1.0f;
+
+		for( int n = 0 ; n < numSplits - 1 ; n++ )
+		{
+			const float x0 = pFromX + ((pToX - pFromX) * splits[n]);
+			const float y0 = pFromY + ((pToY - pFromY) * splits[n]);
+			const float x1 = n == numSplits - 2 ? pToX : pFromX + ((pToX - pFromX) * splits[n+1]);
+			const float y1 = n == numSplits - 2 ? pToY : pFromY + ((pToY - pFromY) * splits[n+1]);
+			AddLineInside(x0,y0,x1,y1);
+		}
+	}
+
+	void AddLineInside(float pFromX,float pFromY,float pToX,float pToY)
+	{
+		float dir = 1.0f;
+		if( pFromY > pToY )
+		{
+			std::swap(pFromX,pToX);
+			std::swap(pFromY,pToY);
+			dir = -1.0f;
+		}
+		if( pFromY == pToY )
+			return;
+
+		const float dxdy = (pToX - pFromX) / (pToY - pFromY);
+		const float right = (float)(mRight - mLeft);
+		const int fromRow = std::max((int)floorf(pFromY),mTop);
+		const int toRow = std::min((int)ceilf(pToY),mBottom);
+		for( int y = fromRow ; y < toRow ; y++ )
+		{
+			const float rowTop = std::max((float)y,pFromY);
+			const float rowBottom = std::min((float)(y + 1),pToY);
+			const float d = (rowBottom - rowTop) * dir;
+			const float xa = std::min(std::max(pFromX + ((rowTop - pFromY) * dxdy) - mLeft,0.0f),right);
+			const float xb = std::min(std::max(pFromX + ((rowBottom - pFromY) * dxdy) - mLeft,0.0f),right);
+			const float x0 = std::min(xa,xb);
+			const float x1 = std::max(xa,xb);
+
+			float* row = GetRow(y);
+			const float x0Floor = floorf(x0);
+			const int x0i = (int)x0Floor;
+			const int x1i = (int)ceilf(x1);
+			if( x1i <= x0i + 1 )
+			{// All in one pixel, what's not covered in it goes to the next one.
+				const float middle = ((xa + xb) * 0.5f) - x0Floor;
+				row[x0i] += d - (d * middle);
+				row[x0i + 1] += d * middle;
+			}
+			else
+			{// Crosses pixels, a triangle in the first and last and even amounts in between.
+				const float s = 1.0f / (x1 - x0);
+				const float x0f = x0 - x0Floor;
+				const float a0 = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+				const float x1f = x1 - x1i + 1.0f;
+				const float am = 0.5f * s * x1f * x1f;
+				row[x0i] += d * a0;
+				if( x1i == x0i + 2 )
+				{
+					row[x0i + 1] += d * (1.0f - a0 - am);
+				}
+				else
+				{
+					const float a1 = s * (1.5f - x0f);
+					row[x0i + 1] += d * (a1 - a0);
+					for( int x = x0i + 2 ; x < x1i - 1 ; x++ )
+					{
+						row[x] += d * s;
+					}
+					const float a2 = a1 + ((x1i - x0i - 3) * s);
+					row[x1i - 1] += d * (1.0f - a2 - am);
+				}
+				row[x1i] += d * am;
+			}
+		}
+	}
+};
+
+/**
+ * @brief Exact, rounded, divide by 255 for any value from 0 to 255*255.
+ * Replaces the integer divide in the blending maths, same trick is used in the vector versions so all code paths give the same result.
+ */
+static inline uint32_t Div255(uint32_t pValue)
+{
+	return ((pValue + 128) * 257) >> 16;
+}
+
+/**
+ * @brief Portable version of the row blend. Source is four bytes per pixel, either in the draw buffer channel order or R G B A.
+ * Does (S*A) + (D*(1-A)), if the dest has alpha the largest of the two alpha values is kept.
+ */
+static void BlendRowScalar(uint8_t* pDest,size_t pDestPixelSize,bool pDestHasAlpha,const uint8_t* pSource,bool pSourceIsRGBA,int pCount)
+{
+	const size_t sourceRed = pSourceIsRGBA ? 0 : RED_PIXEL_INDEX;
+	const size_t sourceBlue = pSourceIsRGBA ? 2 : BLUE_PIXEL_INDEX;
+	for( int n = 0 ; n < pCount ; n++, pDest += pDestPixelSize, pSource += 4 )
+	{
+		const uint32_t sA = pSource[ALPHA_PIXEL_INDEX];
+		const uint32_t dA = 255 - sA;
+
+		const uint32_t r = Div255( (pSource[sourceRed] * sA) + (pDest[RED_PIXEL_INDEX] * dA) );
+		const uint32_t g = Div255( (pSource[GREEN_PIXEL_INDEX] * sA) + (pDest[GREEN_PIXEL_INDEX] * dA) );
+		const uint32_t b = Div255( (pSource[sourceBlue] * sA) + (pDest[BLUE_PIXEL_INDEX] * dA) );
+
+		WRITE_RGB_TO_PIXEL(pDest,r,g,b);
+
+		// If dest has alpha, we need to pic the max value. Blending will just make everything vanish.
+		if( pDestHasAlpha && pDest[ALPHA_PIXEL_INDEX] < sA )
+		{
+			pDest[ALPHA_PIXEL_INDEX] = sA;
+		}
+	}
+}
+
+/**
+ * @brief Portable version of the pre multiplied row blend, does S + (D * A). Source alpha has already been inverted by PreMultiplyAlpha.
+ * Dest alpha is left alone.
+ */
+static void BlendPreAlphaRowScalar(uint8_t* pDest,size_t pDestPixelSize,const uint8_t* pSource,bool pSourceIsRGBA,int pCount)
+{
+	const size_t sourceRed = pSourceIsRGBA ? 0 : RED_PIXEL_INDEX;
+	const size_t sourceBlue = pSourceIsRGBA ? 2 : BLUE_PIXEL_INDEX;
+	for( int n = 0 ; n < pCount ; n++, pDest += pDestPixelSize, pSource += 4 )
+	{
+		const uint32_t dA = pSource[ALPHA_PIXEL_INDEX];
+
+		// Saturate so badly pre multiplied data does not wrap around, the vector versions do the same.
+		const uint32_t r = std::min<uint32_t>(255,pSource[sourceRed] + Div255(pDest[RED_PIXEL_INDEX] * dA));
+		const uint32_t g = std::min<uint32_t>(255,pSource[GREEN_PIXEL_INDEX] + Div255(pDest[GREEN_PIXEL_INDEX] * dA));
+		const uint32_t b = std::min<uint32_t>(255,pSource[sourceBlue] + Div255(pDest[BLUE_PIXEL_INDEX] * dA));
+
+		WRITE_RGB_TO_PIXEL(pDest,r,g,b);
+	}
+}
+
+#ifdef TINY2D_USE_SSE2
+/**
+ * @brief Swaps bytes 0 and 2 of each pixel, R G B A <-> B G R A.
+ */
+static inline __m128i SwapRedBlueSSE2(__m128i pPixels)
+{
+	const __m128i greenAlpha = _mm_set1_epi32(0xff00ff00);
+	const __m128i lowByte = _mm_set1_epi32(0x000000ff);
+	const __m128i red = _mm_and_si128(_mm_srli_epi32(pPixels,16),lowByte);
+	const __m128i blue = _mm_slli_epi32(_mm_and_si128(pPixels,lowByte),16);
+	return _mm_or_si128(_mm_and_si128(pPixels,greenAlpha),_mm_or_si128(red,blue));
+}
+
+/**
+ * @brief Div255 on eight 16 bit values. (t+128) + ((t+128)>>8) can not overflow 16 bits for t <= 255*255.
+ */
+static inline __m128i Div255SSE2(__m128i pValue)
+{
+	pValue = _mm_add_epi16(pValue,_mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(pValue,_mm_srli_epi16(pValue,8)),8);
+}
+
+/**
+ * @brief Copies the alpha of each of the two pixels held in 16 bit lanes into all four of its lanes.
+ */
+static inline __m128i BroadcastAlphaSSE2(__m128i pPixels16)
+{
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(pPixels16,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+}
+
+/**
+ * @brief (S*A) + (D*(1-A)) for four pixels. The alpha byte of the result is max(D,S) if the dest has alpha, else the dest byte untouched.
+ */
+static inline __m128i BlendFourPixelsSSE2(__m128i pDest,__m128i pSource,bool pDestHasAlpha)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaMask = _mm_set1_epi32(0xff000000);
+	const __m128i v255 = _mm_set1_epi16(255);
+
+	const __m128i sLo = _mm_unpacklo_epi8(pSource,zero);
+	const __m128i sHi = _mm_unpackhi_epi8(pSource,zero);
+	const __m128i aLo = BroadcastAlphaSSE2(sLo);
+	const __m128i aHi = BroadcastAlphaSSE2(sHi);
+
+	const __m128i lo = Div255SSE2(_mm_add_epi16(_mm_mullo_epi16(sLo,aLo),_mm_mullo_epi16(_mm_unpacklo_epi8(pDest,zero),_mm_sub_epi16(v255,aLo))));
+	const __m128i hi = Div255SSE2(_mm_add_epi16(_mm_mullo_epi16(sHi,aHi),_mm_mullo_epi16(_mm_unpackhi_epi8(pDest,zero),_mm_sub_epi16(v255,aHi))));
+
+	const __m128i alpha = pDestHasAlpha ? _mm_max_epu8(pDest,pSource) : pDest;
+	return _mm_or_si128(_mm_andnot_si128(alphaMask,_mm_packus_epi16(lo,hi)),_mm_and_si128(alphaMask,alpha));
+}
+
+/**
+ * @brief S + (D * A) for four pixels, dest alpha byte is kept.
+ */
+static inline __m128i BlendPreAlphaFourPixelsSSE2(__m128i pDest,__m128i pSource)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaMask = _mm_set1_epi32(0xff000000);
+
+	const __m128i lo = Div255SSE2(_mm_mullo_epi16(_mm_unpacklo_epi8(pDest,zero),BroadcastAlphaSSE2(_mm_unpacklo_epi8(pSource,zero))));
+	const __m128i hi = Div255SSE2(_mm_mullo_epi16(_mm_unpackhi_epi8(pDest,zero),BroadcastAlphaSSE2(_mm_unpackhi_epi8(pSource,zero))));
+
+	const __m128i rgb = _mm_adds_epu8(pSource,_mm_packus_epi16(lo,hi));
+	return _mm_or_si128(_mm_andnot_si128(alphaMask,rgb),_mm_and_si128(alphaMask,pDest));
+}
+#endif //#ifdef TINY2D_USE_SSE2
+
+#ifdef TINY2D_USE_NEON
+/**
+ * @brief Div255 on eight 16 bit values, narrowing to 8 bits. vraddhn does (a + b + 128) >> 8.
+ */
+static inline uint8x8_t Div255NEON(uint16x8_t pValue)
+{
+	return vraddhn_u16(pValue,vrshrq_n_u16(pValue,8));
+}
+
+/**
+ * @brief (S*A) + (D*(1-A)) for one channel of sixteen pixels.
+ */
+static inline uint8x16_t BlendChannelNEON(uint8x16_t pDest,uint8x16_t pSource,uint8x16_t pAlpha,uint8x16_t pInvAlpha)
+{
+	const uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(pSource),vget_low_u8(pAlpha)),vget_low_u8(pDest),vget_low_u8(pInvAlpha));
+	const uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(pSource),vget_high_u8(pAlpha)),vget_high_u8(pDest),vget_high_u8(pInvAlpha));
+	return vcombine_u8(Div255NEON(lo),Div255NEON(hi));
+}
+
+/**
+ * @brief S + (D * A) for one channel of sixteen pixels.
+ */
+static inline uint8x16_t BlendPreAlphaChannelNEON(uint8x16_t pDest,uint8x16_t pSource,uint8x16_t pAlpha)
+{
+	const uint16x8_t lo = vmull_u8(vget_low_u8(pDest),vget_low_u8(pAlpha));
+	const uint16x8_t hi = vmull_u8(vget_high_u8(pDest),vget_high_u8(pAlpha));
+	return vqaddq_u8(pSource,vcombine_u8(Div255NEON(lo),Div255NEON(hi)));
+}
+#endif //#ifdef TINY2D_USE_NEON
+
+/**
+ * @brief Row version of DrawBuffer::BlendPixel, source is four bytes per pixel in the draw buffer channel order or R G B A.
+ * Runs the vector kernel for as much of the row as it can then finishes the tail with the portable code.
+ */
+static void BlendRow(uint8_t* pDest,size_t pDestPixelSize,bool pDestHasAlpha,const uint8_t* pSource,bool pSourceIsRGBA,int pCount)
+{
+#if defined(TINY2D_USE_SSE2)
+	if( pDestPixelSize == 4 )
+	{
+		for( ; pCount >= 8 ; pCount -= 8, pDest += 32, pSource += 32 )
+		{
+			__m128i s0 = _mm_loadu_si128((const __m128i*)pSource);
+			__m128i s1 = _mm_loadu_si128((const __m128i*)(pSource + 16));
+			if( pSourceIsRGBA )
+			{
+				s0 = SwapRedBlueSSE2(s0);
+				s1 = SwapRedBlueSSE2(s1);
+			}
+			const __m128i d0 = _mm_loadu_si128((const __m128i*)pDest);
+			const __m128i d1 = _mm_loadu_si128((const __m128i*)(pDest + 16));
+			_mm_storeu_si128((__m128i*)pDest,BlendFourPixelsSSE2(d0,s0,pDestHasAlpha));
+			_mm_storeu_si128((__m128i*)(pDest + 16),BlendFourPixelsSSE2(d1,s1,pDestHasAlpha));
+		}
+	}
+#elif defined(TINY2D_USE_NEON)
+	const int sourceRed = pSourceIsRGBA ? 0 : RED_PIXEL_INDEX;
+	const int sourceBlue = pSourceIsRGBA ? 2 : BLUE_PIXEL_INDEX;
+	if( pDestPixelSize == 4 )
+	{
+		for( ; pCount >= 16 ; pCount -= 16, pDest += 64, pSource += 64 )
+		{
+			const uint8x16x4_t s = vld4q_u8(pSource);
+			uint8x16x4_t d = vld4q_u8(pDest);
+			const uint8x16_t a = s.val[ALPHA_PIXEL_INDEX];
+			const uint8x16_t ia = vmvnq_u8(a);
+			d.val[RED_PIXEL_INDEX] = BlendChannelNEON(d.val[RED_PIXEL_INDEX],s.val[sourceRed],a,ia);
+			d.val[GREEN_PIXEL_INDEX] = BlendChannelNEON(d.val[GREEN_PIXEL_INDEX],s.val[GREEN_PIXEL_INDEX],a,ia);
+			d.val[BLUE_PIXEL_INDEX] = BlendChannelNEON(d.val[BLUE_PIXEL_INDEX],s.val[sourceBlue],a,ia);
+			if( pDestHasAlpha )
+			{
+				d.val[ALPHA_PIXEL_INDEX] = vmaxq_u8(d.val[ALPHA_PIXEL_INDEX],a);
+			}
+			vst4q_u8(pDest,d);
+		}
+	}
+	else if( pDestPixelSize == 3 )
+	{
+		for( ; pCount >= 16 ; pCount -= 16, pDest += 48, pSource += 64 )
+		{
+			const uint8x16x4_t s = vld4q_u8(pSource);
+			uint8x16x3_t d = vld3q_u8(pDest);
+			const uint8x16_t a = s.val[ALPHA_PIXEL_INDEX];
+			const uint8x16_t ia = vmvnq_u8(a);
+			d.val[RED_PIXEL_INDEX] = BlendChannelNEON(d.val[RED_PIXEL_INDEX],s.val[sourceRed],a,ia);
+			d.val[GREEN_PIXEL_INDEX] = BlendChannelNEON(d.val[GREEN_PIXEL_INDEX],s.val[GREEN_PIXEL_INDEX],a,ia);
+			d.val[BLUE_PIXEL_INDEX] = BlendChannelNEON(d.val[BLUE_PIXEL_INDEX],s.val[sourceBlue],a,ia);
+			vst3q_u8(pDest,d);
+		}
+	}
+#endif
+
+	BlendRowScalar(pDest,pDestPixelSize,pDestHasAlpha,pSource,pSourceIsRGBA,pCount);
+}
+
+/**
+ * @brief Row version of DrawBuffer::BlendPreAlphaPixel, source alpha has already been inverted by PreMultiplyAlpha.
+ * Runs the vector kernel for as much of the row as it can then finishes the tail with the portable code.
+ */
+static void BlendPreAlphaRow(uint8_t* pDest,size_t pDestPixelSize,const uint8_t* pSource,bool pSourceIsRGBA,int pCount)
+{
+#if defined(TINY2D_USE_SSE2)
+	if( pDestPixelSize == 4 )
+	{
+		for( ; pCount >= 8 ; pCount -= 8, pDest += 32, pSource += 32 )
+		{
+			__m128i s0 = _mm_loadu_si128((const __m128i*)pSource);
+			__m128i s1 = _mm_loadu_si128((const __m128i*)(pSource + 16));
+			if( pSourceIsRGBA )
+			{
+				s0 = SwapRedBlueSSE2(s0);
+				s1 = SwapRedBlueSSE2(s1);
+			}
+			const __m128i d0 = _mm_loadu_si128((const __m128i*)pDest);
+			const __m128i d1 = _mm_loadu_si128((const __m128i*)(pDest + 16));
+			_mm_storeu_si128((__m128i*)pDest,BlendPreAlphaFourPixelsSSE2(d0,s0));
+			_mm_storeu_si128((__m128i*)(pDest + 16),BlendPreAlphaFourPixelsSSE2(d1,s1));
+		}
+	}
+#elif defined(TINY2D_USE_NEON)
+	const int sourceRed = pSourceIsRGBA ? 0 : RED_PIXEL_INDEX;
+	const int sourceBlue = pSourceIsRGBA ? 2 : BLUE_PIXEL_INDEX;
+	if( pDestPixelSize == 4 )
+	{
+		for( ; pCount >= 16 ; pCount -= 16, pDest += 64, pSource += 64 )
+		{
+			const uint8x16x4_t s = vld4q_u8(pSource);
+			uint8x16x4_t d = vld4q_u8(pDest);
+			const uint8x16_t a = s.val[ALPHA_PIXEL_INDEX];
+			d.val[RED_PIXEL_INDEX] = BlendPreAlphaChannelNEON(d.val[RED_PIXEL_INDEX],s.val[sourceRed],a);
+			d.val[GREEN_PIXEL_INDEX] = BlendPreAlphaChannelNEON(d.val[GREEN_PIXEL_INDEX],s.val[GREEN_PIXEL_INDEX],a);
+			d.val[BLUE_PIXEL_INDEX] = BlendPreAlphaChannelNEON(d.val[BLUE_PIXEL_INDEX],s.val[sourceBlue],a);
+			vst4q_u8(pDest,d);
+		}
+	}
+	else if( pDestPixelSize == 3 )
+	{
+		for( ; pCount >= 16 ; pCount -= 16, pDest += 48, pSource += 64 )
+		{
+			const uint8x16x4_t s = vld4q_u8(pSource);
+			uint8x16x3_t d = vld3q_u8(pDest);
+			const uint8x16_t a = s.val[ALPHA_PIXEL_INDEX];
+			d.val[RED_PIXEL_INDEX] = BlendPreAlphaChannelNEON(d.val[RED_PIXEL_INDEX],s.val[sourceRed],a);
+			d.val[GREEN_PIXEL_INDEX] = BlendPreAlphaChannelNEON(d.val[GREEN_PIXEL_INDEX],s.val[GREEN_PIXEL_INDEX],a);
+			d.val[BLUE_PIXEL_INDEX] = BlendPreAlphaChannelNEON(d.val[BLUE_PIXEL_INDEX],s.val[sourceBlue],a);
+			vst3q_u8(pDest,d);
+		}
+	}
+#endif
+
+	BlendPreAlphaRowScalar(pDest,pDestPixelSize,pSource,pSourceIsRGBA,pCount);
+}
+
+/**
+ * @brief Portable, any format, version of (S*A) + (D*(1-A)) for one pixel. Dest alpha, if it has it, becomes the largest of the two.
+ */
+template<class DEST> static inline void BlendPixelFormat(uint8_t* pDest,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	uint8_t r,g,b,a;
+	DEST::Unpack(DEST::Read(pDest),r,g,b,a);
+
+	const uint32_t sA = pAlpha;
+	const uint32_t dA = 255 - sA;
+
+	r = Div255( (pRed * sA) + (r * dA) );
+	g = Div255( (pGreen * sA) + (g * dA) );
+	b = Div255( (pBlue * sA) + (b * dA) );
+	if( a < sA )
+	{
+		a = sA;
+	}
+
+	DEST::Write(pDest,DEST::Pack(r,g,b,a));
+}
+
+/**
+ * @brief Portable, any format, version of S + (D * A) for one pixel. Dest alpha is left alone.
+ */
+template<class DEST> static inline void BlendPreAlphaPixelFormat(uint8_t* pDest,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	uint8_t r,g,b,a;
+	DEST::Unpack(DEST::Read(pDest),r,g,b,a);
+
+	r = std::min<uint32_t>(255,pRed + Div255(r * pAlpha));
+	g = std::min<uint32_t>(255,pGreen + Div255(g * pAlpha));
+	b = std::min<uint32_t>(255,pBlue + Div255(b * pAlpha));
+
+	DEST::Write(pDest,DEST::Pack(r,g,b,a));
+}
+
+/**
+ * @brief Blends a row of source pixels onto a row of dest pixels.
+ * When the source is B G R A or R G B A and the dest is a B G R format this goes to the vector kernels, else it is done a pixel at a time.
+ */
+template<class SOURCE,class DEST> static void BlendRow(uint8_t* pDest,const uint8_t* pSource,int pCount)
+{
+	constexpr bool sourceIsRGBA = std::is_same<SOURCE,PixelFormatRGBA8888Source>::value;
+	if constexpr( IsBGRFormat<DEST>() && (sourceIsRGBA || std::is_same<SOURCE,PixelFormatBGRA8888>::value) )
+	{
+		BlendRow(pDest,DEST::PIXEL_SIZE,DEST::HAS_ALPHA,pSource,sourceIsRGBA,pCount);
+	}
+	else
+	{
+		for( int n = 0 ; n < pCount ; n++, pDest += DEST::PIXEL_SIZE, pSource += SOURCE::PIXEL_SIZE )
+		{
+			uint8_t r,g,b,a;
+			SOURCE::Unpack(SOURCE::Read(pSource),r,g,b,a);
+			BlendPixelFormat<DEST>(pDest,r,g,b,a);
+		}
+	}
+}
+
+/**
+ * @brief Pre multiplied version of BlendRow, source alpha has already been inverted by PreMultiplyAlpha.
+ */
+template<class SOURCE,class DEST> static void BlendPreAlphaRow(uint8_t* pDest,const uint8_t* pSource,int pCount)
+{
+	constexpr bool sourceIsRGBA = std::is_same<SOURCE,PixelFormatRGBA8888Source>::value;
+	if constexpr( IsBGRFormat<DEST>() && (sourceIsRGBA || std::is_same<SOURCE,PixelFormatBGRA8888>::value) )
+	{
+		BlendPreAlphaRow(pDest,DEST::PIXEL_SIZE,pSource,sourceIsRGBA,pCount);
+	}
+	else
+	{
+		for( int n = 0 ; n < pCount ; n++, pDest += DEST::PIXEL_SIZE, pSource += SOURCE::PIXEL_SIZE )
+		{
+			uint8_t r,g,b,a;
+			SOURCE::Unpack(SOURCE::Read(pSource),r,g,b,a);
+			BlendPreAlphaPixelFormat<DEST>(pDest,r,g,b,a);
+		}
+	}
+}
+
+/**
+ * @brief Calls pFunction with a std::integral_constant of pMode, so each mode has its own row kernel and it is picked once per row, not per pixel.
+ * BLEND_MODE_NORMAL is not passed on, it is drawn by BlendRow and BlendPreAlphaRow.
+ */
+template<class FUNCTION> static inline void DispatchBlendMode(BlendMode pMode,FUNCTION&& pFunction)
+{
+	switch( pMode )
+	{
+	case BLEND_MODE_NORMAL:
+		assert( !"BLEND_MODE_NORMAL is drawn by BlendRow" );
+		break;
+
+	case BLEND_MODE_ADD:
+		pFunction(std::integral_constant<BlendMode,BLEND_MODE_ADD>());
+		break;
+
+	case BLEND_MODE_MULTIPLY:
+		pFunction(std::integral_constant<BlendMode,BLEND_MODE_MULTIPLY>());
+		break;
+
+	case BLEND_MODE_SCREEN:
+		pFunction(std::integral_constant<BlendMode,BLEND_MODE_SCREEN>());
+		break;
+
+	case BLEND_MODE_DARKEN:
+		pFunction(std::integral_constant<BlendMode,BLEND_MODE_DARKEN>());
+		break;
+
+	case BLEND_MODE_LIGHTEN:
+		pFunction(std::integral_constant<BlendMode,BLEND_MODE_LIGHTEN>());
+		break;
+
+	case BLEND_MODE_XOR:
+		pFunction(std::integral_constant<BlendMode,BLEND_MODE_XOR>());
+		break;
+	}
+}
+
+/**
+ * @brief One channel of a BlendMode. pSource is the colour times its alpha and pInvAlpha is 255 - alpha, as a pre multiplied image holds them,
+ * so straight and pre multiplied sources share the maths. The vector versions below give the same results.
+ */
+template<BlendMode MODE> static inline uint32_t BlendModeChannel(uint32_t pDest,uint32_t pSource,uint32_t pInvAlpha)
+{
+	static_assert( MODE != BLEND_MODE_NORMAL , "BLEND_MODE_NORMAL is drawn by BlendRow" );
+	if constexpr( MODE == BLEND_MODE_ADD )
+		return std::min<uint32_t>(255,pDest + pSource);
+	else if constexpr( MODE == BLEND_MODE_MULTIPLY )
+		return Div255(pDest * std::min<uint32_t>(255,pSource + pInvAlpha));
+	else if constexpr( MODE == BLEND_MODE_SCREEN )
+		return pDest + pSource - Div255(pDest * pSource);
+	else if constexpr( MODE == BLEND_MODE_DARKEN )
+		return std::min<uint32_t>(pDest,std::min<uint32_t>(255,pSource + Div255(pDest * pInvAlpha)));
+	else if constexpr( MODE == BLEND_MODE_LIGHTEN )
+		return std::max<uint32_t>(pDest,std::min<uint32_t>(255,pSource + Div255(pDest * pInvAlpha)));
+	else
+		return pDest ^ pSource;
+}
+
+/**
+ * @brief Portable version of the BlendMode row for the B G R formats, the source is four bytes per pixel pSourceStep bytes apart.
+ * Dest alpha, if it has it, becomes the largest of the two.
+ */
+template<BlendMode MODE,bool PRE_MULTIPLIED> static void BlendModeRowScalar(uint8_t* pDest,size_t pDestPixelSize,bool pDestHasAlpha,const uint8_t* pSource,size_t pSourceStep,bool pSourceIsRGBA,int pCount)
+{
+	const size_t sourceRed = pSourceIsRGBA ? 0 : RED_PIXEL_INDEX;
+	const size_t sourceBlue = pSourceIsRGBA ? 2 : BLUE_PIXEL_INDEX;
+	for( int n = 0 ; n < pCount ; n++, pDest += pDestPixelSize, pSource += pSourceStep )
+	{
+		const uint32_t sA = PRE_MULTIPLIED ? 255 - pSource[ALPHA_PIXEL_INDEX] : pSource[ALPHA_PIXEL_INDEX];
+		const uint32_t dA = 255 - sA;
+		auto source = [&](size_t pIndex)->uint32_t{return PRE_MULTIPLIED ? pSource[pIndex] : Div255(pSource[pIndex] * sA);};
+
+		const uint32_t r = BlendModeChannel<MODE>(pDest[RED_PIXEL_INDEX],source(sourceRed),dA);
+		const uint32_t g = BlendModeChannel<MODE>(pDest[GREEN_PIXEL_INDEX],source(GREEN_PIXEL_INDEX),dA);
+		const uint32_t b = BlendModeChannel<MODE>(pDest[BLUE_PIXEL_INDEX],source(sourceBlue),dA);
+
+		WRITE_RGB_TO_PIXEL(pDest,r,g,b);
+
+		if( pDestHasAlpha && pDest[ALPHA_PIXEL_INDEX] < sA )
+		{
+			pDest[ALPHA_PIXEL_INDEX] = sA;
+		}
+	}
+}
+
+#ifdef TINY2D_USE_SSE2
+/**
+ * @brief A BlendMode for four pixels. The alpha byte of the result is max(D,S) if the dest has alpha, else the dest byte untouched.
+ */
+template<BlendMode MODE,bool PRE_MULTIPLIED> static inline __m128i BlendModeFourPixelsSSE2(__m128i pDest,__m128i pSource,bool pDestHasAlpha)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaMask = _mm_set1_epi32(0xff000000);
+	const __m128i v255 = _mm_set1_epi16(255);
+
+	// The source as colour times alpha and 255 - alpha, in 16 bit lanes. Pre multiplied sources hold just that.
+	__m128i sLo = _mm_unpacklo_epi8(pSource,zero);
+	__m128i sHi = _mm_unpackhi_epi8(pSource,zero);
+	__m128i iaLo = BroadcastAlphaSSE2(sLo);
+	__m128i iaHi = BroadcastAlphaSSE2(sHi);
+	__m128i sourceAlpha = pSource;
+	if constexpr( PRE_MULTIPLIED )
+	{
+		sourceAlpha = _mm_xor_si128(pSource,_mm_set1_epi32(-1));
+	}
+	else
+	{
+		sLo = Div255SSE2(_mm_mullo_epi16(sLo,iaLo));
+		sHi = Div255SSE2(_mm_mullo_epi16(sHi,iaHi));
+		iaLo = _mm_sub_epi16(v255,iaLo);
+		iaHi = _mm_sub_epi16(v255,iaHi);
+	}
+	const __m128i dLo = _mm_unpacklo_epi8(pDest,zero);
+	const __m128i dHi = _mm_unpackhi_epi8(pDest,zero);
+
+	__m128i rgb;
+	if constexpr( MODE == BLEND_MODE_ADD )
+	{
+		rgb = _mm_adds_epu8(pDest,_mm_packus_epi16(sLo,sHi));
+	}
+	else if constexpr( MODE == BLEND_MODE_MULTIPLY )
+	{
+		const __m128i lo = Div255SSE2(_mm_mullo_epi16(dLo,_mm_min_epi16(_mm_add_epi16(sLo,iaLo),v255)));
+		const __m128i hi = Div255SSE2(_mm_mullo_epi16(dHi,_mm_min_epi16(_mm_add_epi16(sHi,iaHi),v255)));
+		rgb = _mm_packus_epi16(lo,hi);
+	}
+	else if constexpr( MODE == BLEND_MODE_SCREEN )
+	{
+		const __m128i lo = _mm_sub_epi16(_mm_add_epi16(dLo,sLo),Div255SSE2(_mm_mullo_epi16(dLo,sLo)));
+		const __m128i hi = _mm_sub_epi16(_mm_add_epi16(dHi,sHi),Div255SSE2(_mm_mullo_epi16(dHi,sHi)));
+		rgb = _mm_packus_epi16(lo,hi);
+	}
+	else if constexpr( MODE == BLEND_MODE_DARKEN || MODE == BLEND_MODE_LIGHTEN )
+	{
+		const __m128i lo = Div255SSE2(_mm_mullo_epi16(dLo,iaLo));
+		const __m128i hi = Div255SSE2(_mm_mullo_epi16(dHi,iaHi));
+		const __m128i normal = _mm_adds_epu8(_mm_packus_epi16(sLo,sHi),_mm_packus_epi16(lo,hi));
+		rgb = MODE == BLEND_MODE_DARKEN ? _mm_min_epu8(pDest,normal) : _mm_max_epu8(pDest,normal);
+	}
+	else
+	{
+		rgb = _mm_xor_si128(pDest,_mm_packus_epi16(sLo,sHi));
+	}
+
+	const __m128i alpha = pDestHasAlpha ? _mm_max_epu8(pDest,sourceAlpha) : pDest;
+	return _mm_or_si128(_mm_andnot_si128(alphaMask,rgb),_mm_and_si128(alphaMask,alpha));
+}
+#endif //#ifdef TINY2D_USE_SSE2
+
+#ifdef TINY2D_USE_NEON
+/**
+ * @brief A BlendMode for one channel of sixteen pixels, pSource is already times alpha and pInvAlpha is 255 - alpha.
+ */
+template<BlendMode MODE> static inline uint8x16_t BlendModeChannelNEON(uint8x16_t pDest,uint8x16_t pSource,uint8x16_t pInvAlpha)
+{
+	if constexpr( MODE == BLEND_MODE_ADD )
+	{
+		return vqaddq_u8(pDest,pSource);
+	}
+	else if constexpr( MODE == BLEND_MODE_MULTIPLY )
+	{
+		const uint8x16_t scale = vqaddq_u8(pSource,pInvAlpha);
+		return vcombine_u8(Div255NEON(vmull_u8(vget_low_u8(pDest),vget_low_u8(scale))),Div255NEON(vmull_u8(vget_high_u8(pDest),vget_high_u8(scale))));
+	}
+	else if constexpr( MODE == BLEND_MODE_SCREEN )
+	{
+		// D*S/255 is never more than S, and D + S - D*S/255 never more than 255, so this can not wrap.
+		const uint8x16_t product = vcombine_u8(Div255NEON(vmull_u8(vget_low_u8(pDest),vget_low_u8(pSource))),Div255NEON(vmull_u8(vget_high_u8(pDest),vget_high_u8(pSource))));
+		return vaddq_u8(pDest,vsubq_u8(pSource,product));
+	}
+	else if constexpr( MODE == BLEND_MODE_DARKEN || MODE == BLEND_MODE_LIGHTEN )
+	{
+		const uint8x16_t normal = BlendPreAlphaChannelNEON(pDest,pSource,pInvAlpha);
+		return MODE == BLEND_MODE_DARKEN ? vminq_u8(pDest,normal) : vmaxq_u8(pDest,normal);
+	}
+	else
+	{
+		return veorq_u8(pDest,pSource);
+	}
+}
+
+/**
+ * @brief The BlendMode for the red, green and blue of sixteen pixels loaded with vld4q_u8, returns the source alpha.
+ */
+template<BlendMode MODE,bool PRE_MULTIPLIED,class DEST_PIXELS> static inline uint8x16_t BlendModePixelsNEON(DEST_PIXELS& rDest,const uint8x16x4_t& pSource,bool pSourceIsRGBA)
+{
+	const uint8x16_t alpha = PRE_MULTIPLIED ? vmvnq_u8(pSource.val[ALPHA_PIXEL_INDEX]) : pSource.val[ALPHA_PIXEL_INDEX];
+	const uint8x16_t invAlpha = vmvnq_u8(alpha);
+	auto source = [&](int pIndex)
+	{
+		if constexpr( PRE_MULTIPLIED )
+			return pSource.val[pIndex];
+		return vcombine_u8(Div255NEON(vmull_u8(vget_low_u8(pSource.val[pIndex]),vget_low_u8(alpha))),Div255NEON(vmull_u8(vget_high_u8(pSource.val[pIndex]),vget_high_u8(alpha))));
+	};
+
+	const int sourceRed = pSourceIsRGBA ? 0 : RED_PIXEL_INDEX;
+	const int sourceBlue = pSourceIsRGBA ? 2 : BLUE_PIXEL_INDEX;
+	rDest.val[RED_PIXEL_INDEX] = BlendModeChannelNEON<MODE>(rDest.val[RED_PIXEL_INDEX],source(sourceRed),invAlpha);
+	rDest.val[GREEN_PIXEL_INDEX] = BlendModeChannelNEON<MODE>(rDest.val[GREEN_PIXEL_INDEX],source(GREEN_PIXEL_INDEX),invAlpha);
+	rDest.val[BLUE_PIXEL_INDEX] = BlendModeChannelNEON<MODE>(rDest.val[BLUE_PIXEL_INDEX],source(sourceBlue),invAlpha);
+	return alpha;
+}
+#endif //#ifdef TINY2D_USE_NEON
+
+/**
+ * @brief BlendMode version of the BlendRow above for the B G R formats. The source is four bytes per pixel pSourceStep bytes apart.
+ * A fill passes a step of 0 and sixteen pixels of its colour, so the vector loads have it in every lane.
+ */
+template<BlendMode MODE,bool PRE_MULTIPLIED> static void BlendModeRow(uint8_t* pDest,size_t pDestPixelSize,bool pDestHasAlpha,const uint8_t* pSource,size_t pSourceStep,bool pSourceIsRGBA,int pCount)
+{
+#if defined(TINY2D_USE_SSE2)
+	if( pDestPixelSize == 4 )
+	{
+		for( ; pCount >= 8 ; pCount -= 8, pDest += 32, pSource += pSourceStep * 8 )
+		{
+			__m128i s0 = _mm_loadu_si128((const __m128i*)pSource);
+			__m128i s1 = _mm_loadu_si128((const __m128i*)(pSource + 16));
+			if( pSourceIsRGBA )
+			{
+				s0 = SwapRedBlueSSE2(s0);
+				s1 = SwapRedBlueSSE2(s1);
+			}
+			const __m128i d0 = _mm_loadu_si128((const __m128i*)pDest);
+			const __m128i d1 = _mm_loadu_si128((const __m128i*)(pDest + 16));
+			_mm_storeu_si128((__m128i*)pDest,BlendModeFourPixelsSSE2<MODE,PRE_MULTIPLIED>(d0,s0,pDestHasAlpha));
+			_mm_storeu_si128((__m128i*)(pDest + 16),BlendModeFourPixelsSSE2<MODE,PRE_MULTIPLIED>(d1,s1,pDestHasAlpha));
+		}
+	}
+#elif defined(TINY2D_USE_NEON)
+	if( pDestPixelSize == 4 )
+	{
+		for( ; pCount >= 16 ; pCount -= 16, pDest += 64, pSource += pSourceStep * 16 )
+		{
+			uint8x16x4_t d = vld4q_u8(pDest);
+			const uint8x16_t alpha = BlendModePixelsNEON<MODE,PRE_MULTIPLIED>(d,vld4q_u8(pSource),pSourceIsRGBA);
+			if( pDestHasAlpha )
+			{
+				d.val[ALPHA_PIXEL_INDEX] = vmaxq_u8(d.val[ALPHA_PIXEL_INDEX],alpha);
+			}
+			vst4q_u8(pDest,d);
+		}
+	}
+	else if( pDestPixelSize == 3 )
+	{
+		for( ; pCount >= 16 ; pCount -= 16, pDest += 48, pSource += pSourceStep * 16 )
+		{
+			uint8x16x3_t d = vld3q_u8(pDest);
+			BlendModePixelsNEON<MODE,PRE_MULTIPLIED>(d,vld4q_u8(pSource),pSourceIsRGBA);
+			vst3q_u8(pDest,d);
+		}
+	}
+#endif
+
+	BlendModeRowScalar<MODE,PRE_MULTIPLIED>(pDest,pDestPixelSize,pDestHasAlpha,pSource,pSourceStep,pSourceIsRGBA,pCount);
+}
+
+/**
+ * @brief Portable, any format, version of a BlendMode for one pixel. The colour is already times alpha and pInvAlpha is 255 - alpha.
+ */
+template<class DEST,BlendMode MODE> static inline void BlendModePixelFormat(uint8_t* pDest,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pInvAlpha)
+{
+	uint8_t r,g,b,a;
+	DEST::Unpack(DEST::Read(pDest),r,g,b,a);
+
+	r = BlendModeChannel<MODE>(r,pRed,pInvAlpha);
+	g = BlendModeChannel<MODE>(g,pGreen,pInvAlpha);
+	b = BlendModeChannel<MODE>(b,pBlue,pInvAlpha);
+	a = std::max<uint8_t>(a,255 - pInvAlpha);
+
+	DEST::Write(pDest,DEST::Pack(r,g,b,a));
+}
+
+/**
+ * @brief Mixes a row of B G R A, or R G B A, pixels into any dest format with the BlendMode.
+ * The B G R formats go to the vector kernels, else it is done a pixel at a time.
+ */
+template<class DEST,BlendMode MODE> static void BlendModeRow(uint8_t* pDest,const uint8_t* pSource,size_t pSourceStep,bool pSourceIsRGBA,bool pPreMultiplied,int pCount)
+{
+	if constexpr( IsBGRFormat<DEST>() )
+	{
+		if( pPreMultiplied )
+			BlendModeRow<MODE,true>(pDest,DEST::PIXEL_SIZE,DEST::HAS_ALPHA,pSource,pSourceStep,pSourceIsRGBA,pCount);
+		else
+			BlendModeRow<MODE,false>(pDest,DEST::PIXEL_SIZE,DEST::HAS_ALPHA,pSource,pSourceStep,pSourceIsRGBA,pCount);
+	}
+	else
+	{
+		const size_t sourceRed = pSourceIsRGBA ? 0 : RED_PIXEL_INDEX;
+		const size_t sourceBlue = pSourceIsRGBA ? 2 : BLUE_PIXEL_INDEX;
+		for( int n = 0 ; n < pCount ; n++, pDest += DEST::PIXEL_SIZE, pSource += pSourceStep )
+		{
+			const uint32_t sA = pSource[ALPHA_PIXEL_INDEX];
+			if( pPreMultiplied )
+				BlendModePixelFormat<DEST,MODE>(pDest,pSource[sourceRed],pSource[GREEN_PIXEL_INDEX],pSource[sourceBlue],sA);
+			else
+				BlendModePixelFormat<DEST,MODE>(pDest,Div255(pSource[sourceRed] * sA),Div255(pSource[GREEN_PIXEL_INDEX] * sA),Div255(pSource[sourceBlue] * sA),255 - sA);
+		}
+	}
+}
+
+/**
+ * @brief Mixes a row of an image of any format into DEST with pMode, which is not BLEND_MODE_NORMAL.
+ * Images that are not B G R A are turned into it a piece at a time first, so one set of kernels does all the formats.
+ */
+template<class SOURCE,class DEST> static void BlendModeImageRow(uint8_t* pDest,const uint8_t* pSource,bool pPreMultiplied,BlendMode pMode,int pCount)
+{
+	DispatchBlendMode(pMode,[&](auto pMode)
+	{
+		constexpr BlendMode MODE = decltype(pMode)::value;
+		if constexpr( std::is_same<SOURCE,PixelFormatBGRA8888>::value )
+		{
+			BlendModeRow<DEST,MODE>(pDest,pSource,4,false,pPreMultiplied,pCount);
+		}
+		else
+		{
+			const int PIECE_SIZE = 64;
+			uint8_t piece[PIECE_SIZE * 4];
+			for( int n = 0 ; n < pCount ; n += PIECE_SIZE )
+			{
+				const int count = std::min(pCount - n,PIECE_SIZE);
+				ConvertRow<SOURCE,PixelFormatBGRA8888>(piece,pSource + (n * SOURCE::PIXEL_SIZE),count);
+				BlendModeRow<DEST,MODE>(pDest + (n * DEST::PIXEL_SIZE),piece,4,false,pPreMultiplied,count);
+			}
+		}
+	});
+}
+
+/**
+ * @brief Calls pFunction with a function that fills pCount pixels from pDest with the colour using pMode.
+ * The mode is picked here once, so the fill functions just work out their runs and pass them on.
+ */
+template<class FORMAT,class FUNCTION> static void DispatchBlendModeFill(BlendMode pMode,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,FUNCTION&& pFunction)
+{
+	if( pMode == BLEND_MODE_NORMAL && pAlpha == 255 )
+	{
+		const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,255);
+		pFunction([&](uint8_t* pDest,int pCount){FillRow<FORMAT>(pDest,pCount,pixel);});
+		return;
+	}
+
+	// Sixteen pixels of the colour, enough for the vector loads. Straight for BlendRow, else pre multiplied for the mode kernels.
+	const int COLOUR_SIZE = 16;
+	const bool normal = pMode == BLEND_MODE_NORMAL;
+	uint8_t colour[COLOUR_SIZE * 4];
+	for( int n = 0 ; n < COLOUR_SIZE ; n++ )
+	{
+		uint8_t* pixel = colour + (n * 4);
+		pixel[RED_PIXEL_INDEX] = normal ? pRed : Div255(pRed * pAlpha);
+		pixel[GREEN_PIXEL_INDEX] = normal ? pGreen : Div255(pGreen * pAlpha);
+		pixel[BLUE_PIXEL_INDEX] = normal ? pBlue : Div255(pBlue * pAlpha);
+		pixel[ALPHA_PIXEL_INDEX] = normal ? pAlpha : 255 - pAlpha;
+	}
+
+	if( normal )
+	{
+		pFunction([&](uint8_t* pDest,int pCount)
+		{
+			for( ; pCount > 0 ; pCount -= COLOUR_SIZE, pDest += COLOUR_SIZE * FORMAT::PIXEL_SIZE )
+			{
+				BlendRow<PixelFormatBGRA8888,FORMAT>(pDest,colour,std::min(pCount,COLOUR_SIZE));
+			}
+		});
+		return;
+	}
+
+	DispatchBlendMode(pMode,[&](auto pMode)
+	{
+		pFunction([&](uint8_t* pDest,int pCount){BlendModeRow<FORMAT,decltype(pMode)::value>(pDest,colour,0,false,true,pCount);});
+	});
+}
+
+/**
+ * @brief Fills pPath with the colour from pPaint(x,y,r,g,b,a) for each pixel it covers.
+ * @return The area drawn to.
+ */
+template<class FORMAT,class PAINT> static Rect FillPathCoverage(DrawBuffer& pBuffer,const Path& pPath,FillRule pRule,PAINT&& pPaint)
+{
+	// The columns are those of the path in the buffer, not the clip rect, so they are the same for any clip rect. See CoverageAccumulator.
+	const Rect bounds = pPath.GetBounds();
+	const Rect columns = bounds.Intersect(Rect(0,0,pBuffer.GetWidth(),pBuffer.GetHeight()));
+	const Rect area = bounds.Intersect(pBuffer.GetClipRect());
+	if( area.GetIsEmpty() )
+		return Rect();
+
+	// Pixel centres are on whole numbers in the path, in the accumulator pixel x covers x to x + 1.
+	CoverageAccumulator coverage(Rect(columns.left,area.top,columns.right,area.bottom));
+	for( const Path::Outline& outline : pPath.GetOutlines() )
+	{
+		if( outline.size() < 2 )
+			continue;
+
+		for( size_t n = 0 ; n < outline.size() ; n++ )
+		{
+			const std::array<float,2>& from = outline[n];
+			const std::array<float,2>& to = outline[(n + 1) % outline.size()];
+			coverage.AddLine(from[0] + 0.5f,from[1] + 0.5f,to[0] + 0.5f,to[1] + 0.5f);
+		}
+	}
+
+	for( int y = area.top ; y < area.bottom ; y++ )
+	{
+		const float* row = coverage.GetRow(y);
+		float sum = 0.0f;
+		for( int x = columns.left ; x < area.left ; x++ )
+		{
+			sum += row[x - columns.left];
+		}
+
+		uint8_t* dst = pBuffer.GetPixelAddress(area.left,y);
+		for( int x = area.left ; x < area.right ; x++, dst += FORMAT::PIXEL_SIZE )
+		{
+			sum += row[x - columns.left];
+
+			// Non zero is how much is covered, for even odd every other layer of overlap is taken away.
+			float covered = fabsf(sum);
+			if( pRule == FILL_RULE_EVEN_ODD )
+			{
+				covered -= 2.0f * floorf(covered * 0.5f);
+				if( covered > 1.0f )
+					covered = 2.0f - covered;
+			}
+			const uint32_t coverage8 = (uint32_t)(std::min(covered,1.0f) * 255.0f + 0.5f);
+			if( coverage8 == 0 )
+				continue;
+
+			uint8_t r,g,b,a;
+			pPaint(x,y,r,g,b,a);
+			const uint32_t alpha = Div255(coverage8 * a);
+			if( alpha == 255 )
+				FORMAT::Write(dst,FORMAT::Pack(r,g,b,255));
+			else if( alpha > 0 )
+				BlendPixelFormat<FORMAT>(dst,r,g,b,alpha);
+		}
+	}
+	return area;
+}
+
+/**
+ * @brief Calls pFillRun(from,to,y) for the runs of pixels in pArea that a shape from MakeEllipseShape covers, no anti-aliasing.
+ * These are all whole numbers, see MakeEllipseShape, so the rows are found with EllipseHalfWidths.
+ */
+template<class FILL_RUN> static void ForEllipseArcRuns(const EllipseArcShape& pShape,const Rect& pArea,FILL_RUN&& pFillRun)
+{
+	const int centreX = (int)pShape.mCentreX;
+	const int centreY = (int)pShape.mCentreY;
+	EllipseHalfWidths outer((int)pShape.mRadiusX,(int)pShape.mRadiusY);
+	EllipseHalfWidths inner((int)pShape.mInnerRadiusX,(int)pShape.mInnerRadiusY);
+	for( int y = pArea.top ; y < pArea.bottom ; y++ )
+	{
+		const int halfWidth = outer.Get(y - centreY);
+		if( halfWidth < 0 )
+			continue;
+
+		const int from = std::max(centreX - halfWidth,pArea.left);
+		const int to = std::min(centreX + halfWidth + 1,pArea.right);
+		EllipseArcShape::Runs runs;
+		const int holeHalfWidth = inner.Get(y - centreY);
+		if( holeHalfWidth >= 0 )
+		{
+			runs.Add(from,std::min(to,centreX - holeHalfWidth));
+			runs.Add(std::max(from,centreX + holeHalfWidth + 1),to);
+		}
+		else
+		{
+			runs.Add(from,to);
+		}
+
+		if( pShape.mHasWedge )
+		{
+			runs = EllipseArcShape::Runs::Intersect(runs,pShape.GetWedgeRuns(y,0.0f));
+		}
+
+		for( int n = 0 ; n < runs.count ; n++ )
+		{
+			pFillRun(runs.from[n],runs.to[n],y);
+		}
+	}
+}
+
+/**
+ * @brief Draws the shape a row at a time, each run of pixels once.
+ * Without anti-aliasing the pixels with their centre inside are written. With it the coverage of the edge pixels, times pAlpha, is blended.
+ * @return The area drawn to.
+ */
+template<class FORMAT> static Rect FillEllipseArc(DrawBuffer& pBuffer,const EllipseArcShape& pShape,bool pAntiAliased,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect area = pShape.GetBounds(pAntiAliased ? 1.0f : 0.0f).Intersect(pBuffer.GetClipRect());
+	if( area.GetIsEmpty() )
+		return Rect();
+
+	if( !pAntiAliased )
+	{
+		const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,pAlpha);
+		ForEllipseArcRuns(pShape,area,[&](int pFromX,int pToX,int pY)
+		{
+			FillRow<FORMAT>(pBuffer.GetPixelAddress(pFromX,pY),pToX - pFromX,pixel);
+		});
+		return area;
+	}
+
+	const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,255);
+	auto drawEdge = [&](int pFromX,int pToX,int pY)
+	{
+		uint8_t* dst = pBuffer.GetPixelAddress(pFromX,pY);
+		for( int x = pFromX ; x < pToX ; x++, dst += FORMAT::PIXEL_SIZE )
+		{
+			const uint32_t alpha = Div255((uint32_t)(pShape.GetCoverage(x,pY) * 255.0f + 0.5f) * pAlpha);
+			if( alpha == 255 )
+				FORMAT::Write(dst,pixel);
+			else if( alpha > 0 )
+				BlendPixelFormat<FORMAT>(dst,pRed,pGreen,pBlue,alpha);
+		}
+	};
+
+	auto drawSolid = [&](int pFromX,int pToX,int pY)
+	{
+		if( pAlpha == 255 )
+		{
+			FillRow<FORMAT>(pBuffer.GetPixelAddress(pFromX,pY),pToX - pFromX,pixel);
+		}
+		else
+		{
+			uint8_t* dst = pBuffer.GetPixelAddress(pFromX,pY);
+			for( int x = pFromX ; x < pToX ; x++, dst += FORMAT::PIXEL_SIZE )
+			{
+				BlendPixelFormat<FORMAT>(dst,pRed,pGreen,pBlue,pAlpha);
+			}
+		}
+	};
+
+	for( int y = area.top ; y < area.bottom ; y++ )
+	{
+		// The pixels with some of the shape in them, and inside those the ones that are all covered so don't need their coverage working out.
+		const EllipseArcShape::Runs edges = pShape.GetRuns(y,0.5f,area.left,area.right);
+		const EllipseArcShape::Runs solid = EllipseArcShape::Runs::Intersect(pShape.GetRuns(y,-0.5f,area.left,area.right),edges);
+		int s = 0;
+		for( int e = 0 ; e < edges.count ; e++ )
+		{
+			int x = edges.from[e];
+			for( ; s < solid.count && solid.to[s] <= edges.to[e] ; s++ )
+			{
+				drawEdge(x,solid.from[s],y);
+				drawSolid(solid.from[s],solid.to[s],y);
+				x = solid.to[s];
+			}
+			drawEdge(x,edges.to[e],y);
+		}
+	}
+	return area;
+}
+
+/**
+ * @brief Draws an anti-aliased rounded rectangle, less pHole for the outlines. The corners are blended from their coverage and the rest is filled as spans.
+ */
+template<class FORMAT> static Rect FillRoundedRectangleRows(DrawBuffer& pBuffer,const RoundedRectRows& pShape,const RoundedRectRows* pHole,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect area = Rect(pShape.mLeft,pShape.mTop,pShape.mRight,pShape.mBottom).Intersect(pBuffer.GetClipRect());
+	if( area.GetIsEmpty() )
+		return Rect();
+
+	const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,255);
+	auto drawEdge = [&](int pFromX,int pToX,int pY)
+	{
+		pFromX = std::max(pFromX,area.left);
+		pToX = std::min(pToX,area.right);
+		if( pFromX >= pToX )
+			return;
+
+		uint8_t* dst = pBuffer.GetPixelAddress(pFromX,pY);
+		for( int x = pFromX ; x < pToX ; x++, dst += FORMAT::PIXEL_SIZE )
+		{
+			uint32_t coverage = pShape.GetCoverage(x,pY);
+			if( pHole )
+				coverage -= std::min(pHole->GetCoverage(x,pY),coverage);
+
+			const uint32_t alpha = Div255(coverage * pAlpha);
+			if( alpha == 255 )
+				FORMAT::Write(dst,pixel);
+			else if( alpha > 0 )
+				BlendPixelFormat<FORMAT>(dst,pRed,pGreen,pBlue,alpha);
+		}
+	};
+
+	auto drawSolid = [&](int pFromX,int pToX,int pY)
+	{
+		pFromX = std::max(pFromX,area.left);
+		pToX = std::min(pToX,area.right);
+		if( pFromX >= pToX )
+			return;
+
+		if( pAlpha == 255 )
+		{
+			FillRow<FORMAT>(pBuffer.GetPixelAddress(pFromX,pY),pToX - pFromX,pixel);
+		}
+		else
+		{
+			uint8_t* dst = pBuffer.GetPixelAddress(pFromX,pY);
+			for( int x = pFromX ; x < pToX ; x++, dst += FORMAT::PIXEL_SIZE )
+			{
+				BlendPixelFormat<FORMAT>(dst,pRed,pGreen,pBlue,pAlpha);
+			}
+		}
+	};
+
+	// A run of pixels with all covered ones in the middle, pSolidFrom and pSolidTo can be outside of it.
+	auto drawRun = [&](int pFromX,int pToX,int pSolidFrom,int pSolidTo,int pY)
+	{
+		pSolidFrom = std::min(std::max(pSolidFrom,pFromX),pToX);
+		pSolidTo = std::min(std::max(pSolidTo,pSolidFrom),pToX);
+		drawEdge(pFromX,pSolidFrom,pY);
+		drawSolid(pSolidFrom,pSolidTo,pY);
+		drawEdge(pSolidTo,pToX,pY);
+	};
+
+	for( int y = area.top ; y < area.bottom ; y++ )
+	{
+		int from,to,solidFrom,solidTo;
+		if( !pShape.GetRow(y,from,to,solidFrom,solidTo) )
+			continue;
+
+		int holeFrom,holeTo,holeSolidFrom,holeSolidTo;
+		if( pHole && pHole->GetRow(y,holeFrom,holeTo,holeSolidFrom,holeSolidTo) )
+		{
+			// Either side of the hole, then the edge of the hole with nothing drawn where it is all covered.
+			drawRun(from,holeFrom,solidFrom,solidTo,y);
+			if( holeSolidFrom < holeSolidTo )
+			{
+				drawEdge(holeFrom,holeSolidFrom,y);
+				drawEdge(holeSolidTo,holeTo,y);
+			}
+			else
+			{
+				drawEdge(holeFrom,holeTo,y);
+			}
+			drawRun(holeTo,to,solidFrom,solidTo,y);
+		}
+		else
+		{
+			drawRun(from,to,solidFrom,solidTo,y);
+		}
+	}
+	return area;
+}
+
+/**
+ * @brief Reads a pixel as red and blue in the top and bottom halves of rRedBlue, and alpha and green in rAlphaGreen.
+ * For mixing pixels two channels at a time. The 32 bit formats are already laid out that way.
+ */
+template<class SOURCE> static inline void ReadChannelPairs(const uint8_t* pSource,uint32_t& rRedBlue,uint32_t& rAlphaGreen)
+{
+	if constexpr( std::is_same<SOURCE,PixelFormatBGRA8888>::value || std::is_same<SOURCE,PixelFormatBGRX8888>::value )
+	{
+		const uint32_t pixel = SOURCE::Read(pSource);
+		rRedBlue = pixel & 0x00ff00ff;
+		rAlphaGreen = (pixel >> 8) & 0x00ff00ff;
+		if( SOURCE::HAS_ALPHA == false )
+			rAlphaGreen |= 0x00ff0000;
+	}
+	else
+	{
+		uint8_t r,g,b,a;
+		SOURCE::Unpack(SOURCE::Read(pSource),r,g,b,a);
+		rRedBlue = (r << 16) | b;
+		rAlphaGreen = (a << 16) | g;
+	}
+}
+
+/**
+ * @brief Mixes the pairs of channels from ReadChannelPairs, pAmount is 0 for all of pFrom to 256 for all of pTo.
+ */
+static inline uint32_t MixChannelPairs(uint32_t pFrom,uint32_t pTo,uint32_t pAmount)
+{
+	return ((((pFrom * (256 - pAmount)) + (pTo * pAmount)) + 0x00800080) >> 8) & 0x00ff00ff;
+}
+
+/**
+ * @brief Multiplies the red, green and blue from ReadChannelPairs by the alpha, so see through pixels add no colour when mixed.
+ */
+static inline void PreMultiplyChannelPairs(uint32_t& rRedBlue,uint32_t& rAlphaGreen)
+{
+	const uint32_t alpha = rAlphaGreen >> 16;
+	const uint32_t redBlue = (rRedBlue * alpha) + 0x00800080;
+	const uint32_t green = ((rAlphaGreen & 255) * alpha) + 128;
+	rRedBlue = ((redBlue + ((redBlue >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+	rAlphaGreen = (alpha << 16) | ((green + (green >> 8)) >> 8);
+}
+
+/**
+ * @brief The draw buffer pixels an image of pWidth by pHeight taken through pTransform could land on, for BlitTransformed.
+ */
+static Rect GetTransformedBounds(const Matrix& pTransform,int pWidth,int pHeight)
+{
+	float left = INFINITY,top = INFINITY,right = -INFINITY,bottom = -INFINITY;
+	for( const float y : {-0.5f,pHeight - 0.5f} )
+	{
+		for( const float x : {-0.5f,pWidth - 0.5f} )
+		{
+			float tx,ty;
+			pTransform.Transform(x,y,tx,ty);
+			left = std::min(left,tx);
+			top = std::min(top,ty);
+			right = std::max(right,tx);
+			bottom = std::max(bottom,ty);
+		}
+	}
+
+	// A little past the corners, the rows work out exactly which pixels are on the image.
+	const float limit = (float)(INT_MAX / 2);
+	auto toPixel = [limit](float pValue){return (int)std::min(std::max(pValue,-limit),limit);};
+	return Rect(toPixel(floorf(left)),toPixel(floorf(top)),toPixel(ceilf(right)) + 1,toPixel(ceilf(bottom)) + 1);
+}
+
+/**
+ * @brief Steps through the pixels of pArea that land on a pImageWidth by pImageHeight image, pInverse taking them back to the image.
+ * Each row's run of pixels is worked out exactly, in the same 16.16 fixed point as the stepping, so every one is on the image.
+ * pDraw(dst,u,v) is called for each with u,v where it is on the image, whole numbers being the image's pixel centres.
+ * @return The area drawn to.
+ */
+template<class DEST,class DRAW> static Rect TransformRows(DrawBuffer& pBuffer,const Matrix& pInverse,int pImageWidth,int pImageHeight,const Rect& pArea,DRAW&& pDraw)
+{
+	constexpr int64_t ONE = 1 << 16;
+	constexpr int64_t HALF = ONE / 2;
+	const int64_t stepU = llround(pInverse.a * ONE);
+	const int64_t stepV = llround(pInverse.b * ONE);
+
+	// Narrows rFrom to rTo to the x where pLow <= pStart + (x * pStep) < pHigh.
+	auto limit = [](int64_t pStart,int64_t pStep,int64_t pLow,int64_t pHigh,int64_t& rFrom,int64_t& rTo)
+	{
+		if( pStep > 0 )
+		{
+			rFrom = std::max(rFrom,CeilDivide(pLow - pStart,pStep));
+			rTo = std::min(rTo,CeilDivide(pHigh - pStart,pStep));
+		}
+		else if( pStep < 0 )
+		{
+			rFrom = std::max(rFrom,FloorDivide(pStart - pHigh,-pStep) + 1);
+			rTo = std::min(rTo,FloorDivide(pStart - pLow,-pStep) + 1);
+		}
+		else if( pStart < pLow || pStart >= pHigh )
+		{
+			rTo = rFrom;
+		}
+	};
+
+	Rect drawn;
+	for( int y = pArea.top ; y < pArea.bottom ; y++ )
+	{
+		// From x = 0, not the clip rect, so the pixels are the same however the buffer is clipped.
+		const int64_t startU = llround(((pInverse.c * (double)y) + pInverse.tx) * ONE);
+		const int64_t startV = llround(((pInverse.d * (double)y) + pInverse.ty) * ONE);
+		int64_t from = pArea.left;
+		int64_t to = pArea.right;
+		limit(startU,stepU,-HALF,(pImageWidth * ONE) - HALF,from,to);
+		limit(startV,stepV,-HALF,(pImageHeight * ONE) - HALF,from,to);
+		if( from >= to )
+			continue;
+
+		// All the pixels in the run are on the image so the positions fit in 32 bits, and so do the steps if there is more than one.
+		int32_t u = (int32_t)(startU + (from * stepU));
+		int32_t v = (int32_t)(startV + (from * stepV));
+		const int32_t du = to - from > 1 ? (int32_t)stepU : 0;
+		const int32_t dv = to - from > 1 ? (int32_t)stepV : 0;
+		uint8_t* dst = pBuffer.GetPixelAddress((int)from,y);
+		for( int n = (int)(to - from) ; ; )
+		{
+			pDraw(dst,u,v);
+			if( --n == 0 )
+				break;
+			dst += DEST::PIXEL_SIZE;
+			u += du;
+			v += dv;
+		}
+		drawn = drawn.Union(Rect((int)from,y,(int)to,y + 1));
+	}
+	return drawn;
+}
+
+/**
+ * @brief Where pixel pDest of a line pDestSize long lands on a line of pSourceSize image pixels, for BlitScaled.
+ * The image pixel either side of the centre and 256ths of the way from the first to the second.
+ */
+struct ScaledSample
+{
+	int first;
+	int second;
+	uint32_t fraction;
+
+	ScaledSample(int pDest,int pDestSize,int pSourceSize)
+	{
+		// Half a pixel in from either end the pixels either side are the same one.
+		const int64_t position = std::max<int64_t>(((((2 * (int64_t)pDest) + 1) * pSourceSize * 256) / (2 * (int64_t)pDestSize)) - 128,0);
+		first = (int)(position >> 8);
+		if( first >= pSourceSize - 1 )
+		{
+			first = second = pSourceSize - 1;
+			fraction = 0;
+		}
+		else
+		{
+			second = first + 1;
+			fraction = (uint32_t)(position & 255);
+		}
+	}
+
+	/**
+	 * @brief The image pixel pDest lands in, for IMAGE_FILTER_NEAREST.
+	 */
+	static int GetNearest(int pDest,int pDestSize,int pSourceSize)
+	{
+		return (int)((((2 * (int64_t)pDest) + 1) * pSourceSize) / (2 * (int64_t)pDestSize));
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Pixel memory Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+static constexpr size_t PIXEL_MEMORY_ALIGNMENT = 64;	// Cache line size, and more than enough for any of the vector loads.
+static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+void* AllocatePixelMemory(size_t pNumBytes)
+{
+	size_t alignment = PIXEL_MEMORY_ALIGNMENT;
+#if defined(USE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+	if( pNumBytes >= HUGE_PAGE_SIZE )
+	{
+		alignment = HUGE_PAGE_SIZE;
+	}
+#endif
+
+	void* memory = nullptr;
+	if( posix_memalign(&memory,alignment,pNumBytes) != 0 )
+	{
+		throw std::bad_alloc();
+	}
+
+#if defined(USE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+	if( alignment == HUGE_PAGE_SIZE )
+	{// Only a hint, if the kernel can't then we just have normal pages.
+		madvise(memory,pNumBytes & ~(HUGE_PAGE_SIZE-1),MADV_HUGEPAGE);
+	}
+#endif
+	return memory;
+}
+
+void FreePixelMemory(void* pMemory)
+{
+	free(pMemory);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DrawBuffer Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+DrawBuffer::DrawBuffer(int pWidth, int pHeight,bool pHasAlpha,bool pPreMultipliedAlpha)
+{
+	Resize(pWidth,pHeight,pHasAlpha,pPreMultipliedAlpha);
+}
+
+DrawBuffer::DrawBuffer(int pWidth, int pHeight,PixelFormat pFormat,bool pPreMultipliedAlpha)
+{
+	Resize(pWidth,pHeight,pFormat,pPreMultipliedAlpha);
+}
+
+DrawBuffer::DrawBuffer(const FrameBuffer* pFB)
+{
+	assert( pFB );
+
+	// Use the display's own layout so present does not have to convert every pixel.
+	// When not rotated the stride matches too, padding and all, then present is one memcpy.
+	PixelFormat format;
+	if( pFB->GetNativePixelFormat(format) == false )
+	{
+		format = PIXEL_FORMAT_BGR888;
+	}
+
+	size_t stride = 0;
+	if( pFB->GetIsRotated() == false && (size_t)pFB->GetStride() >= pFB->GetWidth() * GetPixelFormatSize(format) )
+	{
+		stride = pFB->GetStride();
+	}
+	Resize(pFB->GetWidth(),pFB->GetHeight(),format,false,stride);
+	Clear(0); // Goes straight to the screen, so don't show what was in the memory.
+}
+
+DrawBuffer::DrawBuffer() :
+	mWidth(0),
+	mHeight(0),
+	mFormat(PIXEL_FORMAT_BGR888),
+	mPixelSize(0),
+	mStride(0),
+	mHasAlpha(false),
+	mPreMultipliedAlpha(false)
+{
+}
+
+void DrawBuffer::Resize(int pWidth, int pHeight,PixelFormat pFormat,bool pPreMultipliedAlpha,size_t pStride)
+{
+	assert( pWidth > 0 );
+	assert( pHeight > 0 );
+	assert( pPreMultipliedAlpha == false || pFormat == PIXEL_FORMAT_BGRA8888 ); // Only format that can hold pre multiplied alpha.
+
+	mWidth = pWidth;
+	mHeight = pHeight;
+	mFormat = pFormat;
+	mPixelSize = GetPixelFormatSize(pFormat);
+	mStride = pStride ? pStride : pWidth * mPixelSize;
+	assert( (size_t)mStride >= pWidth * mPixelSize );
+	mViewPixels = nullptr;
+	mViewParent = nullptr;
+	mClip = Rect(0,0,pWidth,pHeight);
+	mClipStack.clear();
+	mHasAlpha = pFormat == PIXEL_FORMAT_BGRA8888 || pFormat == PIXEL_FORMAT_A8;
+	mPreMultipliedAlpha = pPreMultipliedAlpha;
+	mPixels.resize(mHeight * mStride);
+
+	// All the pixels are new.
+	mDirtyRects.clear();
+	mOpacityTiles.clear();
+	Touched(mClip);
+}
+
+void DrawBuffer::SetViewPixels(uint8_t* pPixels,int pWidth,int pHeight,ptrdiff_t pStride,PixelFormat pFormat,bool pPreMultipliedAlpha)
+{
+	assert( pPixels );
+	assert( pWidth >= 0 );
+	assert( pHeight >= 0 );
+	assert( pPreMultipliedAlpha == false || pFormat == PIXEL_FORMAT_BGRA8888 );
+
+	mWidth = pWidth;
+	mHeight = pHeight;
+	mFormat = pFormat;
+	mPixelSize = GetPixelFormatSize(pFormat);
+	mStride = pStride;
+	assert( (size_t)std::abs(mStride) >= pWidth * mPixelSize || pHeight < 2 );
+	mViewPixels = pPixels;
+	mViewParent = nullptr;
+	mClip = Rect(0,0,pWidth,pHeight);
+	mClipStack.clear();
+	mHasAlpha = pFormat == PIXEL_FORMAT_BGRA8888 || pFormat == PIXEL_FORMAT_A8;
+	mPreMultipliedAlpha = pPreMultipliedAlpha;
+	mOpacityTiles.clear();
+	PixelStorage().swap(mPixels);
+
+	mDirtyRects.clear();
+	Touched(mClip);
+}
+
+void DrawBuffer::SetViewParent(DrawBuffer* pParent,int pX,int pY,bool pFlipped)
+{
+	assert( mViewPixels );
+	mViewParent = pParent;
+	mViewX = pX;
+	mViewY = pY;
+	mViewFlipped = pFlipped;
+}
+
+void DrawBuffer::TouchParent(const Rect& pRect)
+{
+	// Only views pay for the lock, and only when the parent has something to keep up to date.
+	static std::mutex parentLock;
+
+	DrawBuffer* parent = mViewParent;
+	const Rect rect = mViewFlipped ?
+		Rect(mViewX + pRect.left,mViewY - pRect.bottom + 1,mViewX + pRect.right,mViewY - pRect.top + 1) :
+		Rect(mViewX + pRect.left,mViewY + pRect.top,mViewX + pRect.right,mViewY + pRect.bottom);
+
+	if( parent->mTrackDirtyRects || parent->mOpacityTiles.size() > 0 )
+	{
+		std::lock_guard<std::mutex> lock(parentLock);
+		if( parent->mTrackDirtyRects )
+			parent->AddDirtyRect(rect);
+		if( parent->mOpacityTiles.size() > 0 )
+			parent->ForgetOpacityTiles(rect);
+	}
+
+	// A view of a view, pass it on up.
+	if( parent->mViewParent )
+		parent->TouchParent(rect);
+}
+
+void DrawBuffer::Resize(int pWidth, int pHeight, size_t pPixelSize,bool pHasAlpha,bool pPreMultipliedAlpha)
+{
+	assert( pPixelSize > 0 && pPixelSize < 5 );
+	assert( pHasAlpha == false || pPixelSize == 4 || pPixelSize == 1 );
+
+	PixelFormat format = PIXEL_FORMAT_BGR888;
+	switch( pPixelSize )
+	{
+	case 1:
+		format = PIXEL_FORMAT_A8;
+		break;
+
+	case 2:
+		format = PIXEL_FORMAT_RGB565;
+		break;
+
+	case 4:
+		format = pHasAlpha ? PIXEL_FORMAT_BGRA8888 : PIXEL_FORMAT_BGRX8888;
+		break;
+	}
+	Resize(pWidth,pHeight,format,pPreMultipliedAlpha);
+}
+
+void DrawBuffer::PushClipRect(const Rect& pRect)
+{
+	mClipStack.push_back(mClip);
+	mClip = mClip.Intersect(pRect);
+	if( mClip.GetIsEmpty() )
+	{// Keep it tidy so the other tests don't have to worry about inside out rects.
+		mClip = Rect();
+	}
+}
+
+void DrawBuffer::PopClipRect()
+{
+	assert( mClipStack.size() > 0 ); // More pops than pushes!
+	if( mClipStack.size() > 0 )
+	{
+		mClip = mClipStack.back();
+		mClipStack.pop_back();
+	}
+}
+
+void DrawBuffer::SetTrackDirtyRects(bool pTrack)
+{
+	mTrackDirtyRects = pTrack;
+	mDirtyRects.clear();
+
+	// What was drawn before we were looking is not known, so all of it. Nothing has been drawn so the opacity tiles are still right.
+	if( pTrack )
+		AddDirtyRect(Rect(0,0,mWidth,mHeight));
+}
+
+void DrawBuffer::AddDirtyRect(const Rect& pRect)
+{
+	// Beyond this many a new rect is merged into the one it grows the least. Each rect is a little overhead in present.
+	const size_t MAX_DIRTY_RECTS = 16;
+	// Rects are merged if that adds no more than this many pixels, or a third, that were not drawn to. Stops text and the like making lots of little rects.
+	const int64_t MERGE_SLACK = 64;
+	auto Area = [](const Rect& pRect){return (int64_t)pRect.GetWidth() * pRect.GetHeight();};
+
+	if( mTrackDirtyRects == false )
+		return;
+
+	Rect rect = pRect.Intersect(Rect(0,0,mWidth,mHeight));
+	if( rect.GetIsEmpty() )
+		return;
+
+	// Most of the time it's inside one we have already, things tend to be drawn over each other.
+	for( const Rect& dirty : mDirtyRects )
+	{
+		if( dirty.GetContains(rect) )
+			return;
+	}
+
+	// Merge with any that are close, the bigger rect may then be close to others so go round again.
+	bool merged;
+	do
+	{
+		merged = false;
+		for( size_t n = 0 ; n < mDirtyRects.size() ; n++ )
+		{
+			const Rect both = rect.Union(mDirtyRects[n]);
+			const int64_t drawn = Area(rect) + Area(mDirtyRects[n]);
+			if( Area(both) <= drawn + std::max(MERGE_SLACK,drawn / 3) )
+			{
+				rect = both;
+				mDirtyRects[n] = mDirtyRects.back();
+				mDirtyRects.pop_back();
+				merged = true;
+				break;
+			}
+		}
+	}while( merged );
+
+	if( mDirtyRects.size() >= MAX_DIRTY_RECTS )
+	{// Full, so merge with the one that grows the least.
+		size_t best = 0;
+		int64_t bestGrowth = INT64_MAX;
+		for( size_t n = 0 ; n < mDirtyRects.size() ; n++ )
+		{
+			const int64_t growth = Area(rect.Union(mDirtyRects[n])) - Area(mDirtyRects[n]);
+			if( growth < bestGrowth )
+			{
+				best = n;
+				bestGrowth = growth;
+			}
+		}
+		mDirtyRects[best] = mDirtyRects[best].Union(rect);
+	}
+	else
+	{
+		mDirtyRects.push_back(rect);
+	}
+}
+
+bool DrawBuffer::ClipBlit(int& rX,int& rY,int& rSourceX,int& rSourceY,int& rWidth,int& rHeight)const
+{
+	if( rX < mClip.left )
+	{
+		rSourceX += mClip.left - rX;
+		rWidth -= mClip.left - rX;
+		rX = mClip.left;
+	}
+
+	if( rY < mClip.top )
+	{
+		rSourceY += mClip.top - rY;
+		rHeight -= mClip.top - rY;
+		rY = mClip.top;
+	}
+
+	if( rX + rWidth > mClip.right )
+		rWidth = mClip.right - rX;
+
+	if( rY + rHeight > mClip.bottom )
+		rHeight = mClip.bottom - rY;
+
+	return rWidth > 0 && rHeight > 0;
+}
+
+void DrawBuffer::BlendPixel(int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( mClip.GetContains(pX,pY) )
+	{
+		uint8_t* dst = GetPixelAddress(pX,pY);
+
+		AssertPixelIsInBuffer(dst);
+
+		DispatchPixelFormat(mFormat,[&](auto pFormat)
+		{
+			BlendPixelFormat<decltype(pFormat)>(dst,pRed,pGreen,pBlue,pAlpha);
+		});
+		Touched(Rect(pX,pY,pX+1,pY+1));
+	}
+}
+
+void DrawBuffer::BlendPreAlphaPixel(int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( mClip.GetContains(pX,pY) )
+	{
+		uint8_t* dst = GetPixelAddress(pX,pY);
+
+		AssertPixelIsInBuffer(dst);
+
+		// pAlpha will already have been subtracted from 255. So just use value.
+		// For pre calculated alpha there is no good choice for combining the source and dest alpha. So we just ignore it.
+		DispatchPixelFormat(mFormat,[&](auto pFormat)
+		{
+			BlendPreAlphaPixelFormat<decltype(pFormat)>(dst,pRed,pGreen,pBlue,pAlpha);
+		});
+		Touched(Rect(pX,pY,pX+1,pY+1));
+	}
+}
+
+void DrawBuffer::Clear(uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		FillArea<FORMAT>(*this,mClip,FORMAT::Pack(pRed,pGreen,pBlue,pAlpha));
+	});
+	Touched(mClip);
+}
+
+void DrawBuffer::Clear(uint8_t pValue)
+{
+	if( mJobs == nullptr && mViewPixels == nullptr && mClipStack.empty() )
+	{// All ours, padding and all, so one go.
+		memset(mPixels.data(),pValue,mPixels.size());
+	}
+	else
+	{
+		ForRows(mJobs,mClip,[&](int pFromY,int pToY)
+		{
+			for( int y = pFromY ; y < pToY ; y++ )
+			{
+				memset(GetPixelAddress(mClip.left,y),pValue,mClip.GetWidth() * mPixelSize);
+			}
+		});
+	}
+	Touched(mClip);
+}
+
+void DrawBuffer::BlitRGB(const uint8_t* pSourcePixels,int pX,int pY,int pSourceWidth,int pSourceHeight)
+{
+	BlitRGB(pSourcePixels,pX,pY,pSourceWidth,pSourceHeight,0,0,pSourceWidth * 3);
+}
+	
+void DrawBuffer::BlitRGB(const uint8_t* pSourcePixels,int pX,int pY,int pWidth,int pHeight,int pSourceX,int pSourceY,int pSourceStride)
+{
+	if( ClipBlit(pX,pY,pSourceX,pSourceY,pWidth,pHeight) == false )
+		return;
+	Touched(Rect(pX,pY,pX + pWidth,pY + pHeight));
+
+	const uint8_t* src = pSourcePixels + (pSourceX*3) + (pSourceY * pSourceStride);
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		for( int y = 0 ; y < pHeight ; y++, src += pSourceStride )
+		{
+			ConvertRow<PixelFormatRGB888Source,decltype(pFormat)>(GetPixelAddress(pX,pY + y),src,pWidth);
+		}
+	});
+}
+
+void DrawBuffer::BlitRGBA(const uint8_t* pSourcePixels,int pX,int pY,int pSourceWidth,int pSourceHeight,bool pPreMultipliedAlpha,BlendMode pMode)
+{
+	BlitRGBA(pSourcePixels,pX,pY,pSourceWidth,pSourceHeight,0,0,pSourceWidth * 4,pPreMultipliedAlpha,pMode);
+}
+
+void DrawBuffer::BlitRGBA(const uint8_t* pSourcePixels,int pX,int pY,int pWidth,int pHeight,int pSourceX,int pSourceY,int pSourceStride,bool pPreMultipliedAlpha,BlendMode pMode)
+{
+	if( ClipBlit(pX,pY,pSourceX,pSourceY,pWidth,pHeight) == false )
+		return;
+	Touched(Rect(pX,pY,pX + pWidth,pY + pHeight));
+
+	const uint8_t* src = pSourcePixels + (pSourceX*4) + (pSourceY * pSourceStride);
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		if( pMode != BLEND_MODE_NORMAL )
+		{
+			DispatchBlendMode(pMode,[&](auto pMode)
+			{
+				for( int y = 0 ; y < pHeight ; y++, src += pSourceStride )
+				{
+					uint8_t* dst = GetPixelAddress(pX,pY + y);
+					AssertPixelIsInBuffer(dst);
+					BlendModeRow<FORMAT,decltype(pMode)::value>(dst,src,4,true,pPreMultipliedAlpha,pWidth);
+				}
+			});
+			return;
+		}
+
+		for( int y = 0 ; y < pHeight ; y++, src += pSourceStride )
+		{
+			uint8_t* dst = GetPixelAddress(pX,pY + y);
+			AssertPixelIsInBuffer(dst);
+			if( pPreMultipliedAlpha )
+				BlendPreAlphaRow<PixelFormatRGBA8888Source,FORMAT>(dst,src,pWidth);
+			else
+				BlendRow<PixelFormatRGBA8888Source,FORMAT>(dst,src,pWidth);
+		}
+	});
+}
+
+/**
+ * @brief True if pHeight rows at pA share any bytes with pHeight rows at pB. A view can be drawn into the buffer it is a view of.
+ */
+static bool RowsOverlap(const uint8_t* pA,ptrdiff_t pAStride,size_t pARowBytes,const uint8_t* pB,ptrdiff_t pBStride,size_t pBRowBytes,int pHeight)
+{
+	const uintptr_t aFirst = (uintptr_t)pA;
+	const uintptr_t aLast = (uintptr_t)(pA + ((pHeight - 1) * pAStride));
+	const uintptr_t bFirst = (uintptr_t)pB;
+	const uintptr_t bLast = (uintptr_t)(pB + ((pHeight - 1) * pBStride));
+	return std::min(aFirst,aLast) < std::max(bFirst,bLast) + pBRowBytes && std::min(bFirst,bLast) < std::max(aFirst,aLast) + pARowBytes;
+}
+
+/**
+ * @brief Copies pHeight rows of pRowBytes at rSource to rCopy, then points rSource and rStride at the copy.
+ * For when the source and dest overlap in a way that can't be done by picking the order rows are done in.
+ */
+static void CopySourceRows(PixelStorage& rCopy,const uint8_t*& rSource,ptrdiff_t& rStride,size_t pRowBytes,int pHeight)
+{
+	rCopy.resize(pRowBytes * pHeight);
+	for( int y = 0 ; y < pHeight ; y++ )
+	{
+		memcpy(rCopy.data() + (y * pRowBytes),rSource + (y * rStride),pRowBytes);
+	}
+	rSource = rCopy.data();
+	rStride = pRowBytes;
+}
+
+void DrawBuffer::Blit(const DrawBuffer& pImage,int pX,int pY)
+{
+	Blit(pImage,pX,pY,Rect(0,0,pImage.mWidth,pImage.mHeight));
+}
+
+void DrawBuffer::Blit(const DrawBuffer& pImage,int pX,int pY,const Rect& pSource)
+{
+	assert( Rect(0,0,pImage.mWidth,pImage.mHeight).GetContains(pSource) );
+	int sourceX = pSource.left;
+	int sourceY = pSource.top;
+	int width = pSource.GetWidth();
+	int height = pSource.GetHeight();
+
+	// Work out what is visible once, then each row is a straight run of pixels.
+	if( ClipBlit(pX,pY,sourceX,sourceY,width,height) == false )
+		return;
+	Touched(Rect(pX,pY,pX + width,pY + height));
+
+	const uint8_t* src = pImage.GetPixelAddress(sourceX,sourceY);
+	ptrdiff_t srcStride = pImage.mStride;
+	uint8_t* dst = GetPixelAddress(pX,pY);
+	PixelStorage copy;
+	const bool overlaps = RowsOverlap(src,srcStride,width * pImage.mPixelSize,dst,mStride,width * mPixelSize,height);
+
+	if( mFormat == pImage.mFormat && (overlaps == false || srcStride == mStride) )
+	{// Same format, so one memcpy per row.
+		const size_t rowBytes = width * mPixelSize;
+		if( overlaps == false )
+		{
+			for( int y = 0 ; y < height ; y++, src += srcStride, dst += mStride )
+			{
+				AssertPixelIsInBuffer(dst);
+				memcpy(dst,src,rowBytes);
+			}
+			return;
+		}
+
+		// Same memory, like ScrollBuffer. When the dest is further on start at the far end, so rows are moved before they are written over.
+		// memmove as a row can overlap the one it is moved from.
+		const bool farEndFirst = (dst > src) == (mStride > 0);
+		const ptrdiff_t step = farEndFirst ? -mStride : mStride;
+		if( farEndFirst )
+		{
+			src += (height - 1) * mStride;
+			dst += (height - 1) * mStride;
+		}
+		for( int y = 0 ; y < height ; y++, src += step, dst += step )
+		{
+			AssertPixelIsInBuffer(dst);
+			memmove(dst,src,rowBytes);
+		}
+	}
+	else
+	{
+		// If they overlap with a different stride or format, a FlipVertical view of the dest say, no order of rows works.
+		if( overlaps )
+			CopySourceRows(copy,src,srcStride,width * pImage.mPixelSize,height);
+
+		DispatchPixelFormat(pImage.mFormat,[&](auto pSourceFormat)
+		{
+			DispatchPixelFormat(mFormat,[&](auto pDestFormat)
+			{
+				for( int y = 0 ; y < height ; y++, src += srcStride, dst += mStride )
+				{
+					AssertPixelIsInBuffer(dst);
+					ConvertRow<decltype(pSourceFormat),decltype(pDestFormat)>(dst,src,width);
+				}
+			});
+		});
+	}
+}
+
+void DrawBuffer::Blend(const DrawBuffer& pImage,int pX,int pY,BlendMode pMode)
+{
+	Blend(pImage,pX,pY,Rect(0,0,pImage.mWidth,pImage.mHeight),pMode);
+}
+
+void DrawBuffer::Blend(const DrawBuffer& pImage,int pX,int pY,const Rect& pSource,BlendMode pMode)
+{
+	if( pImage.mHasAlpha == false && pMode == BLEND_MODE_NORMAL )
+	{
+		Blit(pImage,pX,pY,pSource);
+		return;
+	}
+
+	assert( Rect(0,0,pImage.mWidth,pImage.mHeight).GetContains(pSource) );
+	int sourceX = pSource.left;
+	int sourceY = pSource.top;
+	int width = pSource.GetWidth();
+	int height = pSource.GetHeight();
+
+	if( ClipBlit(pX,pY,sourceX,sourceY,width,height) == false )
+		return;
+	Touched(Rect(pX,pY,pX + width,pY + height));
+
+	const uint8_t* src = pImage.GetPixelAddress(sourceX,sourceY);
+	ptrdiff_t srcStride = pImage.mStride;
+	uint8_t* dst = GetPixelAddress(pX,pY);
+
+	// Blending reads the dest as well, so if the source is in the same memory it is copied out first, whatever the overlap.
+	PixelStorage copy;
+	if( RowsOverlap(src,srcStride,width * pImage.mPixelSize,dst,mStride,width * mPixelSize,height) )
+		CopySourceRows(copy,src,srcStride,width * pImage.mPixelSize,height);
+
+	DispatchPixelFormat(pImage.mFormat,[&](auto pSourceFormat)
+	{
+		DispatchPixelFormat(mFormat,[&](auto pDestFormat)
+		{
+			typedef decltype(pSourceFormat) SOURCE;
+			typedef decltype(pDestFormat) DEST;
+			auto blendRow = [&](uint8_t* pDest,const uint8_t* pSource,int pCount)
+			{
+				if( pMode != BLEND_MODE_NORMAL )
+					BlendModeImageRow<SOURCE,DEST>(pDest,pSource,pImage.mPreMultipliedAlpha,pMode,pCount);
+				else if( pImage.mPreMultipliedAlpha )
+					BlendPreAlphaRow<SOURCE,DEST>(pDest,pSource,pCount);
+				else
+					BlendRow<SOURCE,DEST>(pDest,pSource,pCount);
+			};
+
+			if( pImage.mOpacityTiles.empty() )
+			{
+				for( int y = 0 ; y < height ; y++, src += srcStride, dst += mStride )
+				{
+					AssertPixelIsInBuffer(dst);
+					blendRow(dst,src,width);
+				}
+				return;
+			}
+
+			// Runs of tiles across the image that are skipped, copied or blended, worked out again for each row of tiles.
+			// Solid pre multiplied pixels have an inverted alpha of 0 so are only copied to formats without alpha.
+			// See through tiles leave the dest as it is in all the modes, solid ones are only copied by the normal blend.
+			const bool copySolid = pMode == BLEND_MODE_NORMAL && (pImage.mPreMultipliedAlpha == false || DEST::HAS_ALPHA == false);
+			const int tileColumns = (pImage.mWidth + OPACITY_TILE_SIZE - 1) / OPACITY_TILE_SIZE;
+			struct Run
+			{
+				int from,count;
+				TileOpacity opacity;
+			};
+			std::vector<Run> runs;
+			int runsTileRow = -1;
+			for( int y = 0 ; y < height ; y++, src += srcStride, dst += mStride )
+			{
+				AssertPixelIsInBuffer(dst);
+				const int tileRow = (sourceY + y) / OPACITY_TILE_SIZE;
+				if( tileRow != runsTileRow )
+				{
+					runsTileRow = tileRow;
+					runs.clear();
+					for( int x = 0 ; x < width ; )
+					{
+						const int tileColumn = (sourceX + x) / OPACITY_TILE_SIZE;
+						const int to = std::min(((tileColumn + 1) * OPACITY_TILE_SIZE) - sourceX,width);
+						TileOpacity opacity = pImage.mOpacityTiles[(tileRow * tileColumns) + tileColumn];
+						if( opacity == TILE_UNKNOWN || (opacity == TILE_SOLID && copySolid == false) )
+							opacity = TILE_MIXED;
+
+						if( runs.size() > 0 && runs.back().opacity == opacity )
+							runs.back().count += to - x;
+						else
+							runs.push_back({x,to - x,opacity});
+						x = to;
+					}
+				}
+
+				for( const Run& run : runs )
+				{
+					uint8_t* runDest = dst + (run.from * DEST::PIXEL_SIZE);
+					const uint8_t* runSource = src + (run.from * SOURCE::PIXEL_SIZE);
+					if( run.opacity == TILE_SOLID )
+					{
+						if constexpr( std::is_same<SOURCE,DEST>::value )
+							memcpy(runDest,runSource,run.count * DEST::PIXEL_SIZE);
+						else
+							ConvertRow<SOURCE,DEST>(runDest,runSource,run.count);
+					}
+					else if( run.opacity == TILE_MIXED )
+					{
+						blendRow(runDest,runSource,run.count);
+					}
+				}
+			}
+		});
+	});
+}
+
+void DrawBuffer::Blit(const Sprite& pSprite,int pX,int pY)
+{
+	if( pSprite.page )
+		Blit(*pSprite.page,pX,pY,pSprite.rect);
+}
+
+void DrawBuffer::Blend(const Sprite& pSprite,int pX,int pY)
+{
+	if( pSprite.page == nullptr || pSprite.clear )
+		return;
+
+	if( pSprite.solid )
+		Blit(*pSprite.page,pX,pY,pSprite.rect);
+	else
+		Blend(*pSprite.page,pX,pY,pSprite.rect);
+}
+
+void DrawBuffer::BlitScaled(const Sprite& pSprite,const Rect& pDest,ImageFilter pFilter,bool pBlend)
+{
+	if( pSprite.page == nullptr || (pBlend && pSprite.clear) )
+		return;
+
+	BlitScaled(*pSprite.page,pDest,pSprite.rect,pFilter,pBlend && !pSprite.solid);
+}
+
+void DrawBuffer::Blend(const SpanSprite& pSprite,int pX,int pY)
+{
+	const Rect& bounds = pSprite.GetBounds();
+	const Rect area = Rect(pX + bounds.left,pY + bounds.top,pX + bounds.right,pY + bounds.bottom).Intersect(mClip);
+	if( area.GetIsEmpty() )
+		return;
+	Touched(area);
+
+	// The clipped part of each line, from the left of the sprite.
+	const int left = area.left - pX;
+	const int right = area.right - pX;
+	DispatchPixelFormat(pSprite.GetSolidFormat(),[&](auto pSolidFormat)
+	{
+		DispatchPixelFormat(mFormat,[&](auto pDestFormat)
+		{
+			typedef decltype(pSolidFormat) SOLID;
+			typedef decltype(pDestFormat) DEST;
+			for( int y = area.top ; y < area.bottom ; y++ )
+			{
+				const SpanSprite::Span* end = pSprite.GetSpansEnd(y - pY);
+				for( const SpanSprite::Span* span = pSprite.GetSpansBegin(y - pY) ; span != end && span->x < right ; span++ )
+				{
+					const int from = std::max(span->x,left);
+					const int count = std::min(span->x + span->count,right) - from;
+					if( count <= 0 )
+						continue;
+
+					uint8_t* dst = GetPixelAddress(pX + from,y);
+					AssertPixelIsInBuffer(dst);
+					if( span->solid )
+					{
+						const uint8_t* src = pSprite.GetSolidPixels() + span->offset + ((from - span->x) * SOLID::PIXEL_SIZE);
+						if constexpr( std::is_same<SOLID,DEST>::value )
+							memcpy(dst,src,count * DEST::PIXEL_SIZE);
+						else
+							ConvertRow<SOLID,DEST>(dst,src,count);
+					}
+					else
+					{
+						const uint8_t* src = pSprite.GetBlendPixels() + span->offset + ((from - span->x) * PixelFormatBGRA8888::PIXEL_SIZE);
+						BlendRow<PixelFormatBGRA8888,DEST>(dst,src,count);
+					}
+				}
+			}
+		});
+	});
+}
+
+void DrawBuffer::BlitTransformed(const DrawBuffer& pImage,const Matrix& pTransform,ImageFilter pFilter,bool pBlend)
+{
+	assert( pImage.mWidth < 32768 && pImage.mHeight < 32768 );	// So the fixed point positions fit.
+	if( pImage.mWidth < 1 || pImage.mHeight < 1 || pTransform.GetDeterminant() == 0.0f )
+		return;
+
+	const Rect area = GetTransformedBounds(pTransform,pImage.mWidth,pImage.mHeight).Intersect(mClip);
+	if( area.GetIsEmpty() )
+		return;
+
+	const Matrix inverse = pTransform.GetInverse();
+	const uint8_t* pixels = pImage.GetPixelAddress(0,0);
+	const ptrdiff_t stride = pImage.mStride;
+	const int lastX = pImage.mWidth - 1;
+	const int lastY = pImage.mHeight - 1;
+	Rect drawn;
+	DispatchPixelFormat(pImage.mFormat,[&](auto pSourceFormat)
+	{
+		DispatchPixelFormat(mFormat,[&](auto pDestFormat)
+		{
+			typedef decltype(pSourceFormat) SOURCE;
+			typedef decltype(pDestFormat) DEST;
+
+			// pPut writes one pixel. For blending an image that is not pre multiplied the mixed colours are weighted by their alpha,
+			// else the colour of the see through pixels, which can be anything, bleeds into the edges.
+			auto draw = [&](auto pPut,auto pWeightByAlpha)
+			{
+				if( pFilter == IMAGE_FILTER_NEAREST )
+				{
+					drawn = TransformRows<DEST>(*this,inverse,pImage.mWidth,pImage.mHeight,area,[&](uint8_t* pDest,int32_t pU,int32_t pV)
+					{
+						const uint8_t* src = pixels + (((pV + 0x8000) >> 16) * stride) + (((pU + 0x8000) >> 16) * SOURCE::PIXEL_SIZE);
+						uint8_t r,g,b,a;
+						SOURCE::Unpack(SOURCE::Read(src),r,g,b,a);
+						pPut(pDest,r,g,b,a);
+					});
+					return;
+				}
+
+				drawn = TransformRows<DEST>(*this,inverse,pImage.mWidth,pImage.mHeight,area,[&](uint8_t* pDest,int32_t pU,int32_t pV)
+				{
+					// Half a pixel in from the edge the pixels either side are the same one.
+					const int x = pU >> 16;
+					const int y = pV >> 16;
+					const uint8_t* row0 = pixels + (std::max(y,0) * stride);
+					const uint8_t* row1 = pixels + (std::min(y + 1,lastY) * stride);
+					const size_t x0 = std::max(x,0) * SOURCE::PIXEL_SIZE;
+					const size_t x1 = std::min(x + 1,lastX) * SOURCE::PIXEL_SIZE;
+					const uint8_t* src[4] = {row0 + x0,row0 + x1,row1 + x0,row1 + x1};
+					const uint32_t fx = (pU >> 8) & 255;
+					const uint32_t fy = (pV >> 8) & 255;
+					// Red and blue, then alpha and green, are mixed two at a time in the halves of a 32 bit value.
+					uint32_t redBlue[4],alphaGreen[4];
+					for( int n = 0 ; n < 4 ; n++ )
+					{
+						ReadChannelPairs<SOURCE>(src[n],redBlue[n],alphaGreen[n]);
+					}
+
+					if( pWeightByAlpha && (alphaGreen[0] >> 16 != alphaGreen[1] >> 16 || alphaGreen[0] >> 16 != alphaGreen[2] >> 16 || alphaGreen[0] >> 16 != alphaGreen[3] >> 16) )
+					{
+						const uint32_t weights[4] = {
+							(256 - fx) * (256 - fy) * (alphaGreen[0] >> 16),
+							fx * (256 - fy) * (alphaGreen[1] >> 16),
+							(256 - fx) * fy * (alphaGreen[2] >> 16),
+							fx * fy * (alphaGreen[3] >> 16)};
+						const uint32_t total = weights[0] + weights[1] + weights[2] + weights[3];
+						if( total == 0 )
+							return;
+
+						uint32_t red = 0,green = 0,blue = 0;
+						for( int n = 0 ; n < 4 ; n++ )
+						{
+							red += weights[n] * (redBlue[n] >> 16);
+							green += weights[n] * (alphaGreen[n] & 255);
+							blue += weights[n] * (redBlue[n] & 255);
+						}
+						pPut(pDest,(uint8_t)((red + (total / 2)) / total),(uint8_t)((green + (total / 2)) / total),(uint8_t)((blue + (total / 2)) / total),(uint8_t)((total + 32768) >> 16));
+						return;
+					}
+
+					const uint32_t rb = MixChannelPairs(MixChannelPairs(redBlue[0],redBlue[1],fx),MixChannelPairs(redBlue[2],redBlue[3],fx),fy);
+					const uint32_t ag = MixChannelPairs(MixChannelPairs(alphaGreen[0],alphaGreen[1],fx),MixChannelPairs(alphaGreen[2],alphaGreen[3],fx),fy);
+					pPut(pDest,(uint8_t)(rb >> 16),(uint8_t)ag,(uint8_t)rb,(uint8_t)(ag >> 16));
+				});
+			};
+
+			if( SOURCE::HAS_ALPHA && pBlend && pImage.mPreMultipliedAlpha )
+			{
+				draw([](uint8_t* pDest,uint8_t r,uint8_t g,uint8_t b,uint8_t a){BlendPreAlphaPixelFormat<DEST>(pDest,r,g,b,a);},std::false_type());
+			}
+			else if( SOURCE::HAS_ALPHA && pBlend )
+			{
+				draw([](uint8_t* pDest,uint8_t r,uint8_t g,uint8_t b,uint8_t a){BlendPixelFormat<DEST>(pDest,r,g,b,a);},std::true_type());
+			}
+			else
+			{
+				draw([](uint8_t* pDest,uint8_t r,uint8_t g,uint8_t b,uint8_t a){DEST::Write(pDest,DEST::Pack(r,g,b,a));},std::false_type());
+			}
+		});
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::BlitScaled(const DrawBuffer& pImage,const Rect& pDest,const Rect& pSource,ImageFilter pFilter,bool pBlend)
+{
+	assert( Rect(0,0,pImage.mWidth,pImage.mHeight).GetContains(pSource) );
+	if( pSource.GetIsEmpty() || Rect(0,0,pImage.mWidth,pImage.mHeight).GetContains(pSource) == false )
+		return;
+
+	const Rect area = pDest.Intersect(mClip);
+	if( area.GetIsEmpty() )
+		return;
+	Touched(area);
+
+	const int destWidth = pDest.GetWidth();
+	const int destHeight = pDest.GetHeight();
+	const int sourceWidth = pSource.GetWidth();
+	const int sourceHeight = pSource.GetHeight();
+	const int columns = area.GetWidth();
+	const int firstColumn = area.left - pDest.left;
+	DispatchPixelFormat(pImage.mFormat,[&](auto pSourceFormat)
+	{
+		DispatchPixelFormat(mFormat,[&](auto pDestFormat)
+		{
+			typedef decltype(pSourceFormat) SOURCE;
+			typedef decltype(pDestFormat) DEST;
+			const bool copy = !(SOURCE::HAS_ALPHA && pBlend);
+
+			// pPut writes an image pixel. pPutMixed writes mixed pixels, for blending an image that is not pre multiplied
+			// they are mixed with their colours multiplied by their alpha, else the colour of the see through pixels bleeds into the edges.
+			auto draw = [&](auto pPut,auto pPutMixed,auto pPreMultiply)
+			{
+				if( pFilter == IMAGE_FILTER_NEAREST )
+				{
+					std::vector<size_t> offsets(columns);
+					for( int n = 0 ; n < columns ; n++ )
+					{
+						offsets[n] = (pSource.left + ScaledSample::GetNearest(firstColumn + n,destWidth,sourceWidth)) * SOURCE::PIXEL_SIZE;
+					}
+
+					int lastRow = -1;
+					for( int y = area.top ; y < area.bottom ; y++ )
+					{
+						const int row = pSource.top + ScaledSample::GetNearest(y - pDest.top,destHeight,sourceHeight);
+						uint8_t* dest = GetPixelAddress(area.left,y);
+						if( copy && row == lastRow )
+						{
+							// Growing taller, the same image row as the line above.
+							memcpy(dest,GetPixelAddress(area.left,y - 1),columns * DEST::PIXEL_SIZE);
+							continue;
+						}
+						lastRow = row;
+
+						const uint8_t* source = pImage.GetPixelAddress(0,row);
+						for( int n = 0 ; n < columns ; n++, dest += DEST::PIXEL_SIZE )
+						{
+							uint8_t r,g,b,a;
+							SOURCE::Unpack(SOURCE::Read(source + offsets[n]),r,g,b,a);
+							pPut(dest,r,g,b,a);
+						}
+					}
+				}
+				else if( pFilter == IMAGE_FILTER_BOX && sourceWidth % destWidth == 0 && sourceHeight % destHeight == 0 )
+				{
+					const int factorX = sourceWidth / destWidth;
+					const int factorY = sourceHeight / destHeight;
+					const uint64_t count = (uint64_t)factorX * factorY;
+					const uint64_t colourCount = pPreMultiply ? count * 255 : count;
+					std::vector<uint64_t> sums(columns * 4);
+					for( int y = area.top ; y < area.bottom ; y++ )
+					{
+						std::fill(sums.begin(),sums.end(),0);
+						const int top = pSource.top + ((y - pDest.top) * factorY);
+						for( int row = top ; row < top + factorY ; row++ )
+						{
+							const uint8_t* source = pImage.GetPixelAddress(pSource.left + (firstColumn * factorX),row);
+							uint64_t* sum = sums.data();
+							for( int n = 0 ; n < columns ; n++, sum += 4 )
+							{
+								for( int k = 0 ; k < factorX ; k++, source += SOURCE::PIXEL_SIZE )
+								{
+									uint8_t r,g,b,a;
+									SOURCE::Unpack(SOURCE::Read(source),r,g,b,a);
+									const uint32_t weight = pPreMultiply ? a : 1;
+									sum[0] += r * weight;
+									sum[1] += g * weight;
+									sum[2] += b * weight;
+									sum[3] += a;
+								}
+							}
+						}
+
+						uint8_t* dest = GetPixelAddress(area.left,y);
+						const uint64_t* sum = sums.data();
+						for( int n = 0 ; n < columns ; n++, dest += DEST::PIXEL_SIZE, sum += 4 )
+						{
+							pPutMixed(dest,
+								(uint8_t)((sum[0] + (colourCount / 2)) / colourCount),
+								(uint8_t)((sum[1] + (colourCount / 2)) / colourCount),
+								(uint8_t)((sum[2] + (colourCount / 2)) / colourCount),
+								(uint8_t)((sum[3] + (count / 2)) / count));
+						}
+					}
+				}
+				else
+				{
+					std::vector<size_t> lefts(columns),rights(columns);
+					std::vector<uint32_t> fractions(columns);
+					for( int n = 0 ; n < columns ; n++ )
+					{
+						const ScaledSample sample(firstColumn + n,destWidth,sourceWidth);
+						lefts[n] = (pSource.left + sample.first) * SOURCE::PIXEL_SIZE;
+						rights[n] = (pSource.left + sample.second) * SOURCE::PIXEL_SIZE;
+						fractions[n] = sample.fraction;
+					}
+
+					// Image rows mixed across, as red blue and alpha green pairs. Kept for the next line, which will often want the same rows.
+					std::vector<uint32_t> rows[2] = {std::vector<uint32_t>(columns * 2),std::vector<uint32_t>(columns * 2)};
+					int rowsFrom[2] = {-1,-1};
+					auto mixRow = [&](int pRow,std::vector<uint32_t>& rMixed)
+					{
+						const uint8_t* source = pImage.GetPixelAddress(0,pRow);
+						uint32_t* mixed = rMixed.data();
+						for( int n = 0 ; n < columns ; n++, mixed += 2 )
+						{
+							uint32_t redBlue[2],alphaGreen[2];
+							ReadChannelPairs<SOURCE>(source + lefts[n],redBlue[0],alphaGreen[0]);
+							ReadChannelPairs<SOURCE>(source + rights[n],redBlue[1],alphaGreen[1]);
+							if( pPreMultiply )
+							{
+								PreMultiplyChannelPairs(redBlue[0],alphaGreen[0]);
+								PreMultiplyChannelPairs(redBlue[1],alphaGreen[1]);
+							}
+							mixed[0] = MixChannelPairs(redBlue[0],redBlue[1],fractions[n]);
+							mixed[1] = MixChannelPairs(alphaGreen[0],alphaGreen[1],fractions[n]);
+						}
+					};
+
+					for( int y = area.top ; y < area.bottom ; y++ )
+					{
+						const ScaledSample sample(y - pDest.top,destHeight,sourceHeight);
+						const int top = pSource.top + sample.first;
+						const int bottom = pSource.top + sample.second;
+						if( rowsFrom[0] != top )
+						{
+							if( rowsFrom[1] == top )
+							{
+								std::swap(rows[0],rows[1]);
+								std::swap(rowsFrom[0],rowsFrom[1]);
+							}
+							else
+							{
+								mixRow(top,rows[0]);
+								rowsFrom[0] = top;
+							}
+						}
+						if( rowsFrom[1] != bottom )
+						{
+							mixRow(bottom,rows[1]);
+							rowsFrom[1] = bottom;
+						}
+
+						uint8_t* dest = GetPixelAddress(area.left,y);
+						const uint32_t* upper = rows[0].data();
+						const uint32_t* lower = rows[1].data();
+						for( int n = 0 ; n < columns ; n++, dest += DEST::PIXEL_SIZE, upper += 2, lower += 2 )
+						{
+							const uint32_t rb = MixChannelPairs(upper[0],lower[0],sample.fraction);
+							const uint32_t ag = MixChannelPairs(upper[1],lower[1],sample.fraction);
+							pPutMixed(dest,(uint8_t)(rb >> 16),(uint8_t)ag,(uint8_t)rb,(uint8_t)(ag >> 16));
+						}
+					}
+				}
+			};
+
+			if( SOURCE::HAS_ALPHA && pBlend && pImage.mPreMultipliedAlpha )
+			{
+				auto put = [](uint8_t* pDest,uint8_t r,uint8_t g,uint8_t b,uint8_t a){BlendPreAlphaPixelFormat<DEST>(pDest,r,g,b,a);};
+				draw(put,put,std::false_type());
+			}
+			else if( SOURCE::HAS_ALPHA && pBlend )
+			{
+				// The mixed colours are already multiplied by alpha, so this is S + (D * (1 - A)), keeping the larger alpha as BlendPixelFormat does.
+				draw([](uint8_t* pDest,uint8_t r,uint8_t g,uint8_t b,uint8_t a){BlendPixelFormat<DEST>(pDest,r,g,b,a);},
+					[](uint8_t* pDest,uint8_t r,uint8_t g,uint8_t b,uint8_t a)
+					{
+						uint8_t destR,destG,destB,destA;
+						DEST::Unpack(DEST::Read(pDest),destR,destG,destB,destA);
+						const uint32_t inverse = 255 - a;
+						DEST::Write(pDest,DEST::Pack(
+							std::min<uint32_t>(255,r + Div255(destR * inverse)),
+							std::min<uint32_t>(255,g + Div255(destG * inverse)),
+							std::min<uint32_t>(255,b + Div255(destB * inverse)),
+							std::max(destA,a)));
+					},std::true_type());
+			}
+			else
+			{
+				auto put = [](uint8_t* pDest,uint8_t r,uint8_t g,uint8_t b,uint8_t a){DEST::Write(pDest,DEST::Pack(r,g,b,a));};
+				draw(put,put,std::false_type());
+			}
+		});
+	});
+}
+
+void DrawBuffer::DrawLineH(int pFromX,int pFromY,int pToX,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pFromY < mClip.top || pFromY >= mClip.bottom || pFromX == pToX )
+		return;
+
+	if( pFromX > pToX )
+		std::swap(pFromX,pToX);
+
+	pFromX = std::max(pFromX,mClip.left);
+	pToX = std::min(pToX,mClip.right - 1);
+	if( pFromX > pToX )
+		return;
+	Touched(Rect(pFromX,pFromY,pToX + 1,pFromY + 1));
+
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		FillRow<FORMAT>(GetPixelAddress(pFromX,pFromY),pToX - pFromX + 1,FORMAT::Pack(pRed,pGreen,pBlue,pAlpha));
+	});
+}
+
+void DrawBuffer::DrawLineV(int pFromX,int pFromY,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pFromX < mClip.left || pFromX >= mClip.right || pFromY == pToY )
+		return;
+
+	if( pFromY > pToY )
+		std::swap(pFromY,pToY);
+
+	pFromY = std::max(pFromY,mClip.top);
+	pToY = std::min(pToY,mClip.bottom - 1);
+	if( pFromY > pToY )
+		return;
+	Touched(Rect(pFromX,pFromY,pFromX + 1,pToY + 1));
+
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		FillColumn<FORMAT>(GetPixelAddress(pFromX,pFromY),mStride,pToY - pFromY + 1,FORMAT::Pack(pRed,pGreen,pBlue,pAlpha));
+	});
+}
+
+void DrawBuffer::DrawLine(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
+{
+	if( pFromX == pToX )
+		DrawLineV(pFromX,pFromY,pToY,pRed,pGreen,pBlue);
+	else if( pFromY == pToY )
+		DrawLineH(pFromX,pFromY,pToX,pRed,pGreen,pBlue);
+	else
+		DrawLineBresenham(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue);
+}
+
+void DrawBuffer::DrawLine(int pFromX,int pFromY,int pToX,int pToY,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
+{
+	// If one or less pixel width then draw normal line quickly.
+	if( pWidth < 2 )
+	{
+		DrawLine(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue);
+	}
+	else if( pFromX == pToX )
+	{
+		// Just do a box.
+		FillRectangle(pFromX - (pWidth/2),pFromY,pToX + (pWidth/2),pToY,pRed,pGreen,pBlue);
+	}
+	else if( pFromY == pToY )
+	{
+		FillRectangle(pFromX,pFromY - (pWidth/2),pToX,pToY + (pWidth/2),pRed,pGreen,pBlue);
+	}
+	else
+	{
+		// Do it the hard way, stamp a pWidth square at each point of the line.
+		const int offset = pWidth/2;
+		LineSteps line(pFromX - offset,pFromY - offset,pToX - offset,pToY - offset);
+
+		// Only stamps that reach into the clip rect are drawn, so clip the top left of the stamps to the clip rect grown up and left by pWidth - 1.
+		const Rect stampClip(mClip.left - pWidth + 1,mClip.top - pWidth + 1,mClip.right,mClip.bottom);
+		const int fromCode = GetOutCode(stampClip,line.x,line.y);
+		const int toCode = GetOutCode(stampClip,pToX - offset,pToY - offset);
+		if( (fromCode & toCode) != 0 )
+			return;
+
+		int64_t first = 0;
+		int64_t last = line.numpixels;
+		if( (fromCode | toCode) != 0 && !line.Clip(stampClip,first,last) )
+			return;
+		line.Skip(first);
+
+		Rect drawn;
+		DispatchPixelFormat(mFormat,[&](auto pFormat)
+		{
+			typedef decltype(pFormat) FORMAT;
+			const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,255);
+			for( int64_t n = first ; n <= last ; n++, line.Step() )
+			{
+				// Stamp a pWidth square, cropped to the clip rect so the parts of stamps hanging over the edge are drawn too.
+				const Rect stamp = Rect(line.x,line.y,line.x + pWidth,line.y + pWidth).Intersect(mClip);
+				for( int ly = stamp.top ; ly < stamp.bottom ; ly++ )
+				{
+					FillRow<FORMAT>(GetPixelAddress(stamp.left,ly),stamp.GetWidth(),pixel);
+				}
+				drawn = drawn.Union(stamp);
+			}
+		});
+		Touched(drawn);
+	}
+}
+
+void DrawBuffer::DrawLineList(const std::vector<std::array<int,2>>& pPoints,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
+{
+	for( size_t n = 0 ; n < pPoints.size() - 1 ; n++ )
+	{
+		DrawLine(pPoints[n][0],pPoints[n][1],pPoints[n+1][0],pPoints[n+1][1],pWidth,pRed,pGreen,pBlue);
+	}
+}
+
+void DrawBuffer::DrawLineAA(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	// The end columns are rounded to the nearest pixel, so the line can go up to half a pixel past the ends.
+	const Rect bounds((std::min(pFromX,pToX) >> FIXED_POINT_SHIFT) - 1,(std::min(pFromY,pToY) >> FIXED_POINT_SHIFT) - 1,
+						(std::max(pFromX,pToX) >> FIXED_POINT_SHIFT) + 3,(std::max(pFromY,pToY) >> FIXED_POINT_SHIFT) + 3);
+	if( bounds.Intersect(mClip).GetIsEmpty() )
+		return;
+	Touched(bounds.Intersect(mClip));
+
+	// Work along the major axis, u, one pixel at a time, with v the minor axis. For steep lines u is y.
+	const bool steep = std::abs(pToY - pFromY) > std::abs(pToX - pFromX);
+	if( steep )
+	{
+		std::swap(pFromX,pFromY);
+		std::swap(pToX,pToY);
+	}
+	if( pFromX > pToX )
+	{
+		std::swap(pFromX,pToX);
+		std::swap(pFromY,pToY);
+	}
+
+	// The slope and v are 16.16 so v can be stepped one pixel at a time without drifting.
+	const int64_t deltaU = pToX - pFromX;
+	const int64_t gradient = deltaU > 0 ? ((int64_t)(pToY - pFromY) * 65536) / deltaU : 0;
+	auto vAt = [&](int pU){return (int64_t)pFromY * 256 + ((gradient * ((int64_t)pU * FIXED_POINT_ONE - pFromX)) >> FIXED_POINT_SHIFT);};
+
+	const int uStart = (pFromX + (FIXED_POINT_ONE/2)) >> FIXED_POINT_SHIFT;
+	const int uEnd = (pToX + (FIXED_POINT_ONE/2)) >> FIXED_POINT_SHIFT;
+
+	// The part of the major axis that can be seen, the rest is skipped.
+	const int clipStart = steep ? mClip.top : mClip.left;
+	const int clipEnd = steep ? mClip.bottom : mClip.right;
+
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,255);
+
+		auto plot = [&](int pU,int pV,uint32_t pCoverage)
+		{
+			const int x = steep ? pV : pU;
+			const int y = steep ? pU : pV;
+			const uint32_t alpha = (pCoverage * pAlpha) >> 16;
+			if( alpha > 0 && mClip.GetContains(x,y) )
+			{
+				uint8_t* dst = GetPixelAddress(x,y);
+				if( alpha == 255 )
+					FORMAT::Write(dst,pixel);
+				else
+					BlendPixelFormat<FORMAT>(dst,pRed,pGreen,pBlue,alpha);
+			}
+		};
+
+		// The two pixels either side of the line in column pU, pGap is how much of the column the line covers. All out of 256.
+		auto plotColumn = [&](int pU,int64_t pV,uint32_t pGap)
+		{
+			const int v = (int)(pV >> 16);
+			const uint32_t fraction = (uint32_t)(pV >> 8) & 255;
+			plot(pU,v,(256 - fraction) * pGap);
+			plot(pU,v + 1,fraction * pGap);
+		};
+
+		if( uStart == uEnd )
+		{// All in one column, fade by the length.
+			plotColumn(uStart,vAt(uStart),(uint32_t)deltaU);
+			return;
+		}
+
+		// The ends are faded by how much of their pixel the line reaches.
+		plotColumn(uStart,vAt(uStart),FIXED_POINT_ONE - ((pFromX + (FIXED_POINT_ONE/2)) & (FIXED_POINT_ONE - 1)));
+		plotColumn(uEnd,vAt(uEnd),(pToX + (FIXED_POINT_ONE/2)) & (FIXED_POINT_ONE - 1));
+
+		const int from = std::max(uStart + 1,clipStart);
+		const int to = std::min(uEnd,clipEnd);
+		int64_t v = vAt(from);
+		for( int u = from ; u < to ; u++, v += gradient )
+		{
+			plotColumn(u,v,FIXED_POINT_ONE);
+		}
+	});
+}
+
+void DrawBuffer::DrawLineAA(int pFromX,int pFromY,int pToX,int pToY,int pWidth,LineCap pCap,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pWidth <= 0 )
+		return;
+
+	const float fromX = (float)pFromX / FIXED_POINT_ONE;
+	const float fromY = (float)pFromY / FIXED_POINT_ONE;
+	const float toX = (float)pToX / FIXED_POINT_ONE;
+	const float toY = (float)pToY / FIXED_POINT_ONE;
+	const float halfWidth = (float)pWidth / (FIXED_POINT_ONE * 2);
+
+	// The line as a rectangle, centre, direction along it and half sizes. With no length a butt ended line has nothing to draw.
+	const float centreX = (fromX + toX) * 0.5f;
+	const float centreY = (fromY + toY) * 0.5f;
+	const float length = sqrtf(((toX - fromX) * (toX - fromX)) + ((toY - fromY) * (toY - fromY)));
+	if( length < 1.0f / FIXED_POINT_ONE && pCap == LINE_CAP_BUTT )
+		return;
+	const float dirX = length > 0.0f ? (toX - fromX) / length : 1.0f;
+	const float dirY = length > 0.0f ? (toY - fromY) / length : 0.0f;
+	const float halfLength = length * 0.5f;
+	const float halfBoxLength = halfLength + (pCap == LINE_CAP_BUTT ? 0.0f : halfWidth);
+
+	// The box that holds the line and caps, a pixel bigger for the anti-aliased edge.
+	// And the box inside that every pixel is all covered, half a pixel in from the edges and not including round caps.
+	const RotatedBox outer(centreX,centreY,dirX,dirY,halfBoxLength + 1.0f,halfWidth + 1.0f);
+	const float innerHalfLength = pCap == LINE_CAP_ROUND ? halfLength : halfBoxLength - 0.5f;
+	const float innerHalfWidth = halfWidth - 0.5f;
+	const bool hasInner = innerHalfLength > 0.0f && innerHalfWidth > 0.0f;
+	const RotatedBox inner(centreX,centreY,dirX,dirY,innerHalfLength,innerHalfWidth);
+
+	const Rect area = Rect(
+		(int)floorf(*std::min_element(outer.mX,outer.mX + 4)),(int)floorf(*std::min_element(outer.mY,outer.mY + 4)),
+		(int)ceilf(*std::max_element(outer.mX,outer.mX + 4)) + 1,(int)ceilf(*std::max_element(outer.mY,outer.mY + 4)) + 1).Intersect(mClip);
+	if( area.GetIsEmpty() )
+		return;
+	Touched(area);
+
+	// How far outside the line the centre of a pixel is, negative inside. Round caps are the distance from the middle segment.
+	auto distance = [&](int pX,int pY)
+	{
+		const float px = pX - centreX;
+		const float py = pY - centreY;
+		const float along = fabsf((px * dirX) + (py * dirY));
+		const float across = fabsf((py * dirX) - (px * dirY));
+		if( pCap == LINE_CAP_ROUND && along > halfLength )
+		{
+			const float outside = along - halfLength;
+			return sqrtf((outside * outside) + (across * across)) - halfWidth;
+		}
+		if( pCap == LINE_CAP_ROUND )
+		{
+			return across - halfWidth;
+		}
+		const float outsideAlong = along - halfBoxLength;
+		const float outsideAcross = across - halfWidth;
+		if( outsideAlong <= 0.0f || outsideAcross <= 0.0f )
+			return std::max(outsideAlong,outsideAcross);
+		return sqrtf((outsideAlong * outsideAlong) + (outsideAcross * outsideAcross));
+	};
+
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,255);
+		// The edge pixels, how much of each is covered is worked out from how far they are from the line.
+		auto drawEdge = [&](int pFromX,int pToX,int pY)
+		{
+			uint8_t* dst = GetPixelAddress(pFromX,pY);
+			for( int x = pFromX ; x < pToX ; x++, dst += FORMAT::PIXEL_SIZE )
+			{
+				// Half a pixel either side of the edge is blended, very close to the area covered for straight edges.
+				const float coverage = 0.5f - distance(x,pY);
+				if( coverage <= 0.0f )
+					continue;
+
+				const uint32_t alpha = Div255((uint32_t)(std::min(coverage,1.0f) * 255.0f + 0.5f) * pAlpha);
+				if( alpha == 255 )
+					FORMAT::Write(dst,pixel);
+				else if( alpha > 0 )
+					BlendPixelFormat<FORMAT>(dst,pRed,pGreen,pBlue,alpha);
+			}
+		};
+
+		for( int y = area.top ; y < area.bottom ; y++ )
+		{
+			float left,right;
+			if( !outer.GetRowSpan(y - 0.5f,y + 0.5f,left,right) )
+				continue;
+			const int fromX = std::max(area.left,(int)floorf(left));
+			const int toX = std::min(area.right,(int)ceilf(right) + 1);
+
+			// Pixels well inside the inner box are solid, so skip working out their coverage.
+			int solidFromX = toX, solidToX = toX;
+			if( hasInner && inner.GetRowSpan((float)y,(float)y,left,right) )
+			{
+				solidFromX = std::min(std::max(fromX,(int)ceilf(left + 0.01f)),toX);
+				solidToX = std::max(std::min(toX,(int)floorf(right - 0.01f) + 1),solidFromX);
+			}
+
+			drawEdge(fromX,solidFromX,y);
+			if( pAlpha == 255 )
+			{
+				FillRow<FORMAT>(GetPixelAddress(solidFromX,y),solidToX - solidFromX,pixel);
+			}
+			else
+			{
+				uint8_t* dst = GetPixelAddress(solidFromX,y);
+				for( int x = solidFromX ; x < solidToX ; x++, dst += FORMAT::PIXEL_SIZE )
+				{
+					BlendPixelFormat<FORMAT>(dst,pRed,pGreen,pBlue,pAlpha);
+				}
+			}
+			drawEdge(solidToX,toX,y);
+		}
+	});
+}
+
+void DrawBuffer::DrawCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,pAlpha);
+
+		// Only test each point against the clip rect if the circle is not all inside it.
+		const Rect bounds(pCenterX - pRadius,pCenterY - pRadius,pCenterX + pRadius + 1,pCenterY + pRadius + 1);
+		Touched(bounds.Intersect(mClip));
+		DispatchClipped(mClip,bounds,[&](auto pClipped)
+		{
+			typedef decltype(pClipped) CLIPPED;
+
+			int x = pRadius-1;
+			int y = 0;
+			int dx = 1;
+			int dy = 1;
+			int err = dx - (pRadius << 1);
+
+			while (x >= y)
+			{
+				PlotPixel<FORMAT,CLIPPED>(*this,pCenterX + x, pCenterY + y,pixel);
+				PlotPixel<FORMAT,CLIPPED>(*this,pCenterX + y, pCenterY + x,pixel);
+				PlotPixel<FORMAT,CLIPPED>(*this,pCenterX - y, pCenterY + x,pixel);
+				PlotPixel<FORMAT,CLIPPED>(*this,pCenterX - x, pCenterY + y,pixel);
+				PlotPixel<FORMAT,CLIPPED>(*this,pCenterX - x, pCenterY - y,pixel);
+				PlotPixel<FORMAT,CLIPPED>(*this,pCenterX - y, pCenterY - x,pixel);
+				PlotPixel<FORMAT,CLIPPED>(*this,pCenterX + y, pCenterY - x,pixel);
+				PlotPixel<FORMAT,CLIPPED>(*this,pCenterX + x, pCenterY - y,pixel);
+
+				if (err <= 0)
+				{
+					y++;
+					err += dy;
+					dy += 2;
+				}
+				if (err > 0)
+				{
+					x--;
+					dx += 2;
+					err += dx - (pRadius << 1);
+				}
+			}
+		});
+	});
+}
+
+void DrawBuffer::FillCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	FillEllipse(pCenterX,pCenterY,pRadius,pRadius,pRed,pGreen,pBlue,pAlpha);
+}
+
+void DrawBuffer::FillCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode)
+{
+	FillEllipse(pCenterX,pCenterY,pRadius,pRadius,pRed,pGreen,pBlue,pAlpha,pMode);
+}
+
+void DrawBuffer::DrawEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pRadiusX < 1 || pRadiusY < 1 )
+		return;
+
+	const EllipseArcShape shape = MakeEllipseShape(pCenterX,pCenterY,pRadiusX,pRadiusY,1);
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillEllipseArc<decltype(pFormat)>(*this,shape,false,pRed,pGreen,pBlue,pAlpha);
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pRadiusX < 1 || pRadiusY < 1 )
+		return;
+
+	const EllipseArcShape shape = MakeEllipseShape(pCenterX,pCenterY,pRadiusX,pRadiusY,0);
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillEllipseArc<decltype(pFormat)>(*this,shape,false,pRed,pGreen,pBlue,pAlpha);
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode)
+{
+	if( pRadiusX < 1 || pRadiusY < 1 )
+		return;
+
+	const EllipseArcShape shape = MakeEllipseShape(pCenterX,pCenterY,pRadiusX,pRadiusY,0);
+	const Rect area = shape.GetBounds(0.0f).Intersect(mClip);
+	if( area.GetIsEmpty() )
+		return;
+	Touched(area);
+
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		DispatchBlendModeFill<decltype(pFormat)>(pMode,pRed,pGreen,pBlue,pAlpha,[&](const auto& pFillRow)
+		{
+			ForEllipseArcRuns(shape,area,[&](int pFromX,int pToX,int pY)
+			{
+				pFillRow(GetPixelAddress(pFromX,pY),pToX - pFromX);
+			});
+		});
+	});
+}
+
+void DrawBuffer::DrawArc(int pCenterX,int pCenterY,int pRadius,int pWidth,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	EllipseArcShape shape = MakeEllipseShape(pCenterX,pCenterY,pRadius,pRadius,pWidth);
+	if( pRadius < 1 || pWidth < 1 || !shape.SetWedge(pFromAngle,pToAngle) )
+		return;
+
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillEllipseArc<decltype(pFormat)>(*this,shape,false,pRed,pGreen,pBlue,pAlpha);
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillArc(int pCenterX,int pCenterY,int pRadius,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	EllipseArcShape shape = MakeEllipseShape(pCenterX,pCenterY,pRadius,pRadius,0);
+	if( pRadius < 1 || !shape.SetWedge(pFromAngle,pToAngle) )
+		return;
+
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillEllipseArc<decltype(pFormat)>(*this,shape,false,pRed,pGreen,pBlue,pAlpha);
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::DrawEllipseAA(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pRadiusX <= 0 || pRadiusY <= 0 || pWidth <= 0 )
+		return;
+
+	const EllipseArcShape shape = MakeEllipseShapeAA(pCenterX,pCenterY,pRadiusX,pRadiusY,pWidth);
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillEllipseArc<decltype(pFormat)>(*this,shape,true,pRed,pGreen,pBlue,pAlpha);
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillEllipseAA(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pRadiusX <= 0 || pRadiusY <= 0 )
+		return;
+
+	const EllipseArcShape shape = MakeEllipseShapeAA(pCenterX,pCenterY,pRadiusX,pRadiusY,0);
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillEllipseArc<decltype(pFormat)>(*this,shape,true,pRed,pGreen,pBlue,pAlpha);
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::DrawArcAA(int pCenterX,int pCenterY,int pRadius,int pWidth,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	EllipseArcShape shape = MakeEllipseShapeAA(pCenterX,pCenterY,pRadius,pRadius,pWidth);
+	if( pRadius <= 0 || pWidth <= 0 || !shape.SetWedge(pFromAngle,pToAngle) )
+		return;
+
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillEllipseArc<decltype(pFormat)>(*this,shape,true,pRed,pGreen,pBlue,pAlpha);
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillArcAA(int pCenterX,int pCenterY,int pRadius,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	EllipseArcShape shape = MakeEllipseShapeAA(pCenterX,pCenterY,pRadius,pRadius,0);
+	if( pRadius <= 0 || !shape.SetWedge(pFromAngle,pToAngle) )
+		return;
+
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillEllipseArc<decltype(pFormat)>(*this,shape,true,pRed,pGreen,pBlue,pAlpha);
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::DrawRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	DrawLineH(pFromX,pFromY,pToX,pRed,pGreen,pBlue,pAlpha);
+	DrawLineH(pFromX,pToY,pToX,pRed,pGreen,pBlue,pAlpha);
+
+	DrawLineV(pFromX,pFromY,pToY,pRed,pGreen,pBlue,pAlpha);
+	DrawLineV(pToX,pFromY,pToY,pRed,pGreen,pBlue,pAlpha);
+}
+
+/**
+ * @brief The pixels FillRectangle fills, the to values are inclusive and can be either side of the from values.
+ */
+static Rect GetFillRectangleArea(int pFromX,int pFromY,int pToX,int pToY,const Rect& pClip)
+{
+	if( pFromX == pToX || pFromY == pToY )
+		return Rect();
+
+	if( pFromY > pToY )
+		std::swap(pFromY,pToY);
+
+	if( pFromX > pToX )
+		std::swap(pFromX,pToX);
+
+	return Rect(pFromX,pFromY,pToX + 1,pToY + 1).Intersect(pClip);
+}
+
+void DrawBuffer::FillRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect area = GetFillRectangleArea(pFromX,pFromY,pToX,pToY,mClip);
+	if( area.GetIsEmpty() )
+		return;
+	Touched(area);
+
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		FillArea<FORMAT>(*this,area,FORMAT::Pack(pRed,pGreen,pBlue,pAlpha));
+	});
+}
+
+void DrawBuffer::FillRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode)
+{
+	const Rect area = GetFillRectangleArea(pFromX,pFromY,pToX,pToY,mClip);
+	if( area.GetIsEmpty() )
+		return;
+	Touched(area);
+
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		DispatchBlendModeFill<decltype(pFormat)>(pMode,pRed,pGreen,pBlue,pAlpha,[&](const auto& pFillRow)
+		{
+			ForRows(GetJobSystem(),area,[&](int pFromY,int pToY)
+			{
+				for( int y = pFromY ; y < pToY ; y++ )
+				{
+					pFillRow(GetPixelAddress(area.left,y),area.GetWidth());
+				}
+			});
+		});
+	});
+}
+
+
+void DrawBuffer::FillTriangle(int pX0,int pY0,int pX1,int pY1,int pX2,int pY2,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const std::array<int,2> points[3] = {{pX0,pY0},{pX1,pY1},{pX2,pY2}};
+	std::vector<PolygonEdge> edges;
+	edges.reserve(3);
+	AddPolygonEdges(edges,points,3);
+
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		drawn = FillPolygonEdges<FORMAT>(*this,edges,FILL_RULE_NON_ZERO,true,FORMAT::Pack(pRed,pGreen,pBlue,pAlpha));
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillConvexPolygon(const std::vector<std::array<int,2>>& pPoints,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	std::vector<PolygonEdge> edges;
+	edges.reserve(pPoints.size());
+	AddPolygonEdges(edges,pPoints.data(),pPoints.size());
+
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		drawn = FillPolygonEdges<FORMAT>(*this,edges,FILL_RULE_NON_ZERO,true,FORMAT::Pack(pRed,pGreen,pBlue,pAlpha));
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillPolygon(const std::vector<std::array<int,2>>& pPoints,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	std::vector<PolygonEdge> edges;
+	edges.reserve(pPoints.size());
+	AddPolygonEdges(edges,pPoints.data(),pPoints.size());
+
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		drawn = FillPolygonEdges<FORMAT>(*this,edges,pRule,false,FORMAT::Pack(pRed,pGreen,pBlue,pAlpha));
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillPolygon(const std::vector<std::vector<std::array<int,2>>>& pOutlines,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	std::vector<PolygonEdge> edges;
+	for( const auto& outline : pOutlines )
+	{
+		AddPolygonEdges(edges,outline.data(),outline.size());
+	}
+
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		drawn = FillPolygonEdges<FORMAT>(*this,edges,pRule,false,FORMAT::Pack(pRed,pGreen,pBlue,pAlpha));
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillPath(const Path& pPath,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillPathCoverage<decltype(pFormat)>(*this,pPath,pRule,[&](int,int,uint8_t& rRed,uint8_t& rGreen,uint8_t& rBlue,uint8_t& rAlpha)
+		{
+			rRed = pRed;
+			rGreen = pGreen;
+			rBlue = pBlue;
+			rAlpha = pAlpha;
+		});
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillPath(const Path& pPath,FillRule pRule,const LinearGradient& pPaint)
+{
+	// The colours along the gradient, then each pixel looks up how far along it is.
+	uint8_t colours[256][4];
+	for( uint32_t n = 0 ; n < 256 ; n++ )
+	{
+		for( int c = 0 ; c < 4 ; c++ )
+		{
+			colours[n][c] = (uint8_t)Div255((pPaint.fromRGBA[c] * (255 - n)) + (pPaint.toRGBA[c] * n));
+		}
+	}
+
+	const float dx = pPaint.toX - pPaint.fromX;
+	const float dy = pPaint.toY - pPaint.fromY;
+	const float lengthSquared = (dx * dx) + (dy * dy);
+	const float scale = lengthSquared > 0.0f ? 255.0f / lengthSquared : 0.0f;
+
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillPathCoverage<decltype(pFormat)>(*this,pPath,pRule,[&](int pX,int pY,uint8_t& rRed,uint8_t& rGreen,uint8_t& rBlue,uint8_t& rAlpha)
+		{
+			const float along = (((pX - pPaint.fromX) * dx) + ((pY - pPaint.fromY) * dy)) * scale;
+			const uint8_t* colour = colours[(int)std::min(std::max(along + 0.5f,0.0f),255.0f)];
+			rRed = colour[0];
+			rGreen = colour[1];
+			rBlue = colour[2];
+			rAlpha = colour[3];
+		});
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::DrawRoundedRectangle(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pRadius < 1 )
+	{
+		DrawRectangle(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue,pAlpha);
+		return;
+	}
+
+	if( pFromY == pToY )
+		return;
+
+	if( pFromY > pToY )
+		std::swap(pFromY,pToY);
+
+	if( pFromX == pToX )
+		return;
+	
+	if( pFromX > pToX )
+		std::swap(pFromX,pToX);
+
+	if( pRadius > pToX - pFromX && pRadius > pToY - pFromY )
+	{
+		pRadius = (pToX - pFromX) / 2;
+		DrawCircle( (pFromX + pToX) / 2 , (pFromY + pToY) / 2 ,pRadius,pRed,pGreen,pBlue,pAlpha);
+		return;
+	}
+	else if( pRadius*2 > pToX - pFromX )
+	{
+		pRadius = (pToX - pFromX) / 2;
+	}
+	else if( pRadius*2 > pToY - pFromY )
+	{
+		pRadius = (pToY - pFromY) / 2;
+	}
+
+	// Values I need so that the quadrants are positioned in the corners of the rectangle.
+	const int left = pFromX + pRadius; 
+	const int right = pToX - pRadius;
+	const int top = pFromY + pRadius;
+	const int bottom = pToY - pRadius;
+
+	// The radius is only reduced to fit one side, so on a thin rectangle the corners can cross over and reach outside it.
+	const Rect corners(left - pRadius,std::min(top,bottom) - pRadius,right + pRadius + 1,std::max(top,bottom) + pRadius + 1);
+	const Rect area = Rect(pFromX,pFromY,pToX + 1,pToY + 1).Union(corners).Intersect(mClip);
+	if( area.GetIsEmpty() )
+		return;
+	Touched(area);
+
+	const std::shared_ptr<const RoundedCorner> corner = pRadius > 0 ? GetRoundedCorner(pRadius) : nullptr;	// Very thin ones have no corners.
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,pAlpha);
+		auto drawRun = [&](int pFromX,int pToX,int pY)	// pToX is inclusive, as with DrawLineH.
+		{
+			pFromX = std::max(pFromX,area.left);
+			pToX = std::min(pToX + 1,area.right);
+			if( pFromX < pToX )
+				FillRow<FORMAT>(GetPixelAddress(pFromX,pY),pToX - pFromX,pixel);
+		};
+
+		// The pixels that overlap are all set to the same value, so where they do on a thin rectangle does not matter.
+		for( int y = area.top ; y < area.bottom ; y++ )
+		{
+			for( const int row : {top - y,y - bottom} )
+			{
+				if( row >= 0 && row < pRadius )
+				{
+					drawRun(left - corner->mMidpointTo[row],left - corner->mMidpointFrom[row],y);
+					drawRun(right + corner->mMidpointFrom[row],right + corner->mMidpointTo[row],y);
+				}
+			}
+
+			if( y == pFromY || y == pToY )
+			{
+				drawRun(left,right,y);
+			}
+
+			if( y >= std::min(top,bottom) && y <= std::max(top,bottom) )
+			{
+				drawRun(pFromX,pFromX,y);
+				drawRun(pToX,pToX,y);
+			}
+		}
+	});
+}
+
+void DrawBuffer::FillRoundedRectangle(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pRadius < 1 )
+	{
+		FillRectangle(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue,pAlpha);
+		return;
+	}
+
+	if( pFromY == pToY )
+		return;
+
+	if( pFromY > pToY )
+		std::swap(pFromY,pToY);
+
+	if( pFromX == pToX )
+		return;
+	
+	if( pFromX > pToX )
+		std::swap(pFromX,pToX);
+
+	if( pRadius > pToX - pFromX && pRadius > pToY - pFromY )
+	{
+		pRadius = (pToX - pFromX) / 2;
 		FillCircle( (pFromX + pToX) / 2 , (pFromY + pToY) / 2 ,pRadius,pRed,pGreen,pBlue,pAlpha);
 		return;
 	}
-	else if( pRadius*2 > pToX - pFromX )
+	else if( pRadius*2 > pToX - pFromX )
+	{
+		pRadius = (pToX - pFromX) / 2;
+	}
+	else if( pRadius*2 > pToY - pFromY )
+	{
+		pRadius = (pToY - pFromY) / 2;
+	}
+
+	// Values I need so that the quadrants are positioned in the corners of the rectangle.
+	const int left = pFromX + pRadius; 
+	const int right = pToX - pRadius;
+	const int top = pFromY + pRadius;
+	const int bottom = pToY - pRadius;
+
+	const Rect area = Rect(pFromX,std::min(top,bottom) - pRadius,pToX + 1,std::max(top,bottom) + pRadius + 1).Intersect(mClip);
+	if( area.GetIsEmpty() )
+		return;
+	Touched(area);
+
+	const std::shared_ptr<const RoundedCorner> corner = pRadius > 0 ? GetRoundedCorner(pRadius) : nullptr;	// Very thin ones have no corners.
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,pAlpha);
+		for( int y = area.top ; y < area.bottom ; y++ )
+		{
+			// Each row is one span, as wide as the widest of the middle and the corners it is in. Only a thin rectangle's rows are in both corners.
+			int out = -1;
+			if( y >= std::min(top,bottom) && y <= std::max(top,bottom) )
+				out = pRadius;
+
+			for( const int row : {top - y,y - bottom} )
+			{
+				if( row >= 0 && row < pRadius )
+					out = std::max(out,corner->mMidpointTo[row]);
+			}
+
+			if( out >= 0 )
+			{
+				const int from = std::max(left - out,area.left);
+				const int to = std::min(right + out + 1,area.right);
+				if( from < to )
+					FillRow<FORMAT>(GetPixelAddress(from,y),to - from,pixel);
+			}
+		}
+	});
+}
+
+void DrawBuffer::DrawRoundedRectangleAA(int pFromX,int pFromY,int pToX,int pToY,int pRadius,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pWidth < 1 )
+		return;
+
+	if( pFromY > pToY )
+		std::swap(pFromY,pToY);
+
+	if( pFromX > pToX )
+		std::swap(pFromX,pToX);
+
+	// The hole is the same shape in by pWidth, its corners share their centre with the outside ones.
+	const RoundedRectRows shape(pFromX,pFromY,pToX + 1,pToY + 1,pRadius);
+	const RoundedRectRows hole(pFromX + pWidth,pFromY + pWidth,pToX + 1 - pWidth,pToY + 1 - pWidth,shape.mRadius - pWidth);
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillRoundedRectangleRows<decltype(pFormat)>(*this,shape,hole.GetIsEmpty() ? nullptr : &hole,pRed,pGreen,pBlue,pAlpha);
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillRoundedRectangleAA(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pFromY > pToY )
+		std::swap(pFromY,pToY);
+
+	if( pFromX > pToX )
+		std::swap(pFromX,pToX);
+
+	const RoundedRectRows shape(pFromX,pFromY,pToX + 1,pToY + 1,pRadius);
+	Rect drawn;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		drawn = FillRoundedRectangleRows<decltype(pFormat)>(*this,shape,nullptr,pRed,pGreen,pBlue,pAlpha);
+	});
+	Touched(drawn);
+}
+
+void DrawBuffer::FillCheckerBoard(int pX,int pY,int pXCount,int pYCount,int pXSize,int pYSize,const uint8_t pRGBA[2][4])
+{
+	const int width = pXSize-1;
+	const int height = pYSize-1;
+
+	for( int y = 0 ; y < pYCount ; y++, pY += pYSize )
+	{
+		int px = pX;
+		for( int x = 0 ; x < pXCount ; x++, px += pXSize )
+		{
+			if( (x&1) == (y&1) )
+				FillRectangle(px,pY,px+width,pY+height,pRGBA[0][0],pRGBA[0][1],pRGBA[0][2],pRGBA[0][3]);
+			else
+				FillRectangle(px,pY,px+width,pY+height,pRGBA[1][0],pRGBA[1][1],pRGBA[1][2],pRGBA[1][3]);
+		}
+	}
+}
+
+void DrawBuffer::FillCheckerBoard(int pX,int pY,int pXCount,int pYCount,int pXSize,int pYSize,uint8_t pA,uint8_t pB)
+{
+	const uint8_t RGBA[2][4] = {{pA,pA,pA,255},{pB,pB,pB,255}};
+	FillCheckerBoard(pX, pY, pXCount, pYCount, pXSize, pYSize,RGBA);
+}
+
+void DrawBuffer::FillCheckerBoard(int pXSize,int pYSize,const uint8_t pRGBA[2][4])
+{
+	FillCheckerBoard(0,0,(mWidth+pXSize-1) / pXSize,(mHeight+pYSize+1) / pYSize,pXSize,pYSize,pRGBA);
+}
+
+void DrawBuffer::FillCheckerBoard(int pXSize,int pYSize,uint8_t pA,uint8_t pB)
+{
+	const uint8_t RGBA[2][4] = {{pA,pA,pA,255},{pB,pB,pB,255}};
+	FillCheckerBoard(pXSize, pYSize,RGBA);
+}
+
+void DrawBuffer::DrawGradient(int pFromX,int pFromY,int pToX,int pToY,uint8_t pFormRed,uint8_t pFormGreen,uint8_t pFormBlue,uint8_t pToRed,uint8_t pToGreen,uint8_t pToBlue)
+{
+	// Do some early outs.
+	if( pFromY == pToY || pFromX == pToX )
+		return;
+
+	// Make sure X is in the right direction.
+	if( pFromX > pToX )
+	{
+		std::swap(pFromX,pToX);
+	}
+
+	float a,s;
+
+	// See if we need to flip the direction of the gradient if they are drawing up instead of down.
+	if( pFromY > pToY )
+	{
+		std::swap(pFromY,pToY);
+		a = 1.0f;
+		s = -1.0f / (float)(pToY - pFromY);
+	}
+	else
+	{
+		a = 0.0f;
+		s = 1.0f / (float)(pToY - pFromY);
+	}
+
+	const float fR = (float)pFormRed / 255.0f;
+	const float fG = (float)pFormGreen / 255.0f;
+	const float fB = (float)pFormBlue / 255.0f;
+
+	const float tR = (float)pToRed / 255.0f;
+	const float tG = (float)pToGreen / 255.0f;
+	const float tB = (float)pToBlue / 255.0f;
+
+	for( int y = pFromY ; y <= pToY ; y++, a += s )
+	{
+		const float invA = 1.0f - a;
+		const uint8_t r = (uint8_t)( ((fR * invA) + (tR * a) ) * 255.0f);
+		const uint8_t g = (uint8_t)( ((fG * invA) + (tG * a) ) * 255.0f);
+		const uint8_t b = (uint8_t)( ((fB * invA) + (tB * a) ) * 255.0f);
+
+		DrawLineH(pFromX,y,pToX,r,g,b);
+	}
+}
+
+void DrawBuffer::ScrollBuffer(int pXDirection,int pYDirection,int8_t pRedFill,uint8_t pGreenFill,uint8_t pBlueFill,uint8_t pAlphaFill)
+{
+	// Scrolls what is in the clip rect, with nothing pushed that is the whole buffer.
+	const Rect& area = mClip;
+	const int numLines = area.GetHeight() - std::abs(pYDirection);
+	const int numBytes = (area.GetWidth() - (std::abs(pXDirection))) * mPixelSize;
+
+	if( numLines > 0 && numBytes > 0 )
+	{
+		const int srcX = area.left + (pXDirection < 0 ? -pXDirection : 0);
+		const int dstX = area.left + (pXDirection > 0 ? pXDirection : 0);
+
+		// When moving down start at the bottom, so lines are moved before they are written over. memmove as left and right overlap.
+		for( int n = 0 ; n < numLines ; n++ )
+		{
+			const int y = pYDirection >= 0 ? area.bottom - 1 - n : area.top + n;
+			const uint8_t* src = GetPixelAddress(srcX,y - pYDirection);
+			uint8_t* dst = GetPixelAddress(dstX,y);
+
+			AssertPixelIsInBuffer(src);
+			AssertPixelIsInBuffer(dst);
+
+			memmove(dst,src,numBytes);
+		}
+		Touched(area);
+	}
+
+	// Now fill in the area that has just been exposed.
+
+	if( pYDirection > 0 )
+	{
+		FillRectangle(area.left,area.top,area.right,area.top + pYDirection,pRedFill,pGreenFill,pBlueFill,pAlphaFill);
+	}
+	else if( pYDirection < 0 )
+	{
+		FillRectangle(area.left,area.bottom + pYDirection,area.right,area.bottom,pRedFill,pGreenFill,pBlueFill,pAlphaFill);
+	}
+
+	if( pXDirection > 0 )
+	{
+		FillRectangle(area.left,area.top,area.left + pXDirection,area.bottom,pRedFill,pGreenFill,pGreenFill,pAlphaFill);
+	}
+	else if( pXDirection < 0 )
+	{
+		FillRectangle(area.right + pXDirection,area.top,area.right,area.bottom,		pRedFill,pGreenFill,pBlueFill,pAlphaFill);
+	}
+
+}
+
+void DrawBuffer::PreMultiplyAlpha()
+{
+	assert( mPreMultipliedAlpha == false ); // Can't do this more than once!
+	assert( mFormat == PIXEL_FORMAT_BGRA8888 ); // Has to have alpha data, in four bytes!
+
+	mPreMultipliedAlpha = true;
+	Touched(Rect(0,0,mWidth,mHeight));
+	for( int y = 0 ; y < mHeight ; y++ )
+	{// By the row, the stride may have padding that is not pixels.
+		uint8_t* pixel = GetPixelAddress(0,y);
+		for( int x = 0 ; x < mWidth ; x++, pixel += 4 )
+		{
+			AssertPixelIsInBuffer(pixel);
+
+			const uint32_t A = pixel[3];
+
+			pixel[0] = (uint8_t)Div255(pixel[0] * A);
+			pixel[1] = (uint8_t)Div255(pixel[1] * A);
+			pixel[2] = (uint8_t)Div255(pixel[2] * A);
+			pixel[3] = 255 - A;
+		}
+	}
+	UpdateOpacityTiles();
+}
+
+void DrawBuffer::UpdateOpacityTiles()
+{
+	const int columns = (mWidth + OPACITY_TILE_SIZE - 1) / OPACITY_TILE_SIZE;
+	const int rows = (mHeight + OPACITY_TILE_SIZE - 1) / OPACITY_TILE_SIZE;
+	if( mOpacityTiles.size() != (size_t)(columns * rows) )
+		mOpacityTiles.assign(columns * rows,TILE_UNKNOWN);
+
+	// Pre multiplied alpha is stored inverted, and a see through pixel must have no colour to add.
+	const uint8_t solidAlpha = mPreMultipliedAlpha ? 0 : 255;
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		for( int row = 0 ; row < rows ; row++ )
+		{
+			for( int column = 0 ; column < columns ; column++ )
+			{
+				TileOpacity& tile = mOpacityTiles[(row * columns) + column];
+				if( tile != TILE_UNKNOWN )
+					continue;
+
+				bool solid = true;
+				bool seeThrough = FORMAT::HAS_ALPHA;
+				const int right = std::min((column + 1) * OPACITY_TILE_SIZE,mWidth);
+				const int bottom = std::min((row + 1) * OPACITY_TILE_SIZE,mHeight);
+				for( int y = row * OPACITY_TILE_SIZE ; y < bottom && (solid || seeThrough) ; y++ )
+				{
+					const uint8_t* pixel = GetPixelAddress(column * OPACITY_TILE_SIZE,y);
+					for( int x = column * OPACITY_TILE_SIZE ; x < right ; x++, pixel += FORMAT::PIXEL_SIZE )
+					{
+						uint8_t r,g,b,a;
+						FORMAT::Unpack(FORMAT::Read(pixel),r,g,b,a);
+						solid = solid && a == solidAlpha;
+						seeThrough = seeThrough && (mPreMultipliedAlpha ? (a == 255 && (r | g | b) == 0) : a == 0);
+					}
+				}
+				tile = solid ? TILE_SOLID : (seeThrough ? TILE_SEE_THROUGH : TILE_MIXED);
+			}
+		}
+	});
+}
+
+void DrawBuffer::ForgetOpacityTiles(const Rect& pRect)
+{
+	const Rect area = pRect.Intersect(Rect(0,0,mWidth,mHeight));
+	if( mOpacityTiles.empty() || area.GetIsEmpty() )
+		return;
+
+	const int columns = (mWidth + OPACITY_TILE_SIZE - 1) / OPACITY_TILE_SIZE;
+	const int left = area.left / OPACITY_TILE_SIZE;
+	const int right = ((area.right - 1) / OPACITY_TILE_SIZE) + 1;
+	for( int row = area.top / OPACITY_TILE_SIZE ; row <= (area.bottom - 1) / OPACITY_TILE_SIZE ; row++ )
+	{
+		std::fill(mOpacityTiles.begin() + (row * columns) + left,mOpacityTiles.begin() + (row * columns) + right,TILE_UNKNOWN);
+	}
+}
+
+
+void DrawBuffer::DrawLineBresenham(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
+{
+	LineSteps line(pFromX,pFromY,pToX,pToY);
+
+	// Cohen Sutherland, both ends inside draws it all and both past the same side draws nothing.
+	// Else the steps that are inside are worked out so the pixels drawn are exactly the ones the whole line would have drawn.
+	const int fromCode = GetOutCode(mClip,pFromX,pFromY);
+	const int toCode = GetOutCode(mClip,pToX,pToY);
+	if( (fromCode & toCode) != 0 )
+		return;
+
+	int64_t first = 0;
+	int64_t last = line.numpixels;
+	if( (fromCode | toCode) != 0 && !line.Clip(mClip,first,last) )
+		return;
+	line.Skip(first);
+
+	const int startX = line.x;
+	const int startY = line.y;
+
+	DispatchPixelFormat(mFormat,[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,255);
+		const ptrdiff_t majorStep = (line.xinc2 * (ptrdiff_t)FORMAT::PIXEL_SIZE) + (line.yinc2 * mStride);
+		const ptrdiff_t minorStep = (line.xinc1 * (ptrdiff_t)FORMAT::PIXEL_SIZE) + (line.yinc1 * mStride);
+
+		uint8_t* dst = GetPixelAddress(line.x,line.y);
+		AssertPixelIsInBuffer(dst);
+		const int64_t den = line.den;
+		const int64_t numadd = line.numadd;
+		int64_t num = line.num;
+		for( int64_t n = first ; n <= last ; n++ )
+		{
+			FORMAT::Write(dst,pixel);
+
+			num += numadd;
+			if( num >= den )
+			{
+				num -= den;
+				dst += minorStep;
+			}
+			dst += majorStep;
+		}
+	});
+
+	line.Skip(last - first);
+	Touched(Rect(std::min(startX,line.x),std::min(startY,line.y),std::max(startX,line.x) + 1,std::max(startY,line.y) + 1));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Matrix Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+Matrix& Matrix::Rotate(float pDegrees)
+{
+	// Exact for the quarter turns, so turning an image by them lands on whole pixels.
+	float cosine,sine;
+	const float turns = pDegrees / 90.0f;
+	if( turns == floorf(turns) )
+	{
+		static const float quarters[4][2] = {{1.0f,0.0f},{0.0f,1.0f},{-1.0f,0.0f},{0.0f,-1.0f}};
+		const int quarter = (((int)fmodf(turns,4.0f)) + 4) % 4;
+		cosine = quarters[quarter][0];
+		sine = quarters[quarter][1];
+	}
+	else
+	{
+		const float radians = pDegrees * (float)(M_PI / 180.0);
+		cosine = cosf(radians);
+		sine = sinf(radians);
+	}
+	return Then(Matrix(cosine,sine,-sine,cosine,0.0f,0.0f));
+}
+
+Matrix& Matrix::Then(const Matrix& pThen)
+{
+	*this = Matrix(
+		(pThen.a * a) + (pThen.c * b),
+		(pThen.b * a) + (pThen.d * b),
+		(pThen.a * c) + (pThen.c * d),
+		(pThen.b * c) + (pThen.d * d),
+		(pThen.a * tx) + (pThen.c * ty) + pThen.tx,
+		(pThen.b * tx) + (pThen.d * ty) + pThen.ty);
+	return *this;
+}
+
+Matrix Matrix::GetInverse()const
+{
+	const double determinant = ((double)a * d) - ((double)b * c);
+	if( determinant == 0.0 )
+		return Matrix(0.0f,0.0f,0.0f,0.0f,0.0f,0.0f);
+
+	const double scale = 1.0 / determinant;
+	return Matrix(
+		(float)(d * scale),
+		(float)(-b * scale),
+		(float)(-c * scale),
+		(float)(a * scale),
+		(float)((((double)c * ty) - ((double)d * tx)) * scale),
+		(float)((((double)b * tx) - ((double)a * ty)) * scale));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Path Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+Path& Path::MoveTo(float pX,float pY)
+{
+	// A point on its own fills nothing, so just move it.
+	if( mOutlines.empty() || mOutlines.back().size() > 1 )
+		mOutlines.emplace_back();
+	else
+		mOutlines.back().clear();
+
+	mOutlines.back().push_back({pX,pY});
+	mStart = {pX,pY};
+	mClosed = false;
+	return *this;
+}
+
+Path& Path::LineTo(float pX,float pY)
+{
+	GetCurrentPoint();
+	mOutlines.back().push_back({pX,pY});
+	return *this;
+}
+
+Path& Path::QuadTo(float pControlX,float pControlY,float pX,float pY)
+{
+	const std::array<float,2> from = GetCurrentPoint();
+
+	// Lines of t step h are within (h * h / 8) times the largest second derivative of the curve, which is 2 * |from - 2 * control + to|.
+	const float ddx = from[0] - (2.0f * pControlX) + pX;
+	const float ddy = from[1] - (2.0f * pControlY) + pY;
+	const int numLines = std::min(1024,std::max(1,(int)ceilf(sqrtf(sqrtf((ddx * ddx) + (ddy * ddy)) / (4.0f * mTolerance)))));
+
+	for( int n = 1 ; n < numLines ; n++ )
+	{
+		const float t = (float)n / numLines;
+		const float u = 1.0f - t;
+		mOutlines.back().push_back({
+			(u * u * from[0]) + (2.0f * u * t * pControlX) + (t * t * pX),
+			(u * u * from[1]) + (2.0f * u * t * pControlY) + (t * t * pY)});
+	}
+	mOutlines.back().push_back({pX,pY});
+	return *this;
+}
+
+Path& Path::CubicTo(float pControlAX,float pControlAY,float pControlBX,float pControlBY,float pX,float pY)
+{
+	const std::array<float,2> from = GetCurrentPoint();
+
+	// Same as QuadTo, here the second derivative is at most 6 times the larger of the two second differences.
+	const float ddAX = from[0] - (2.0f * pControlAX) + pControlBX;
+	const float ddAY = from[1] - (2.0f * pControlAY) + pControlBY;
+	const float ddBX = pControlAX - (2.0f * pControlBX) + pX;
+	const float ddBY = pControlAY - (2.0f * pControlBY) + pY;
+	const float dd = sqrtf(std::max((ddAX * ddAX) + (ddAY * ddAY),(ddBX * ddBX) + (ddBY * ddBY)));
+	const int numLines = std::min(1024,std::max(1,(int)ceilf(sqrtf((0.75f * dd) / mTolerance))));
+
+	for( int n = 1 ; n < numLines ; n++ )
+	{
+		const float t = (float)n / numLines;
+		const float u = 1.0f - t;
+		mOutlines.back().push_back({
+			(u * u * u * from[0]) + (3.0f * u * u * t * pControlAX) + (3.0f * u * t * t * pControlBX) + (t * t * t * pX),
+			(u * u * u * from[1]) + (3.0f * u * u * t * pControlAY) + (3.0f * u * t * t * pControlBY) + (t * t * t * pY)});
+	}
+	mOutlines.back().push_back({pX,pY});
+	return *this;
+}
+
+Path& Path::Close()
+{
+	mClosed = true;
+	return *this;
+}
+
+void Path::Clear()
+{
+	mOutlines.clear();
+	mClosed = true;
+	mStart = {0.0f,0.0f};
+}
+
+Rect Path::GetBounds()const
+{
+	bool found = false;
+	float left = 0.0f,top = 0.0f,right = 0.0f,bottom = 0.0f;
+	for( const Outline& outline : mOutlines )
+	{
+		if( outline.size() < 2 )
+			continue;
+
+		for( const auto& point : outline )
+		{
+			left = found ? std::min(left,point[0]) : point[0];
+			top = found ? std::min(top,point[1]) : point[1];
+			right = found ? std::max(right,point[0]) : point[0];
+			bottom = found ? std::max(bottom,point[1]) : point[1];
+			found = true;
+		}
+	}
+
+	if( !found )
+		return Rect();
+
+	// Pixel x covers x - 0.5 to x + 0.5.
+	return Rect((int)floorf(left + 0.5f),(int)floorf(top + 0.5f),(int)floorf(right + 0.5f) + 1,(int)floorf(bottom + 0.5f) + 1);
+}
+
+std::array<float,2> Path::GetCurrentPoint()
+{
+	if( mClosed )
+	{
+		mOutlines.push_back({mStart});
+		mClosed = false;
+	}
+	return mOutlines.back().back();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DrawBufferView Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+DrawBufferView::DrawBufferView(DrawBuffer& pParent,int pX,int pY,int pWidth,int pHeight)
+{
+	// Clip to the parent, if nothing is left it's an empty view that draws nothing.
+	const int fromX = std::max(pX,0);
+	const int fromY = std::max(pY,0);
+	const int toX = std::min(pX + pWidth,pParent.GetWidth());
+	const int toY = std::min(pY + pHeight,pParent.GetHeight());
+
+	SetViewPixels(pParent.GetPixelAddress(fromX,fromY),std::max(toX - fromX,0),std::max(toY - fromY,0),pParent.GetStride(),pParent.GetPixelFormat(),pParent.GetPreMultipliedAlpha());
+	SetViewParent(&pParent,fromX,fromY,false);
+}
+
+DrawBufferView::DrawBufferView(uint8_t* pPixels,int pWidth,int pHeight,ptrdiff_t pStride,PixelFormat pFormat,bool pPreMultipliedAlpha)
+{
+	SetViewPixels(pPixels,pWidth,pHeight,pStride,pFormat,pPreMultipliedAlpha);
+}
+
+DrawBufferView DrawBufferView::FlipVertical(DrawBuffer& pParent)
+{
+	DrawBufferView view(pParent.GetPixelAddress(0,pParent.GetHeight() - 1),pParent.GetWidth(),pParent.GetHeight(),-pParent.GetStride(),pParent.GetPixelFormat(),pParent.GetPreMultipliedAlpha());
+	view.SetViewParent(&pParent,0,pParent.GetHeight() - 1,true);
+	return view;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// NinePatch Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief Finds the lowest and highest alpha in pArea of the image, both 255 for formats with no alpha.
+ */
+static void GetAlphaRange(const DrawBuffer& pImage,const Rect& pArea,uint8_t& rLowest,uint8_t& rHighest)
+{
+	rLowest = 255;
+	rHighest = 0;
+	DispatchPixelFormat(pImage.GetPixelFormat(),[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		if( FORMAT::HAS_ALPHA == false )
+		{
+			rHighest = 255;
+			return;
+		}
+
+		for( int y = pArea.top ; y < pArea.bottom ; y++ )
+		{
+			const uint8_t* pixel = pImage.GetPixelAddress(pArea.left,y);
+			for( int x = pArea.left ; x < pArea.right ; x++, pixel += FORMAT::PIXEL_SIZE )
+			{
+				uint8_t r,g,b,a;
+				FORMAT::Unpack(FORMAT::Read(pixel),r,g,b,a);
+				rLowest = std::min(rLowest,a);
+				rHighest = std::max(rHighest,a);
+			}
+		}
+	});
+}
+
+/**
+ * @brief True if the border pixel is a nine patch mark. Solid with alpha, else black.
+ */
+static bool GetIsNinePatchMark(const DrawBuffer& pImage,int pX,int pY)
+{
+	bool mark = false;
+	DispatchPixelFormat(pImage.GetPixelFormat(),[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		uint8_t r,g,b,a;
+		FORMAT::Unpack(FORMAT::Read(pImage.GetPixelAddress(pX,pY)),r,g,b,a);
+		if( FORMAT::HAS_ALPHA )
+			mark = pImage.GetPreMultipliedAlpha() ? a < 128 : a >= 128;	// Pre multiplied alpha is stored inverted.
+		else
+			mark = r < 128 && g < 128 && b < 128;
+	});
+	return mark;
+}
+
+/**
+ * @brief Finds the first and last marks along a border edge, from pX,pY stepping pStepX,pStepY for pCount pixels.
+ * The results are counted from the first pixel, if there are none they are left alone.
+ */
+static void FindNinePatchMarks(const DrawBuffer& pImage,int pX,int pY,int pStepX,int pStepY,int pCount,int& rFirst,int& rEnd)
+{
+	int first = -1;
+	int last = -1;
+	for( int n = 0 ; n < pCount ; n++ )
+	{
+		if( GetIsNinePatchMark(pImage,pX + (n * pStepX),pY + (n * pStepY)) )
+		{
+			if( first < 0 )
+				first = n;
+			last = n;
+		}
+	}
+
+	if( first >= 0 )
+	{
+		rFirst = first;
+		rEnd = last + 1;
+	}
+}
+
+/**
+ * @brief Where the slice edges go when drawn pSize long, from pFrom. The middle takes what is left, and if there is not
+ * enough room for the ends they share it in proportion.
+ */
+static void GetNinePatchDrawEdges(const int pEdges[4],int pFrom,int pSize,int rEdges[4])
+{
+	const int fixed = pEdges[1] + (pEdges[3] - pEdges[2]);
+	const int first = pSize >= fixed ? pEdges[1] : (int)(((int64_t)pSize * pEdges[1]) / fixed);
+	const int last = pSize >= fixed ? pEdges[3] - pEdges[2] : pSize - first;
+	rEdges[0] = pFrom;
+	rEdges[1] = pFrom + first;
+	rEdges[2] = pFrom + pSize - last;
+	rEdges[3] = pFrom + pSize;
+}
+
+NinePatch::NinePatch(const DrawBuffer& pNinePatch)
+{
+	assert( pNinePatch.GetWidth() >= 2 && pNinePatch.GetHeight() >= 2 );
+	const int width = std::max(pNinePatch.GetWidth() - 2,0);
+	const int height = std::max(pNinePatch.GetHeight() - 2,0);
+
+	// No marks stretches all of it.
+	int stretchLeft = 0,stretchRight = width,stretchTop = 0,stretchBottom = height;
+	FindNinePatchMarks(pNinePatch,1,0,1,0,width,stretchLeft,stretchRight);
+	FindNinePatchMarks(pNinePatch,0,1,0,1,height,stretchTop,stretchBottom);
+
+	int contentLeft = stretchLeft,contentRight = stretchRight,contentTop = stretchTop,contentBottom = stretchBottom;
+	FindNinePatchMarks(pNinePatch,1,height + 1,1,0,width,contentLeft,contentRight);
+	FindNinePatchMarks(pNinePatch,width + 1,1,0,1,height,contentTop,contentBottom);
+
+	mColumns[0] = 0;
+	mColumns[1] = stretchLeft;
+	mColumns[2] = stretchRight;
+	mColumns[3] = width;
+	mRows[0] = 0;
+	mRows[1] = stretchTop;
+	mRows[2] = stretchBottom;
+	mRows[3] = height;
+	mContentInsets = Rect(contentLeft,contentTop,width - contentRight,height - contentBottom);
+	Slice(pNinePatch,1);
+}
+
+NinePatch::NinePatch(const DrawBuffer& pImage,int pLeft,int pTop,int pRight,int pBottom)
+{
+	const int width = pImage.GetWidth();
+	const int height = pImage.GetHeight();
+	pLeft = std::min(std::max(pLeft,0),width);
+	pTop = std::min(std::max(pTop,0),height);
+	pRight = std::min(std::max(pRight,0),width - pLeft);
+	pBottom = std::min(std::max(pBottom,0),height - pTop);
+
+	mColumns[0] = 0;
+	mColumns[1] = pLeft;
+	mColumns[2] = width - pRight;
+	mColumns[3] = width;
+	mRows[0] = 0;
+	mRows[1] = pTop;
+	mRows[2] = height - pBottom;
+	mRows[3] = height;
+	mContentInsets = Rect(pLeft,pTop,pRight,pBottom);
+	Slice(pImage,0);
+}
+
+Rect NinePatch::GetContentRect(const Rect& pRect)const
+{
+	return Rect(pRect.left + mContentInsets.left,pRect.top + mContentInsets.top,pRect.right - mContentInsets.right,pRect.bottom - mContentInsets.bottom);
+}
+
+void NinePatch::Draw(DrawBuffer& pDest,const Rect& pRect)const
+{
+	if( pRect.GetIsEmpty() )
+		return;
+
+	int columns[4],rows[4];
+	GetNinePatchDrawEdges(mColumns,pRect.left,pRect.GetWidth(),columns);
+	GetNinePatchDrawEdges(mRows,pRect.top,pRect.GetHeight(),rows);
+	for( int y = 0 ; y < 3 ; y++ )
+	{
+		for( int x = 0 ; x < 3 ; x++ )
+		{
+			const DrawBuffer& slice = mSlices[y][x];
+			const Rect dest(columns[x],rows[y],columns[x + 1],rows[y + 1]);
+			if( dest.GetIsEmpty() || slice.GetWidth() < 1 || slice.GetHeight() < 1 )
+				continue;
+
+			// Unstretched is a row at a time, and stretched solid slices are copied with each repeated row a memcpy of the one above.
+			if( dest.GetWidth() == slice.GetWidth() && dest.GetHeight() == slice.GetHeight() )
+			{
+				if( mSolid[y][x] )
+					pDest.Blit(slice,dest.left,dest.top);
+				else
+					pDest.Blend(slice,dest.left,dest.top);
+			}
+			else
+			{
+				pDest.BlitScaled(slice,dest,IMAGE_FILTER_NEAREST,!mSolid[y][x]);
+			}
+		}
+	}
+}
+
+void NinePatch::Slice(const DrawBuffer& pImage,int pBorder)
+{
+	for( int y = 0 ; y < 3 ; y++ )
+	{
+		for( int x = 0 ; x < 3 ; x++ )
+		{
+			DrawBuffer& slice = mSlices[y][x];
+			const int width = mColumns[x + 1] - mColumns[x];
+			const int height = mRows[y + 1] - mRows[y];
+			mSolid[y][x] = true;
+			if( width < 1 || height < 1 )
+				continue;
+
+			slice.Resize(width,height,pImage.GetPixelFormat(),pImage.GetPreMultipliedAlpha());
+			slice.Blit(pImage,-(mColumns[x] + pBorder),-(mRows[y] + pBorder));
+
+			// Pre multiplied images are always blended, a copy would put their inverted alpha in the draw buffer.
+			uint8_t lowest,highest;
+			GetAlphaRange(slice,Rect(0,0,width,height),lowest,highest);
+			mSolid[y][x] = lowest == 255 && (slice.GetPreMultipliedAlpha() == false || slice.GetHasAlpha() == false);
+			if( mSolid[y][x] == false )
+				slice.UpdateOpacityTiles();
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Atlas Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+Atlas::Atlas(int pPageWidth,int pPageHeight,PixelFormat pFormat) :
+	mPageWidth(pPageWidth),
+	mPageHeight(pPageHeight),
+	mFormat(pFormat)
+{
+	assert( pPageWidth > 0 && pPageHeight > 0 );
+}
+
+Sprite Atlas::Add(const DrawBuffer& pImage)
+{
+	assert( pImage.GetPreMultipliedAlpha() == false );
+	const int width = pImage.GetWidth();
+	const int height = pImage.GetHeight();
+	if( width < 1 || height < 1 )
+		return Sprite();
+
+	// First page with room, else a new one. Big images get a page their size.
+	int x = 0,y = 0;
+	Page* page = nullptr;
+	for( Page& p : mPages )
+	{
+		if( Place(p,width,height,x,y) )
+		{
+			page = &p;
+			break;
+		}
+	}
+
+	if( page == nullptr )
+	{
+		mPages.emplace_back();
+		page = &mPages.back();
+		const int pageWidth = std::max(mPageWidth,width);
+		const int pageHeight = std::max(mPageHeight,height);
+		page->pixels = std::make_unique<DrawBuffer>(pageWidth,pageHeight,mFormat);
+		page->pixels->Clear(0,0,0,0);
+		page->skyline.push_back({0,0,pageWidth});
+		Place(*page,width,height,x,y);
+	}
+
+	page->pixels->Blit(pImage,x,y);
+	page->pixels->UpdateOpacityTiles();
+
+	Sprite sprite;
+	sprite.page = page->pixels.get();
+	sprite.rect = Rect(x,y,x + width,y + height);
+	uint8_t lowest,highest;
+	GetAlphaRange(*sprite.page,sprite.rect,lowest,highest);
+	sprite.solid = lowest == 255;
+	sprite.clear = highest == 0;
+	return sprite;
+}
+
+std::vector<Sprite> Atlas::Add(const std::vector<const DrawBuffer*>& pImages)
+{
+	std::vector<size_t> order(pImages.size());
+	for( size_t n = 0 ; n < order.size() ; n++ )
+	{
+		order[n] = n;
+	}
+	std::stable_sort(order.begin(),order.end(),[&](size_t pA,size_t pB){return pImages[pA]->GetHeight() > pImages[pB]->GetHeight();});
+
+	std::vector<Sprite> sprites(pImages.size());
+	for( size_t n : order )
+	{
+		sprites[n] = Add(*pImages[n]);
+	}
+	return sprites;
+}
+
+bool Atlas::Place(Page& rPage,int pWidth,int pHeight,int& rX,int& rY)
+{
+	std::vector<Segment>& skyline = rPage.skyline;
+	const int pageWidth = rPage.pixels->GetWidth();
+	const int pageHeight = rPage.pixels->GetHeight();
+
+	// Try the left edge of each segment, it sits on the highest segment under it. Lowest top edge wins, then the least wasted width.
+	size_t best = skyline.size();
+	int bestY = 0,bestBottom = INT_MAX,bestWidth = INT_MAX;
+	for( size_t n = 0 ; n < skyline.size() ; n++ )
+	{
+		const int x = skyline[n].x;
+		if( x + pWidth > pageWidth )
+			break;
+
+		int y = 0;
+		for( size_t k = n ; k < skyline.size() && skyline[k].x < x + pWidth ; k++ )
+		{
+			y = std::max(y,skyline[k].y);
+		}
+
+		if( y + pHeight <= pageHeight && (y + pHeight < bestBottom || (y + pHeight == bestBottom && skyline[n].width < bestWidth)) )
+		{
+			best = n;
+			bestY = y;
+			bestBottom = y + pHeight;
+			bestWidth = skyline[n].width;
+		}
+	}
+
+	if( best == skyline.size() )
+		return false;
+
+	rX = skyline[best].x;
+	rY = bestY;
+
+	// The new segment covers the image, the ones it overhangs are cut back or removed.
+	skyline.insert(skyline.begin() + best,{rX,bestBottom,pWidth});
+	const int right = rX + pWidth;
+	size_t n = best + 1;
+	while( n < skyline.size() && skyline[n].x < right )
+	{
+		const int end = skyline[n].x + skyline[n].width;
+		if( end <= right )
+		{
+			skyline.erase(skyline.begin() + n);
+		}
+		else
+		{
+			skyline[n].width = end - right;
+			skyline[n].x = right;
+			break;
+		}
+	}
+
+	// Join neighbours at the same height so the list stays short.
+	for( size_t k = 1 ; k < skyline.size() ; )
+	{
+		if( skyline[k - 1].y == skyline[k].y )
+		{
+			skyline[k - 1].width += skyline[k].width;
+			skyline.erase(skyline.begin() + k);
+		}
+		else
+		{
+			k++;
+		}
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SpanSprite Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+SpanSprite::SpanSprite(const DrawBuffer& pImage,PixelFormat pFormat) :
+	mWidth(pImage.GetWidth()),
+	mHeight(pImage.GetHeight()),
+	mFormat(pFormat)
+{
+	assert( pImage.GetPreMultipliedAlpha() == false );
+	enum {RUN_SEE_THROUGH,RUN_SOLID,RUN_BLENDED};
+	struct Run
+	{
+		int kind,x,count;
+	};
+
+	mLines.push_back(0);
+	DispatchPixelFormat(pImage.GetPixelFormat(),[&](auto pSourceFormat)
+	{
+		DispatchPixelFormat(pFormat,[&](auto pSolidFormat)
+		{
+			typedef decltype(pSourceFormat) SOURCE;
+			typedef decltype(pSolidFormat) SOLID;
+			std::vector<Run> runs;
+			for( int y = 0 ; y < mHeight ; y++ )
+			{
+				const uint8_t* source = pImage.GetPixelAddress(0,y);
+				runs.clear();
+				for( int x = 0 ; x < mWidth ; x++ )
+				{
+					uint8_t r,g,b,a;
+					SOURCE::Unpack(SOURCE::Read(source + (x * SOURCE::PIXEL_SIZE)),r,g,b,a);
+					const int kind = a == 0 ? RUN_SEE_THROUGH : (a == 255 ? RUN_SOLID : RUN_BLENDED);
+					if( runs.size() > 0 && runs.back().kind == kind )
+						runs.back().count++;
+					else
+						runs.push_back({kind,x,1});
+				}
+
+				// A few solid or see through pixels next to blended ones are quicker blended with them, and blending them changes nothing.
+				const int SHORT_RUN = 4;
+				for( size_t n = 0 ; n < runs.size() ; n++ )
+				{
+					const bool blendedBefore = n > 0 && runs[n - 1].kind == RUN_BLENDED;
+					const bool blendedAfter = n + 1 < runs.size() && runs[n + 1].kind == RUN_BLENDED;
+					if( runs[n].count < SHORT_RUN &&
+						((runs[n].kind == RUN_SOLID && (blendedBefore || blendedAfter)) || (runs[n].kind == RUN_SEE_THROUGH && blendedBefore && blendedAfter)) )
+					{
+						runs[n].kind = RUN_BLENDED;
+					}
+				}
+
+				for( size_t n = 0 ; n < runs.size() ; n++ )
+				{
+					const Run& run = runs[n];
+					if( run.kind == RUN_SEE_THROUGH )
+						continue;
+
+					const bool solid = run.kind == RUN_SOLID;
+					std::vector<uint8_t>& pixels = solid ? mSolidPixels : mBlendPixels;
+					size_t offset = pixels.size();
+
+					// Runs that have become blended join the one before.
+					if( solid == false && n > 0 && runs[n - 1].kind == RUN_BLENDED )
+						mSpans.back().count += run.count;
+					else
+						mSpans.push_back({run.x,run.count,solid,offset});
+
+					pixels.resize(offset + (run.count * (solid ? SOLID::PIXEL_SIZE : PixelFormatBGRA8888::PIXEL_SIZE)));
+					for( int x = run.x ; x < run.x + run.count ; x++ )
+					{
+						uint8_t r,g,b,a;
+						SOURCE::Unpack(SOURCE::Read(source + (x * SOURCE::PIXEL_SIZE)),r,g,b,a);
+						if( solid )
+						{
+							SOLID::Write(pixels.data() + offset,SOLID::Pack(r,g,b,255));
+							offset += SOLID::PIXEL_SIZE;
+						}
+						else
+						{
+							PixelFormatBGRA8888::Write(pixels.data() + offset,PixelFormatBGRA8888::Pack(r,g,b,a));
+							offset += PixelFormatBGRA8888::PIXEL_SIZE;
+						}
+					}
+					mBounds = mBounds.Union(Rect(run.x,y,run.x + run.count,y + 1));
+				}
+				mLines.push_back(mSpans.size());
+			}
+		});
+	});
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DrawBufferPool Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+DrawBufferPool::DrawBufferPool(size_t pMaxFree) : mMaxFree(pMaxFree)
+{
+}
+
+DrawBufferPool::~DrawBufferPool()
+{
+	Trim();
+}
+
+DrawBuffer* DrawBufferPool::Acquire(int pWidth,int pHeight,PixelFormat pFormat)
+{
+	const size_t numBytes = pWidth * pHeight * GetPixelFormatSize(pFormat);
+	DrawBuffer* buffer = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+
+		// Best is the same geometry, then the smallest that will hold it without growing.
+		auto found = mFree.end();
+		for( auto it = mFree.begin() ; it != mFree.end() ; ++it )
+		{
+			const DrawBuffer* b = *it;
+			if( b->GetWidth() == pWidth && b->GetHeight() == pHeight && b->GetPixelFormat() == pFormat )
+			{
+				found = it;
+				break;
+			}
+
+			if( b->mPixels.capacity() >= numBytes && (found == mFree.end() || b->mPixels.capacity() < (*found)->mPixels.capacity()) )
+			{
+				found = it;
+			}
+		}
+
+		if( found != mFree.end() )
+		{
+			buffer = *found;
+			mFree.erase(found);
+		}
+	}
+
+	if( buffer )
+	{// Still resize when it's the same, puts stride and pre multiplied alpha back to how a new one would be.
+		// The last owner's job system may be gone by now, and they may have been tracking dirty rects, a new buffer does neither.
+		buffer->SetJobSystem(nullptr);
+		buffer->SetTrackDirtyRects(false);
+		buffer->Resize(pWidth,pHeight,pFormat);
+		return buffer;
+	}
+	return new DrawBuffer(pWidth,pHeight,pFormat);
+}
+
+void DrawBufferPool::Release(DrawBuffer* pBuffer)
+{
+	if( pBuffer == nullptr )
+	{
+		return;
+	}
+
 	{
-		pRadius = (pToX - pFromX) / 2;
+		std::lock_guard<std::mutex> lock(mLock);
+		if( mFree.size() < mMaxFree )
+		{
+			mFree.push_back(pBuffer);
+			return;
+		}
 	}
-	else if( pRadius*2 > pToY - pFromY )
+	delete pBuffer;
+}
+
+void DrawBufferPool::Trim()
+{
+	std::vector<DrawBuffer*> toDelete;
 	{
-		pRadius = (pToY - pFromY) / 2;
+		std::lock_guard<std::mutex> lock(mLock);
+		toDelete.swap(mFree);
 	}
 
-    int x = pRadius-1;
-    int y = 0;
-    int dx = 1;
-    int dy = 1;
-    int err = dx - (pRadius << 1);
+	for( auto b : toDelete )
+	{
+		delete b;
+	}
+}
 
-	// Values I need so that the quadrants are positioned in the corners of the rectangle.
-	const int left = pFromX + pRadius; 
-	const int right = pToX - pRadius;
-	const int top = pFromY + pRadius;
-	const int bottom = pToY - pRadius;
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// JobSystem Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// So a thread knows if it's one of the workers, and which queue is its own. Other threads use queue 0.
+static thread_local JobSystem* tWorkerOf = nullptr;
+static thread_local size_t tWorkerQueue = 0;
 
-    while (x >= y)
-    {
-		DrawLineH(left - x, top - y,right + x,pRed,pGreen,pBlue,pAlpha);
-		DrawLineH(left - y, top - x,right + y,pRed,pGreen,pBlue,pAlpha);			
-
-		DrawLineH(left - x, bottom + y,right + x,pRed,pGreen,pBlue,pAlpha);
-		DrawLineH(left - y, bottom + x,right + y,pRed,pGreen,pBlue,pAlpha);
-
-        if (err <= 0)
-        {
-            y++;
-            err += dy;
-            dy += 2;
-        }
-        if (err > 0)
-        {
-            x--;
-            dx += 2;
-            err += (-pRadius << 1) + dx;
-        }
-    }
+JobSystem::JobSystem(size_t pNumThreads,bool pPinToCores) :
+	mNumQueued(0)
+{
+	const size_t numCores = std::max(1u,std::thread::hardware_concurrency());
+	if( pNumThreads == 0 )
+	{
+		pNumThreads = numCores;
+	}
+
+	for( size_t n = 0 ; n < pNumThreads ; n++ )
+	{
+		mQueues.emplace_back(new Queue);
+	}
 
-	FillRectangle(pFromX,pFromY+pRadius,pToX,pToY-pRadius,pRed,pGreen,pBlue,pAlpha);
+	// The thread calling ParallelFor is the first, so start at one.
+	for( size_t n = 1 ; n < pNumThreads ; n++ )
+	{
+		mWorkers.emplace_back(&JobSystem::WorkerMain,this,n);
+		if( pPinToCores )
+		{
+			cpu_set_t cores;
+			CPU_ZERO(&cores);
+			CPU_SET(n % numCores,&cores);
+			pthread_setaffinity_np(mWorkers.back().native_handle(),sizeof(cores),&cores);
+		}
+	}
 }
 
-void DrawBuffer::FillCheckerBoard(int pX,int pY,int pXCount,int pYCount,int pXSize,int pYSize,const uint8_t pRGBA[2][4])
+JobSystem::~JobSystem()
 {
-	const int width = pXSize-1;
-	const int height = pYSize-1;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for( auto& w : mWorkers )
+	{
+		w.join();
+	}
+}
 
-	for( int y = 0 ; y < pYCount ; y++, pY += pYSize )
+JobSystem& JobSystem::Get()
+{
+	static JobSystem jobs;
+	return jobs;
+}
+
+void JobSystem::ParallelFor(int pBegin,int pEnd,int pGrain,const std::function<void(int pFrom,int pTo)>& pFunction)
+{
+	assert( pGrain > 0 );
+	if( pEnd <= pBegin )
+		return;
+
+	const int numJobs = ((pEnd - pBegin) + pGrain - 1) / pGrain;
+	if( numJobs == 1 || mQueues.size() == 1 )
 	{
-		int px = pX;
-		for( int x = 0 ; x < pXCount ; x++, px += pXSize )
+		pFunction(pBegin,pEnd);
+		return;
+	}
+
+	const size_t ourQueue = tWorkerOf == this ? tWorkerQueue : 0;
+	std::atomic<int> numLeft(numJobs);
+
+	// Each thread gets a run of jobs next to each other, ours first. Good for the cache and they only steal once they run out.
+	const size_t numQueues = mQueues.size();
+	for( size_t q = 0 ; q < numQueues ; q++ )
+	{
+		const int from = (int)((numJobs * q) / numQueues);
+		const int to = (int)((numJobs * (q + 1)) / numQueues);
+		if( from == to )
+			continue;
+
+		Queue& queue = *mQueues[(ourQueue + q) % numQueues];
+		std::lock_guard<std::mutex> lock(queue.mLock);
+		for( int j = from ; j < to ; j++ )
 		{
-			if( (x&1) == (y&1) )
-				FillRectangle(px,pY,px+width,pY+height,pRGBA[0][0],pRGBA[0][1],pRGBA[0][2],pRGBA[0][3]);
-			else
-				FillRectangle(px,pY,px+width,pY+height,pRGBA[1][0],pRGBA[1][1],pRGBA[1][2],pRGBA[1][3]);
+			const int jobFrom = pBegin + (j * pGrain);
+			queue.mJobs.push_back({&pFunction,jobFrom,std::min(jobFrom + pGrain,pEnd),&numLeft});
+		}
+	}
+
+	mNumQueued += numJobs;
+	{// Take the lock so a worker can't miss the wake up between looking at mNumQueued and waiting.
+		std::lock_guard<std::mutex> lock(mLock);
+	}
+	mWake.notify_all();
+
+	// Help until all ours are done, may run jobs from other calls too.
+	Job job;
+	while( numLeft > 0 )
+	{
+		if( GetJob(ourQueue,job) )
+		{
+			(*job.mFunction)(job.mFrom,job.mTo);
+			(*job.mNumLeft)--;
+		}
+		else
+		{// The last ones are being done by other threads.
+			std::this_thread::yield();
 		}
 	}
 }
 
-void DrawBuffer::FillCheckerBoard(int pX,int pY,int pXCount,int pYCount,int pXSize,int pYSize,uint8_t pA,uint8_t pB)
+void JobSystem::ParallelForRows(const DrawBuffer& pBuffer,int pGrain,const std::function<void(int pFromY,int pToY)>& pFunction)
 {
-	const uint8_t RGBA[2][4] = {{pA,pA,pA,255},{pB,pB,pB,255}};
-	FillCheckerBoard(pX, pY, pXCount, pYCount, pXSize, pYSize,RGBA);
+	ParallelFor(pBuffer.GetClipRect().top,pBuffer.GetClipRect().bottom,pGrain,pFunction);
 }
 
-void DrawBuffer::FillCheckerBoard(int pXSize,int pYSize,const uint8_t pRGBA[2][4])
+bool JobSystem::GetJob(size_t pQueue,Job& rJob)
 {
-	FillCheckerBoard(0,0,(mWidth+pXSize-1) / pXSize,(mHeight+pYSize+1) / pYSize,pXSize,pYSize,pRGBA);
+	if( mNumQueued == 0 )
+		return false;
+
+	{
+		Queue& queue = *mQueues[pQueue];
+		std::lock_guard<std::mutex> lock(queue.mLock);
+		if( queue.mJobs.size() > 0 )
+		{
+			rJob = queue.mJobs.front();
+			queue.mJobs.pop_front();
+			mNumQueued--;
+			return true;
+		}
+	}
+
+	// Steal from the back, the work the owner will get to last.
+	for( size_t n = 1 ; n < mQueues.size() ; n++ )
+	{
+		Queue& queue = *mQueues[(pQueue + n) % mQueues.size()];
+		std::lock_guard<std::mutex> lock(queue.mLock);
+		if( queue.mJobs.size() > 0 )
+		{
+			rJob = queue.mJobs.back();
+			queue.mJobs.pop_back();
+			mNumQueued--;
+			return true;
+		}
+	}
+	return false;
 }
 
-void DrawBuffer::FillCheckerBoard(int pXSize,int pYSize,uint8_t pA,uint8_t pB)
+void JobSystem::WorkerMain(size_t pQueue)
 {
-	const uint8_t RGBA[2][4] = {{pA,pA,pA,255},{pB,pB,pB,255}};
-	FillCheckerBoard(pXSize, pYSize,RGBA);
+	tWorkerOf = this;
+	tWorkerQueue = pQueue;
+
+	Job job;
+	for(;;)
+	{
+		if( GetJob(pQueue,job) )
+		{
+			(*job.mFunction)(job.mFrom,job.mTo);
+			(*job.mNumLeft)--;
+		}
+		else
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+			mWake.wait(lock,[this]{return mQuit || mNumQueued > 0;});
+			if( mQuit )
+				return;
+		}
+	}
 }
 
-void DrawBuffer::DrawGradient(int pFromX,int pFromY,int pToX,int pToY,uint8_t pFormRed,uint8_t pFormGreen,uint8_t pFormBlue,uint8_t pToRed,uint8_t pToGreen,uint8_t pToBlue)
+void ParallelForRows(DrawBuffer& pBuffer,int pGrain,const std::function<void(int pFromY,int pToY)>& pFunction)
 {
-	// Do some early outs.
-	if( pFromY == pToY || pFromX == pToX )
+	JobSystem::Get().ParallelForRows(pBuffer,pGrain,pFunction);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DisplayList Implementation.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+DisplayList::DisplayList(int pTileSize,JobSystem* pJobs) :
+	mTileSize(pTileSize),
+	mJobs(pJobs ? *pJobs : JobSystem::Get())
+{
+	assert( pTileSize > 0 );
+}
+
+void DisplayList::Execute(DrawBuffer& pTarget)
+{
+	const Rect area = pTarget.GetClipRect();
+	if( area.GetIsEmpty() || mCommands.size() == 0 )
 		return;
 
-	// Make sure X is in the right direction.
-	if( pFromX > pToX )
+	// Bin the commands, a command goes in every tile its bounds touch.
+	mTilesAcross = (pTarget.GetWidth() + mTileSize - 1) / mTileSize;
+	const int tilesDown = (pTarget.GetHeight() + mTileSize - 1) / mTileSize;
+	mBins.resize(mTilesAcross * tilesDown);
+	for( auto& bin : mBins )
 	{
-		std::swap(pFromX,pToX);
+		bin.clear();
 	}
 
-	float a,s;
-
-	// See if we need to flip the direction of the gradient if they are drawing up instead of down.
-	if( pFromY > pToY )
+	for( uint32_t n = 0 ; n < mCommands.size() ; n++ )
 	{
-		std::swap(pFromY,pToY);
-		a = 1.0f;
-		s = -1.0f / (float)(pToY - pFromY);
+		const Rect bounds = mCommands[n].mBounds.Intersect(area);
+		if( bounds.GetIsEmpty() )
+			continue;
+
+		for( int y = bounds.top / mTileSize ; y <= (bounds.bottom - 1) / mTileSize ; y++ )
+		{
+			for( int x = bounds.left / mTileSize ; x <= (bounds.right - 1) / mTileSize ; x++ )
+			{
+				mBins[x + (y * mTilesAcross)].push_back(n);
+			}
+		}
 	}
-	else
+
+	mTilesToDraw.clear();
+	for( uint32_t n = 0 ; n < mBins.size() ; n++ )
 	{
-		a = 0.0f;
-		s = 1.0f / (float)(pToY - pFromY);
+		if( mBins[n].size() > 0 )
+			mTilesToDraw.push_back(n);
 	}
 
-	const float fR = (float)pFormRed / 255.0f;
-	const float fG = (float)pFormGreen / 255.0f;
-	const float fB = (float)pFormBlue / 255.0f;
+	// One tile a job, they take very different times so this lets the threads even it out.
+	mJobs.ParallelFor(0,(int)mTilesToDraw.size(),1,[&](int pFrom,int pTo)
+	{
+		for( int n = pFrom ; n < pTo ; n++ )
+		{
+			DrawTile(pTarget,area,mTilesToDraw[n]);
+		}
+	});
+}
 
-	const float tR = (float)pToRed / 255.0f;
-	const float tG = (float)pToGreen / 255.0f;
-	const float tB = (float)pToBlue / 255.0f;
+void DisplayList::Record(const Rect& pBounds,std::function<void(DrawBuffer& pTile)> pDraw)
+{
+	if( pBounds.GetIsEmpty() )
+		return;
 
-	for( int y = pFromY ; y <= pToY ; y++, a += s )
-	{
-		const float invA = 1.0f - a;
-		const uint8_t r = (uint8_t)( ((fR * invA) + (tR * a) ) * 255.0f);
-		const uint8_t g = (uint8_t)( ((fG * invA) + (tG * a) ) * 255.0f);
-		const uint8_t b = (uint8_t)( ((fB * invA) + (tB * a) ) * 255.0f);
+	mCommands.push_back({pBounds,std::move(pDraw)});
+}
 
-		DrawLineH(pFromX,y,pToX,r,g,b);
+void DisplayList::DrawTile(DrawBuffer& pTarget,const Rect& pArea,uint32_t pTile)const
+{
+	const int x = (pTile % mTilesAcross) * mTileSize;
+	const int y = (pTile / mTilesAcross) * mTileSize;
+
+	// A view of all of the target, so the recorded coordinates are used as they are, clipped to the tile.
+	DrawBufferView tile(pTarget,0,0,pTarget.GetWidth(),pTarget.GetHeight());
+	tile.PushClipRect(Rect(x,y,x + mTileSize,y + mTileSize).Intersect(pArea));
+	for( uint32_t n : mBins[pTile] )
+	{
+		mCommands[n].mDraw(tile);
 	}
 }
 
-void DrawBuffer::ScrollBuffer(int pXDirection,int pYDirection,int8_t pRedFill,uint8_t pGreenFill,uint8_t pBlueFill,uint8_t pAlphaFill)
+void DisplayList::Clear(uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	Record(Rect(0,0,INT_MAX,INT_MAX),[=](DrawBuffer& pTile){pTile.Clear(pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::WritePixel(int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	Record(Rect(pX,pY,pX + 1,pY + 1),[=](DrawBuffer& pTile){pTile.WritePixel(pX,pY,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::BlendPixel(int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	Record(Rect(pX,pY,pX + 1,pY + 1),[=](DrawBuffer& pTile){pTile.BlendPixel(pX,pY,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::BlitRGB(const uint8_t* pSourcePixels,int pX,int pY,int pSourceWidth,int pSourceHeight)
+{
+	Record(Rect(pX,pY,pX + pSourceWidth,pY + pSourceHeight),[=](DrawBuffer& pTile){pTile.BlitRGB(pSourcePixels,pX,pY,pSourceWidth,pSourceHeight);});
+}
+
+void DisplayList::BlitRGBA(const uint8_t* pSourcePixels,int pX,int pY,int pSourceWidth,int pSourceHeight,bool pPreMultipliedAlpha,BlendMode pMode)
+{
+	Record(Rect(pX,pY,pX + pSourceWidth,pY + pSourceHeight),[=](DrawBuffer& pTile){pTile.BlitRGBA(pSourcePixels,pX,pY,pSourceWidth,pSourceHeight,pPreMultipliedAlpha,pMode);});
+}
+
+void DisplayList::Blit(const DrawBuffer& pImage,int pX,int pY)
+{
+	const DrawBuffer* image = &pImage;
+	Record(Rect(pX,pY,pX + pImage.GetWidth(),pY + pImage.GetHeight()),[=](DrawBuffer& pTile){pTile.Blit(*image,pX,pY);});
+}
+
+void DisplayList::Blend(const DrawBuffer& pImage,int pX,int pY,BlendMode pMode)
+{
+	const DrawBuffer* image = &pImage;
+	Record(Rect(pX,pY,pX + pImage.GetWidth(),pY + pImage.GetHeight()),[=](DrawBuffer& pTile){pTile.Blend(*image,pX,pY,pMode);});
+}
+
+void DisplayList::Blit(const Sprite& pSprite,int pX,int pY)
+{
+	Record(Rect(pX,pY,pX + pSprite.GetWidth(),pY + pSprite.GetHeight()),[=](DrawBuffer& pTile){pTile.Blit(pSprite,pX,pY);});
+}
+
+void DisplayList::Blend(const Sprite& pSprite,int pX,int pY)
+{
+	Record(Rect(pX,pY,pX + pSprite.GetWidth(),pY + pSprite.GetHeight()),[=](DrawBuffer& pTile){pTile.Blend(pSprite,pX,pY);});
+}
+
+void DisplayList::Blend(const SpanSprite& pSprite,int pX,int pY)
+{
+	const SpanSprite* sprite = &pSprite;
+	const Rect& bounds = pSprite.GetBounds();
+	Record(Rect(pX + bounds.left,pY + bounds.top,pX + bounds.right,pY + bounds.bottom),[=](DrawBuffer& pTile){pTile.Blend(*sprite,pX,pY);});
+}
+
+void DisplayList::BlitTransformed(const DrawBuffer& pImage,const Matrix& pTransform,ImageFilter pFilter,bool pBlend)
+{
+	const DrawBuffer* image = &pImage;
+	Record(GetTransformedBounds(pTransform,pImage.GetWidth(),pImage.GetHeight()),[=](DrawBuffer& pTile){pTile.BlitTransformed(*image,pTransform,pFilter,pBlend);});
+}
+
+void DisplayList::BlitScaled(const DrawBuffer& pImage,const Rect& pDest,const Rect& pSource,ImageFilter pFilter,bool pBlend)
+{
+	const DrawBuffer* image = &pImage;
+	Record(pDest,[=](DrawBuffer& pTile){pTile.BlitScaled(*image,pDest,pSource,pFilter,pBlend);});
+}
+
+void DisplayList::DrawLineH(int pFromX,int pFromY,int pToX,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	Record(Rect(std::min(pFromX,pToX),pFromY,std::max(pFromX,pToX) + 1,pFromY + 1),[=](DrawBuffer& pTile){pTile.DrawLineH(pFromX,pFromY,pToX,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::DrawLineV(int pFromX,int pFromY,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	Record(Rect(pFromX,std::min(pFromY,pToY),pFromX + 1,std::max(pFromY,pToY) + 1),[=](DrawBuffer& pTile){pTile.DrawLineV(pFromX,pFromY,pToY,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::DrawLine(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
+{
+	const Rect bounds(std::min(pFromX,pToX),std::min(pFromY,pToY),std::max(pFromX,pToX) + 1,std::max(pFromY,pToY) + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.DrawLine(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue);});
+}
+
+void DisplayList::DrawLine(int pFromX,int pFromY,int pToX,int pToY,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
+{
+	// The thick line is stamped with squares of pWidth, so can reach that far either side of the ends.
+	const int w = std::max(pWidth,1);
+	const Rect bounds(std::min(pFromX,pToX) - w,std::min(pFromY,pToY) - w,std::max(pFromX,pToX) + w + 1,std::max(pFromY,pToY) + w + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.DrawLine(pFromX,pFromY,pToX,pToY,pWidth,pRed,pGreen,pBlue);});
+}
+
+void DisplayList::DrawLineAA(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect bounds((std::min(pFromX,pToX) >> FIXED_POINT_SHIFT) - 1,(std::min(pFromY,pToY) >> FIXED_POINT_SHIFT) - 1,
+						(std::max(pFromX,pToX) >> FIXED_POINT_SHIFT) + 3,(std::max(pFromY,pToY) >> FIXED_POINT_SHIFT) + 3);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.DrawLineAA(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::DrawLineAA(int pFromX,int pFromY,int pToX,int pToY,int pWidth,LineCap pCap,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	// The caps can reach half the width past the ends, the sides of a diagonal line a little more, plus the anti-aliased edge.
+	const int reach = (std::max(pWidth,0) >> FIXED_POINT_SHIFT) + 2;
+	const Rect bounds((std::min(pFromX,pToX) >> FIXED_POINT_SHIFT) - reach,(std::min(pFromY,pToY) >> FIXED_POINT_SHIFT) - reach,
+						(std::max(pFromX,pToX) >> FIXED_POINT_SHIFT) + reach + 1,(std::max(pFromY,pToY) >> FIXED_POINT_SHIFT) + reach + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.DrawLineAA(pFromX,pFromY,pToX,pToY,pWidth,pCap,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::DrawCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect bounds(pCenterX - pRadius,pCenterY - pRadius,pCenterX + pRadius + 1,pCenterY + pRadius + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.DrawCircle(pCenterX,pCenterY,pRadius,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::FillCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect bounds(pCenterX - pRadius,pCenterY - pRadius,pCenterX + pRadius + 1,pCenterY + pRadius + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.FillCircle(pCenterX,pCenterY,pRadius,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::FillCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode)
+{
+	const Rect bounds(pCenterX - pRadius,pCenterY - pRadius,pCenterX + pRadius + 1,pCenterY + pRadius + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.FillCircle(pCenterX,pCenterY,pRadius,pRed,pGreen,pBlue,pAlpha,pMode);});
+}
+
+void DisplayList::DrawEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect bounds(pCenterX - pRadiusX,pCenterY - pRadiusY,pCenterX + pRadiusX + 1,pCenterY + pRadiusY + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.DrawEllipse(pCenterX,pCenterY,pRadiusX,pRadiusY,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::FillEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect bounds(pCenterX - pRadiusX,pCenterY - pRadiusY,pCenterX + pRadiusX + 1,pCenterY + pRadiusY + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.FillEllipse(pCenterX,pCenterY,pRadiusX,pRadiusY,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::FillEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode)
+{
+	const Rect bounds(pCenterX - pRadiusX,pCenterY - pRadiusY,pCenterX + pRadiusX + 1,pCenterY + pRadiusY + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.FillEllipse(pCenterX,pCenterY,pRadiusX,pRadiusY,pRed,pGreen,pBlue,pAlpha,pMode);});
+}
+
+void DisplayList::DrawArc(int pCenterX,int pCenterY,int pRadius,int pWidth,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	EllipseArcShape shape = MakeEllipseShape(pCenterX,pCenterY,pRadius,pRadius,pWidth);
+	if( pRadius < 1 || pWidth < 1 || !shape.SetWedge(pFromAngle,pToAngle) )
+		return;
+	Record(shape.GetBounds(0.0f),[=](DrawBuffer& pTile){pTile.DrawArc(pCenterX,pCenterY,pRadius,pWidth,pFromAngle,pToAngle,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::FillArc(int pCenterX,int pCenterY,int pRadius,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	EllipseArcShape shape = MakeEllipseShape(pCenterX,pCenterY,pRadius,pRadius,0);
+	if( pRadius < 1 || !shape.SetWedge(pFromAngle,pToAngle) )
+		return;
+	Record(shape.GetBounds(0.0f),[=](DrawBuffer& pTile){pTile.FillArc(pCenterX,pCenterY,pRadius,pFromAngle,pToAngle,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::DrawEllipseAA(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pRadiusX <= 0 || pRadiusY <= 0 || pWidth <= 0 )
+		return;
+	Record(MakeEllipseShapeAA(pCenterX,pCenterY,pRadiusX,pRadiusY,pWidth).GetBounds(1.0f),[=](DrawBuffer& pTile){pTile.DrawEllipseAA(pCenterX,pCenterY,pRadiusX,pRadiusY,pWidth,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::FillEllipseAA(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	if( pRadiusX <= 0 || pRadiusY <= 0 )
+		return;
+	Record(MakeEllipseShapeAA(pCenterX,pCenterY,pRadiusX,pRadiusY,0).GetBounds(1.0f),[=](DrawBuffer& pTile){pTile.FillEllipseAA(pCenterX,pCenterY,pRadiusX,pRadiusY,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::DrawArcAA(int pCenterX,int pCenterY,int pRadius,int pWidth,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	EllipseArcShape shape = MakeEllipseShapeAA(pCenterX,pCenterY,pRadius,pRadius,pWidth);
+	if( pRadius <= 0 || pWidth <= 0 || !shape.SetWedge(pFromAngle,pToAngle) )
+		return;
+	Record(shape.GetBounds(1.0f),[=](DrawBuffer& pTile){pTile.DrawArcAA(pCenterX,pCenterY,pRadius,pWidth,pFromAngle,pToAngle,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::FillArcAA(int pCenterX,int pCenterY,int pRadius,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	EllipseArcShape shape = MakeEllipseShapeAA(pCenterX,pCenterY,pRadius,pRadius,0);
+	if( pRadius <= 0 || !shape.SetWedge(pFromAngle,pToAngle) )
+		return;
+	Record(shape.GetBounds(1.0f),[=](DrawBuffer& pTile){pTile.FillArcAA(pCenterX,pCenterY,pRadius,pFromAngle,pToAngle,pRed,pGreen,pBlue,pAlpha);});
+}
+
+void DisplayList::DrawRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
 {
-	const uint8_t* src = mPixels.data() + (mStride * -pYDirection);	
-	uint8_t* dst = mPixels.data();
+	const Rect bounds(std::min(pFromX,pToX),std::min(pFromY,pToY),std::max(pFromX,pToX) + 1,std::max(pFromY,pToY) + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.DrawRectangle(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue,pAlpha);});
+}
 
-	const int numLines = mHeight - std::abs(pYDirection);
-	const int numBytes = (mWidth - (std::abs(pXDirection))) * mPixelSize;
+void DisplayList::FillRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect bounds(std::min(pFromX,pToX),std::min(pFromY,pToY),std::max(pFromX,pToX) + 1,std::max(pFromY,pToY) + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.FillRectangle(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue,pAlpha);});
+}
 
-	size_t stride = mStride;
-	if( pYDirection >= 0 )
-	{
-		stride = -stride;
-		dst += mLastlineOffset;
-		src += mLastlineOffset;
-	}
+void DisplayList::FillRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode)
+{
+	const Rect bounds(std::min(pFromX,pToX),std::min(pFromY,pToY),std::max(pFromX,pToX) + 1,std::max(pFromY,pToY) + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.FillRectangle(pFromX,pFromY,pToX,pToY,pRed,pGreen,pBlue,pAlpha,pMode);});
+}
 
-	if( pXDirection < 0 )
-	{
-		src += mPixelSize * -pXDirection;
-	}
-	else
+/**
+ * @brief The pixels a polygon with these fixed point points can fill.
+ */
+static Rect GetPolygonBounds(const std::array<int,2>* pPoints,size_t pNumPoints,Rect pBounds = Rect())
+{
+	for( size_t n = 0 ; n < pNumPoints ; n++ )
 	{
-		dst += mPixelSize * pXDirection;
+		const int x = pPoints[n][0] >> FIXED_POINT_SHIFT;
+		const int y = pPoints[n][1] >> FIXED_POINT_SHIFT;
+		pBounds = pBounds.Union(Rect(x,y,x + 2,y + 2));
 	}
+	return pBounds;
+}
 
-	// Now do the work.
-	for( int y = 0 ; y < numLines ; y++, src += stride, dst += stride )
-	{
-		AssertPixelIsInBuffer(src);
-		AssertPixelIsInBuffer(dst);
-
-		memcpy(dst,src,numBytes);
-	}
+void DisplayList::FillTriangle(int pX0,int pY0,int pX1,int pY1,int pX2,int pY2,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const std::array<int,2> points[3] = {{pX0,pY0},{pX1,pY1},{pX2,pY2}};
+	Record(GetPolygonBounds(points,3),[=](DrawBuffer& pTile){pTile.FillTriangle(pX0,pY0,pX1,pY1,pX2,pY2,pRed,pGreen,pBlue,pAlpha);});
+}
 
-	// Now fill in the area that has just been exposed.
+void DisplayList::FillConvexPolygon(const std::vector<std::array<int,2>>& pPoints,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	Record(GetPolygonBounds(pPoints.data(),pPoints.size()),[=](DrawBuffer& pTile){pTile.FillConvexPolygon(pPoints,pRed,pGreen,pBlue,pAlpha);});
+}
 
-	if( pYDirection > 0 )
-	{
-		FillRectangle(0,0,mWidth,pYDirection,pRedFill,pGreenFill,pBlueFill,pAlphaFill);
-	}
-	else if( pYDirection < 0 )
-	{
-		FillRectangle(0,mHeight + pYDirection,mWidth,mHeight,pRedFill,pGreenFill,pBlueFill,pAlphaFill);
-	}
+void DisplayList::FillPolygon(const std::vector<std::array<int,2>>& pPoints,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	Record(GetPolygonBounds(pPoints.data(),pPoints.size()),[=](DrawBuffer& pTile){pTile.FillPolygon(pPoints,pRule,pRed,pGreen,pBlue,pAlpha);});
+}
 
-	if( pXDirection > 0 )
-	{
-		FillRectangle(0,0,pXDirection,mHeight,pRedFill,pGreenFill,pGreenFill,pAlphaFill);
-	}
-	else if( pXDirection < 0 )
+void DisplayList::FillPolygon(const std::vector<std::vector<std::array<int,2>>>& pOutlines,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	Rect bounds;
+	for( const auto& outline : pOutlines )
 	{
-		FillRectangle(mWidth+pXDirection,0,mWidth,mHeight,		pRedFill,pGreenFill,pBlueFill,pAlphaFill);
+		bounds = GetPolygonBounds(outline.data(),outline.size(),bounds);
 	}
+	Record(bounds,[=](DrawBuffer& pTile){pTile.FillPolygon(pOutlines,pRule,pRed,pGreen,pBlue,pAlpha);});
+}
 
+void DisplayList::FillPath(const Path& pPath,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	Record(pPath.GetBounds(),[=](DrawBuffer& pTile){pTile.FillPath(pPath,pRule,pRed,pGreen,pBlue,pAlpha);});
 }
 
-void DrawBuffer::PreMultiplyAlpha()
+void DisplayList::FillPath(const Path& pPath,FillRule pRule,const LinearGradient& pPaint)
 {
-	assert( mPreMultipliedAlpha == false ); // Can't do this more than once!
-	assert( mHasAlpha ); // Has to have alpha data!
-	assert( (mPixels.size()&3) == 0 ); // Must be multiples for four bytes!
+	Record(pPath.GetBounds(),[=](DrawBuffer& pTile){pTile.FillPath(pPath,pRule,pPaint);});
+}
 
-	uint8_t* pixel = mPixels.data();
-	size_t pixelCount = mPixels.size()/4;
-	mPreMultipliedAlpha = true;
-	while( pixelCount-- )
-	{
-		AssertPixelIsInBuffer(pixel);
+void DisplayList::DrawRoundedRectangle(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	// On a thin rectangle the corners can reach outside it by up to the radius.
+	const int r = std::max(pRadius,0);
+	const Rect bounds(std::min(pFromX,pToX) - r,std::min(pFromY,pToY) - r,std::max(pFromX,pToX) + r + 1,std::max(pFromY,pToY) + r + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.DrawRoundedRectangle(pFromX,pFromY,pToX,pToY,pRadius,pRed,pGreen,pBlue,pAlpha);});
+}
 
-		const uint32_t A = pixel[3];
+void DisplayList::FillRoundedRectangle(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const int r = std::max(pRadius,0);
+	const Rect bounds(std::min(pFromX,pToX) - r,std::min(pFromY,pToY) - r,std::max(pFromX,pToX) + r + 1,std::max(pFromY,pToY) + r + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.FillRoundedRectangle(pFromX,pFromY,pToX,pToY,pRadius,pRed,pGreen,pBlue,pAlpha);});
+}
 
-		pixel[0] = (uint8_t)((pixel[0] * A)/255);
-		pixel[1] = (uint8_t)((pixel[1] * A)/255);
-		pixel[2] = (uint8_t)((pixel[2] * A)/255);
-		pixel[3] = 255 - A;
+void DisplayList::DrawRoundedRectangleAA(int pFromX,int pFromY,int pToX,int pToY,int pRadius,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect bounds(std::min(pFromX,pToX),std::min(pFromY,pToY),std::max(pFromX,pToX) + 1,std::max(pFromY,pToY) + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.DrawRoundedRectangleAA(pFromX,pFromY,pToX,pToY,pRadius,pWidth,pRed,pGreen,pBlue,pAlpha);});
+}
 
-		pixel += 4;
-	}
+void DisplayList::FillRoundedRectangleAA(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha)
+{
+	const Rect bounds(std::min(pFromX,pToX),std::min(pFromY,pToY),std::max(pFromX,pToX) + 1,std::max(pFromY,pToY) + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.FillRoundedRectangleAA(pFromX,pFromY,pToX,pToY,pRadius,pRed,pGreen,pBlue,pAlpha);});
 }
 
+void DisplayList::FillCheckerBoard(int pX,int pY,int pXCount,int pYCount,int pXSize,int pYSize,const uint8_t pRGBA[2][4])
+{
+	uint8_t RGBA[2][4];
+	memcpy(RGBA,pRGBA,sizeof(RGBA));
+	const Rect bounds(pX,pY,pX + (pXCount * pXSize),pY + (pYCount * pYSize));
+	Record(bounds,[=](DrawBuffer& pTile){pTile.FillCheckerBoard(pX,pY,pXCount,pYCount,pXSize,pYSize,RGBA);});
+}
 
-void DrawBuffer::DrawLineBresenham(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
+void DisplayList::DrawGradient(int pFromX,int pFromY,int pToX,int pToY,uint8_t pFormRed,uint8_t pFormGreen,uint8_t pFormBlue,uint8_t pToRed,uint8_t pToGreen,uint8_t pToBlue)
 {
-	// Deals with all 8 quadrants.
-	int deltax = pToX - pFromX;	// The difference between the x's
-	int deltay = pToY - pFromY;	// The difference between the y's	
-	int x = pFromX;				// Start x off at the first pixel
-	int y = pFromY;				// Start y off at the first pixel
-
-	int xinc1 = 1;
-	int xinc2 = 1;
-	int yinc1 = 1;
-	int yinc2 = 1;
-
-	if( deltax < 0 )
-	{// The x-values are decreasing
-		deltax = -deltax;
-		xinc1 = -1;
-		xinc2 = -1;
-	}
-
-	if( deltay < 0 )
-	{// The y-values are decreasing
-		deltay = -deltay;
-		yinc1 = -1;
-		yinc2 = -1;
-	}
-
-	int den,num,numadd,numpixels,curpixel;
-	if( deltax >= deltay )
-	{// There is at least one x-value for every y-value
-		xinc1 = 0;	// Don't change the x when numerator >= denominator
-		yinc2 = 0;	// Don't change the y for every iteration
-		den = deltax;
-		num = deltax>>1;
-		numadd = deltay;
-		numpixels = deltax;// There are more x-values than y-values
-	}
-	else
-	{ // There is at least one y-value for every x-value
-		xinc2 = 0;	// Don't change the x for every iteration
-		yinc1 = 0;	// Don't change the y when numerator >= denominator
-		den = deltay;
-		num = deltay>>1;
-		numadd = deltax;
-		numpixels = deltay;// There are more y-values than x-values
-	}
+	const Rect bounds(std::min(pFromX,pToX),std::min(pFromY,pToY),std::max(pFromX,pToX) + 1,std::max(pFromY,pToY) + 1);
+	Record(bounds,[=](DrawBuffer& pTile){pTile.DrawGradient(pFromX,pFromY,pToX,pToY,pFormRed,pFormGreen,pFormBlue,pToRed,pToGreen,pToBlue);});
+}
 
-	for( curpixel = 0 ; curpixel <= numpixels ; curpixel++ )
-	{
-		if( x > -1 && x < mWidth && y > -1 && y < mHeight )
-		{
-			WritePixel(x,y,pRed,pGreen,pBlue);
-		}
-		num += numadd;	// Increase the numerator by the top of the fraction
-		if (num >= den)	// Check if numerator >= denominator
-		{
-			num -= den;	// Calculate the new numerator value
-			x += xinc1;	// Change the x as appropriate
-			y += yinc1;	// Change the y as appropriate
-		}
-		x += xinc2;		// Change the x as appropriate
-		y += yinc2;		// Change the y as appropriate
-	}
+void DisplayList::Print(const PixelFont& pFont,int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,const std::string& pText)
+{
+	// The border can add a pixel to the left and top and two to the right and bottom.
+	const Rect bounds(pX - 1,pY - 1,pX + (pFont.GetCharWidth() * (int)pText.size()) + 2,pY + pFont.GetCharHeight() + 2);
+	const PixelFont font = pFont;
+	Record(bounds,[=](DrawBuffer& pTile){font.Print(pTile,pX,pY,pRed,pGreen,pBlue,pText);});
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1186,6 +6158,139 @@ struct X11FrameBufferEmulation
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 // FrameBuffer Implementation.
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief Finds the DrawBuffer pixel format that has the same memory layout as the display, if there is one.
+ */
+static bool GetPixelFormatFromScreenInfo(const struct fb_var_screeninfo& pScreenInfo,PixelFormat& rFormat)
+{
+	const bool is888 =	pScreenInfo.red.offset == 16 && pScreenInfo.red.length == 8 &&
+						pScreenInfo.green.offset == 8 && pScreenInfo.green.length == 8 &&
+						pScreenInfo.blue.offset == 0 && pScreenInfo.blue.length == 8;
+
+	const bool is565 =	pScreenInfo.red.offset == 11 && pScreenInfo.red.length == 5 &&
+						pScreenInfo.green.offset == 5 && pScreenInfo.green.length == 6 &&
+						pScreenInfo.blue.offset == 0 && pScreenInfo.blue.length == 5;
+
+	const bool isBGR565 =	pScreenInfo.red.offset == 0 && pScreenInfo.red.length == 5 &&
+							pScreenInfo.green.offset == 5 && pScreenInfo.green.length == 6 &&
+							pScreenInfo.blue.offset == 11 && pScreenInfo.blue.length == 5;
+
+	if( pScreenInfo.bits_per_pixel == 32 && is888 )
+	{
+		rFormat = PIXEL_FORMAT_BGRX8888;
+		return true;
+	}
+
+	if( pScreenInfo.bits_per_pixel == 24 && is888 )
+	{
+		rFormat = PIXEL_FORMAT_BGR888;
+		return true;
+	}
+
+	if( pScreenInfo.bits_per_pixel == 16 && is565 )
+	{
+		rFormat = PIXEL_FORMAT_RGB565;
+		return true;
+	}
+
+	if( pScreenInfo.bits_per_pixel == 16 && isBGR565 )
+	{
+		rFormat = PIXEL_FORMAT_BGR565;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Writes pixels to a 16 bit display using the bit positions the driver gave us.
+ */
+struct DisplayWriter16
+{
+	const uint32_t mRedShift,mGreenShift,mBlueShift;
+
+	DisplayWriter16(const struct fb_var_screeninfo& pScreenInfo):
+		mRedShift(pScreenInfo.red.offset),
+		mGreenShift(pScreenInfo.green.offset),
+		mBlueShift(pScreenInfo.blue.offset)
+	{
+	}
+
+	inline void Write(uint8_t* pPixel,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)const
+	{
+		const uint16_t rgb = ((pRed >> 3) << mRedShift) | ((pGreen >> 2) << mGreenShift) | ((pBlue >> 3) << mBlueShift);
+		memcpy(pPixel,&rgb,sizeof(rgb));
+	}
+};
+
+/**
+ * @brief Writes pixels to a 24 or 32 bit display using the byte positions the driver gave us.
+ */
+struct DisplayWriter888
+{
+	const size_t mRedOffset,mGreenOffset,mBlueOffset;
+
+	DisplayWriter888(const struct fb_var_screeninfo& pScreenInfo):
+		mRedOffset(pScreenInfo.red.offset/8),
+		mGreenOffset(pScreenInfo.green.offset/8),
+		mBlueOffset(pScreenInfo.blue.offset/8)
+	{
+	}
+
+	inline void Write(uint8_t* pPixel,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)const
+	{
+		pPixel[mRedOffset] = pRed;
+		pPixel[mGreenOffset] = pGreen;
+		pPixel[mBlueOffset] = pBlue;
+	}
+};
+
+/**
+ * @brief Converts an area of the draw buffer to the display format, pixel by pixel.
+ * pDisplay is where the top left pixel of the area goes.
+ * pXStep and pYStep are the byte distances in the display for one pixel step in the image, this is what does the rotation.
+ */
+template<class FORMAT,class WRITER> static void ConvertToDisplay(const DrawBuffer& pImage,const Rect& pArea,const WRITER& pWriter,uint8_t* pDisplay,ptrdiff_t pXStep,ptrdiff_t pYStep)
+{
+	const int width = pArea.GetWidth();
+	for( int y = pArea.top ; y < pArea.bottom ; y++, pDisplay += pYStep )
+	{
+		const uint8_t* src = pImage.GetPixelAddress(pArea.left,y);
+		uint8_t* dst = pDisplay;
+		for( int x = 0 ; x < width ; x++, src += FORMAT::PIXEL_SIZE, dst += pXStep )
+		{
+			uint8_t r,g,b,a;
+			FORMAT::Unpack(FORMAT::Read(src),r,g,b,a);
+			pWriter.Write(dst,r,g,b);
+		}
+	}
+}
+
+/**
+ * @brief Used when the image is already in the display's pixel format but can't be one memcpy, rotated, a different stride or only part of it.
+ * Pixels are moved as they are, no unpacking. When not rotated each row is a memcpy.
+ */
+template<class FORMAT> static void CopyToDisplay(const DrawBuffer& pImage,const Rect& pArea,uint8_t* pDisplay,ptrdiff_t pXStep,ptrdiff_t pYStep)
+{
+	const int width = pArea.GetWidth();
+	for( int y = pArea.top ; y < pArea.bottom ; y++, pDisplay += pYStep )
+	{
+		const uint8_t* src = pImage.GetPixelAddress(pArea.left,y);
+		if( pXStep == FORMAT::PIXEL_SIZE )
+		{
+			memcpy(pDisplay,src,width * FORMAT::PIXEL_SIZE);
+		}
+		else
+		{
+			uint8_t* dst = pDisplay;
+			for( int x = 0 ; x < width ; x++, src += FORMAT::PIXEL_SIZE, dst += pXStep )
+			{
+				FORMAT::Write(dst,FORMAT::Read(src));
+			}
+		}
+	}
+}
+
 FrameBuffer* FrameBuffer::Open(int pCreationFlags)
 {
 	FrameBuffer* newFrameBuffer = NULL;
@@ -1274,6 +6379,7 @@ FrameBuffer::FrameBuffer(int pFile,uint8_t* pDisplayBuffer,struct fb_fix_screeni
 	mDisplayBufferStride(pFixInfo.line_length),
 	mDisplayBufferPixelSize(pScreenInfo.bits_per_pixel/8),
 	mDisplayBufferSize(pFixInfo.smem_len),
+	mDisplayVisibleSize(std::min((size_t)pFixInfo.smem_len,((size_t)pFixInfo.line_length * (pScreenInfo.yres - 1)) + (pScreenInfo.xres * (pScreenInfo.bits_per_pixel/8)))),
 	mDisplayBufferFile(pFile),
 	mDisplayBuffer(pDisplayBuffer),
 
@@ -1283,6 +6389,12 @@ FrameBuffer::FrameBuffer(int pFile,uint8_t* pDisplayBuffer,struct fb_fix_screeni
 {
 	FrameBuffer::mKeepGoing = true;
 
+	mHasNativePixelFormat = GetPixelFormatFromScreenInfo(mVariableScreenInfo,mNativePixelFormat);
+	if( mVerbose )
+	{
+		std::clog << (mHasNativePixelFormat ? "Display has a native draw buffer pixel format\n" : "Display has no native draw buffer pixel format, present will convert\n");
+	}
+
 	// Lets hook ctrl + c.
 	mUsersSignalAction = signal(SIGINT,CtrlHandler);
 
@@ -1340,203 +6452,124 @@ void FrameBuffer::OnApplicationExitRequest()
 	}
 }
 
-void FrameBuffer::Present(const DrawBuffer& pImage)
-{
 #ifdef NDEBUG
 	#define DBG_REPORT_PRESENT_SPEED(MESSAGE__){}
 #else
 	#define DBG_REPORT_PRESENT_SPEED(MESSAGE__)if( mVerbose && mReportedPresentSpeed == false ){mReportedPresentSpeed = true;std::clog << MESSAGE__;}
 #endif
 
-
-	// When optimized by compiler these const vars will
-	// all move to generate the same code as if I made it all one line and unreadable!
-	// Trust your optimizer. :)
-	const size_t RedShift = mVariableScreenInfo.red.offset;
-	const size_t GreenShift = mVariableScreenInfo.green.offset;
-	const size_t BlueShift = mVariableScreenInfo.blue.offset;
-
+void FrameBuffer::Present(const DrawBuffer& pImage)
+{
 	if( GetIsNativeFormat(pImage) )
 	{// Early out...
 		DBG_REPORT_PRESENT_SPEED("Optimal frame buffer copy mode taken\n");
 
-		// Copy mDisplayBufferSize bytes, not the number of source, then we can't over flow what we have to write to.
-		memcpy(mDisplayBuffer,pImage.mPixels.data(),mDisplayBufferSize);
+		// Copy only what is on screen, not the number of source bytes, then we can't over flow what we have to write to.
+		memcpy(mDisplayBuffer,pImage.GetPixelAddress(0,0),mDisplayVisibleSize);
 	}
-	else if( mDisplayBufferPixelSize == 2 )
+	else
 	{
-		DBG_REPORT_PRESENT_SPEED("Slow 16Bit frame buffer copy mode taken\n");
-		u_int8_t* dst = (u_int8_t*)(mDisplayBuffer);
-		const u_int8_t* src = pImage.mPixels.data();
-		switch( mRotation )
-		{
-		case FRAME_BUFFER_ROTATION_0:
-			for( int y = 0 ; y < mHeight ; y++, dst += mDisplayBufferStride )
-			{
-				for( int x = 0 ; x < mWidth ; x++, src += pImage.GetPixelSize() )
-				{
-					const uint16_t b = src[BLUE_PIXEL_INDEX] >> 3;
-					const uint16_t g = src[GREEN_PIXEL_INDEX] >> 2;
-					const uint16_t r = src[RED_PIXEL_INDEX] >> 3;
-
-					const uint16_t pixel = (r << RedShift) | (g << GreenShift) | (b << BlueShift);
-
-					assert( (y*mDisplayBufferStride) + x < mDisplayBufferSize );
-
-					((uint16_t*)dst)[x] = pixel;
-				}
-			}
-			break;
+		PresentRect(pImage,Rect(0,0,pImage.GetWidth(),pImage.GetHeight()));
+	}
 
-		case FRAME_BUFFER_ROTATION_90:
-			for( int y = 0 ; y < mWidth ; y++ )
-			{
-				u_int8_t* pixel = dst + (y*(mDisplayBufferPixelSize)) + (mDisplayBufferStride*(mHeight-1));
-				src = pImage.mPixels.data() + (pImage.GetStride()*(mWidth-y));
-				for( int x = 0 ; x < mHeight ; x++, src -= pImage.GetPixelSize(), pixel -= mDisplayBufferStride )
-				{
-					const uint16_t b = src[BLUE_PIXEL_INDEX] >> 3;
-					const uint16_t g = src[GREEN_PIXEL_INDEX] >> 2;
-					const uint16_t r = src[RED_PIXEL_INDEX] >> 3;
+	// Now do event processing.
+	ProcessSystemEvents();
+}
 
-					const uint16_t rgb = (r << RedShift) | (g << GreenShift) | (b << BlueShift);
+void FrameBuffer::Present(DrawBuffer& pImage)
+{
+	if( pImage.GetTrackDirtyRects() == false )
+	{
+		Present((const DrawBuffer&)pImage);
+		return;
+	}
 
-					assert( (y*mDisplayBufferStride) + x < mDisplayBufferSize );
+	for( const Rect& rect : pImage.GetDirtyRects() )
+	{
+		PresentRect(pImage,rect);
+	}
+	pImage.ClearDirtyRects();
 
-					*((uint16_t*)pixel) = rgb;
-				}
-			}
-			break;
+	// Now do event processing.
+	ProcessSystemEvents();
+}
 
-		case FRAME_BUFFER_ROTATION_180:
-			dst += mDisplayBufferSize - (mDisplayBufferPixelSize*1);
-			for( int y = 0 ; y < mHeight ; y++, dst -= mDisplayBufferStride )
-			{
-				u_int8_t* pixel = dst;
-				for( int x = 0 ; x < mWidth ; x++, src += pImage.GetPixelSize(), pixel -= mDisplayBufferPixelSize )
-				{
-					const uint16_t b = src[BLUE_PIXEL_INDEX] >> 3;
-					const uint16_t g = src[GREEN_PIXEL_INDEX] >> 2;
-					const uint16_t r = src[RED_PIXEL_INDEX] >> 3;
+void FrameBuffer::PresentRect(const DrawBuffer& pImage,const Rect& pRect)
+{
+	// Only the part of the image that is on the display.
+	const Rect area = pRect.Intersect(Rect(0,0,std::min(GetWidth(),pImage.GetWidth()),std::min(GetHeight(),pImage.GetHeight())));
+	if( area.GetIsEmpty() )
+		return;
 
-					const uint16_t rgb = (r << RedShift) | (g << GreenShift) | (b << BlueShift);
+	// Work out where the first pixel goes and how far to move in the display for each step in x and y of the image.
+	// Rotation is then just different values for these.
+	const ptrdiff_t stride = mDisplayBufferStride;
+	const ptrdiff_t pixelSize = mDisplayBufferPixelSize;
+	ptrdiff_t firstPixel = 0;
+	ptrdiff_t xStep = pixelSize;
+	ptrdiff_t yStep = stride;
+	switch( mRotation )
+	{
+	case FRAME_BUFFER_ROTATION_0:
+		break;
 
-					assert( (y*mDisplayBufferStride) + x < mDisplayBufferSize );
+	case FRAME_BUFFER_ROTATION_90:
+		firstPixel = (mWidth - 1) * pixelSize;
+		xStep = stride;
+		yStep = -pixelSize;
+		break;
 
-					*((uint16_t*)pixel) = rgb;
-				}
-			}
-			break;
+	case FRAME_BUFFER_ROTATION_180:
+		firstPixel = ((mWidth - 1) * pixelSize) + ((mHeight - 1) * stride);
+		xStep = -pixelSize;
+		yStep = -stride;
+		break;
 
-		case FRAME_BUFFER_ROTATION_270:
-			for( int y = 0 ; y < mWidth ; y++ )
-			{
-				u_int8_t* pixel = dst + (y*(mDisplayBufferPixelSize)) + (mDisplayBufferStride*(mHeight-1));
-				src = pImage.mPixels.data() + (pImage.GetStride()*y);
-				for( int x = 0 ; x < mHeight ; x++, src += pImage.GetPixelSize(), pixel -= mDisplayBufferStride )
-				{
-					const uint16_t b = src[BLUE_PIXEL_INDEX] >> 3;
-					const uint16_t g = src[GREEN_PIXEL_INDEX] >> 2;
-					const uint16_t r = src[RED_PIXEL_INDEX] >> 3;
+	case FRAME_BUFFER_ROTATION_270:
+		firstPixel = (mHeight - 1) * stride;
+		xStep = -stride;
+		yStep = pixelSize;
+		break;
+	}
 
-					const uint16_t rgb = (r << RedShift) | (g << GreenShift) | (b << BlueShift);
+	uint8_t* dst = mDisplayBuffer + firstPixel + (area.left * xStep) + (area.top * yStep);
 
-					assert( (y*mDisplayBufferStride) + x < mDisplayBufferSize );
+	// Each band of rows goes to it's own part of the display, so they can be done on different threads.
+	auto presentRows = [&](const auto& pPresent)
+	{
+		ForRows(mJobs,area,[&](int pFromY,int pToY)
+		{
+			pPresent(Rect(area.left,pFromY,area.right,pToY),dst + ((pFromY - area.top) * yStep));
+		});
+	};
 
-					*((uint16_t*)pixel) = rgb;
-				}
-			}
-			break;
-		}
+	if( GetIsNativePixelFormat(pImage.GetPixelFormat()) )
+	{
+		DBG_REPORT_PRESENT_SPEED("Native pixel format copy mode taken\n");
+		DispatchPixelFormat(pImage.GetPixelFormat(),[&](auto pFormat)
+		{
+			presentRows([&](const Rect& pRows,uint8_t* pDisplay){CopyToDisplay<decltype(pFormat)>(pImage,pRows,pDisplay,xStep,yStep);});
+		});
+	}
+	else if( mDisplayBufferPixelSize == 2 )
+	{
+		DBG_REPORT_PRESENT_SPEED("Slow 16Bit frame buffer copy mode taken\n");
+		const DisplayWriter16 writer(mVariableScreenInfo);
+		DispatchPixelFormat(pImage.GetPixelFormat(),[&](auto pFormat)
+		{
+			presentRows([&](const Rect& pRows,uint8_t* pDisplay){ConvertToDisplay<decltype(pFormat)>(pImage,pRows,writer,pDisplay,xStep,yStep);});
+		});
 	}
 	else
 	{
 		DBG_REPORT_PRESENT_SPEED("Sub optimal scanline frame buffer copy mode taken\n");
-
-		const size_t RED_OFFSET = (RedShift/8);
-		const size_t GREEN_OFFSET = (GreenShift/8);
-		const size_t BLUE_OFFSET = (BlueShift/8);
-
 		assert( mDisplayBufferPixelSize == 3 || mDisplayBufferPixelSize == 4 );
-		u_int8_t* dst = mDisplayBuffer;
-		const u_int8_t* src = pImage.mPixels.data();
-
-		switch( mRotation )
+		const DisplayWriter888 writer(mVariableScreenInfo);
+		DispatchPixelFormat(pImage.GetPixelFormat(),[&](auto pFormat)
 		{
-		case FRAME_BUFFER_ROTATION_0:
-			for( int y = 0 ; y < mHeight ; y++, dst += mDisplayBufferStride )
-			{
-				u_int8_t* pixel = dst;
-				for( int x = 0 ; x < mWidth ; x++, src += pImage.GetPixelSize(), pixel += mDisplayBufferPixelSize )
-				{
-					assert( pixel + RED_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-					assert( pixel + GREEN_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-					assert( pixel + BLUE_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-
-					pixel[ BLUE_OFFSET ]	= src[0];
-					pixel[ GREEN_OFFSET ]	= src[1];
-					pixel[ RED_OFFSET ]		= src[2];
-				}
-			}
-			break;
-
-		case FRAME_BUFFER_ROTATION_90:
-			for( int y = 0 ; y < mWidth ; y++ )
-			{
-				u_int8_t* pixel = dst + (y*(mDisplayBufferPixelSize)) + (mDisplayBufferStride*(mHeight-1));
-				src = pImage.mPixels.data() + (pImage.GetStride()*(mWidth-y));
-				for( int x = 0 ; x < mHeight ; x++, src -= pImage.GetPixelSize(), pixel -= mDisplayBufferStride )
-				{
-					assert( pixel + RED_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-					assert( pixel + GREEN_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-					assert( pixel + BLUE_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-
-					pixel[ BLUE_OFFSET ]	= src[0];
-					pixel[ GREEN_OFFSET ]	= src[1];
-					pixel[ RED_OFFSET ]		= src[2];
-				}
-			}
-			break;
-
-		case FRAME_BUFFER_ROTATION_180:
-			dst += mDisplayBufferSize - (mDisplayBufferPixelSize*1);
-			for( int y = 0 ; y < mHeight ; y++, dst -= mDisplayBufferStride )
-			{
-				u_int8_t* pixel = dst;
-				for( int x = 0 ; x < mWidth ; x++, src += pImage.GetPixelSize(), pixel -= mDisplayBufferPixelSize )
-				{
-					assert( pixel + RED_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-					assert( pixel + GREEN_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-					assert( pixel + BLUE_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-
-					pixel[ BLUE_OFFSET ]	= src[0];
-					pixel[ GREEN_OFFSET ]	= src[1];
-					pixel[ RED_OFFSET ]		= src[2];
-				}
-			}
-			break;
-
-		case FRAME_BUFFER_ROTATION_270:
-			for( int y = 0 ; y < mWidth ; y++ )
-			{
-				u_int8_t* pixel = dst + (y*(mDisplayBufferPixelSize)) + (mDisplayBufferStride*(mHeight-1));
-				src = pImage.mPixels.data() + (pImage.GetStride()*y);
-				for( int x = 0 ; x < mHeight ; x++, src += pImage.GetPixelSize(), pixel -= mDisplayBufferStride )
-				{
-					assert( pixel + RED_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-					assert( pixel + GREEN_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-					assert( pixel + BLUE_OFFSET < mDisplayBuffer + mDisplayBufferSize );
-
-					pixel[ BLUE_OFFSET ]	= src[0];
-					pixel[ GREEN_OFFSET ]	= src[1];
-					pixel[ RED_OFFSET ]		= src[2];
-				}
-			}
-			break;		}
+			presentRows([&](const Rect& pRows,uint8_t* pDisplay){ConvertToDisplay<decltype(pFormat)>(pImage,pRows,writer,pDisplay,xStep,yStep);});
+		});
 	}
-
-	// Now do event processing.
-	ProcessSystemEvents();
 }
 
 void FrameBuffer::ProcessSystemEvents()
@@ -2165,22 +7198,36 @@ void PixelFont::DrawChar(DrawBuffer& pDest,int pX,int pY,uint8_t pRed,uint8_t pG
 			}
 		}
 
-		const uint8_t* d = charBits;
-		for(int y = 0 ; y < 13 ; y++ , d++)
+		// Written direct, not with WritePixel, so the dirty rects and opacity tiles are updated once for the char and not per pixel.
+		const Rect bounds(pX,pY,pX + 8,pY + 13);
+		DispatchPixelFormat(pDest.GetPixelFormat(),[&](auto pFormat)
 		{
-			int x = pX;
-			const uint8_t bits = *d;
-			if( bits != 0 )
+			typedef decltype(pFormat) FORMAT;
+			const typename FORMAT::PixelType pixel = FORMAT::Pack(pRed,pGreen,pBlue,255);
+			DispatchClipped(pDest.GetClipRect(),bounds,[&](auto pClipped)
 			{
-				for( int bit = 7 ; bit > -1 ; bit-- , x++ )
+				typedef decltype(pClipped) CLIPPED;
+				const uint8_t* d = charBits;
+				for(int y = 0 ; y < 13 ; y++ , d++)
 				{
-					if( bits&(1<<bit) )
+					int x = pX;
+					const uint8_t bits = *d;
+					if( bits != 0 )
 					{
-						pDest.WritePixel(x,pY + y,pRed,pGreen,pBlue);
+						for( int bit = 7 ; bit > -1 ; bit-- , x++ )
+						{
+							if( bits&(1<<bit) )
+							{
+								PlotPixel<FORMAT,CLIPPED>(pDest,x,pY + y,pixel);
+							}
+						}
 					}
 				}
-			}
-		}
+			});
+		});
+		const Rect drawn = bounds.Intersect(pDest.GetClipRect());
+		pDest.AddDirtyRect(drawn);
+		pDest.ForgetOpacityTiles(drawn);
 	}
 	else
 	{
@@ -2457,32 +7504,45 @@ int FreeTypeFont::DrawChar(DrawBuffer& pDest,int pX,int pY,char pChar)const
 	//  empty pixels. bitmap.width is the number of pixels that actually
 	//  contain values; bitmap.pitch is the spacing between bitmap
 	//  rows in memory.
-	const uint8_t* src = mFace->glyph->bitmap.buffer;
-	for (int i = 0; i < (int)mFace->glyph->bitmap.rows; i++ , src += mFace->glyph->bitmap.pitch )
+	// Written direct, not with WritePixel, so the dirty rects and opacity tiles are updated once for the glyph and not per pixel.
+	const Rect bounds(pX + x_off,pY + y_off,pX + x_off + (int)mFace->glyph->bitmap.width,pY + y_off + (int)mFace->glyph->bitmap.rows);
+	DispatchPixelFormat(pDest.GetPixelFormat(),[&](auto pFormat)
 	{
-		// Row offset is the distance from the top of the framebuffer
-		//  of this particular row of pixels in the glyph.
-		int row_offset = pY + i + y_off;
-		for (int j = 0; j < (int)mFace->glyph->bitmap.width; j++ )
+		typedef decltype(pFormat) FORMAT;
+		DispatchClipped(pDest.GetClipRect(),bounds,[&](auto pClipped)
 		{
-			const uint8_t p = src[j];
+			typedef decltype(pClipped) CLIPPED;
+			const uint8_t* src = mFace->glyph->bitmap.buffer;
+			for (int i = 0; i < (int)mFace->glyph->bitmap.rows; i++ , src += mFace->glyph->bitmap.pitch )
+			{
+				// Row offset is the distance from the top of the framebuffer
+				//  of this particular row of pixels in the glyph.
+				int row_offset = pY + i + y_off;
+				for (int j = 0; j < (int)mFace->glyph->bitmap.width; j++ )
+				{
+					const uint8_t p = src[j];
 
-			// Working out the Y position is a little fiddly. horiBearingY 
-			//  is how far the glyph extends about the baseline. We push
-			//  the bitmap down by the height of the bounding box, and then
-			//  back up by this "bearing" value.
+					// Working out the Y position is a little fiddly. horiBearingY 
+					//  is how far the glyph extends about the baseline. We push
+					//  the bitmap down by the height of the bounding box, and then
+					//  back up by this "bearing" value.
 
-			// As I am not blending against the background I have to do this test.
-			// Otherwise we state to crop previous letters.
-			// Should really be blending agaist the background. But that is slow.... Richard.
-			if( p > 0 )
-			{
-				const int pixelX = pX + j + x_off;
-				const int pixelY = row_offset;
-				pDest.WritePixel(pixelX,pixelY, mBlended[p].r, mBlended[p].g, mBlended[p].b);
+					// As I am not blending against the background I have to do this test.
+					// Otherwise we state to crop previous letters.
+					// Should really be blending agaist the background. But that is slow.... Richard.
+					if( p > 0 )
+					{
+						const int pixelX = pX + j + x_off;
+						const int pixelY = row_offset;
+						PlotPixel<FORMAT,CLIPPED>(pDest,pixelX,pixelY,FORMAT::Pack(mBlended[p].r,mBlended[p].g,mBlended[p].b,255));
+					}
+				}
 			}
-		}
-	}
+		});
+	});
+	const Rect drawn = bounds.Intersect(pDest.GetClipRect());
+	pDest.AddDirtyRect(drawn);
+	pDest.ForgetOpacityTiles(drawn);
 	// horiAdvance is the nominal X spacing between displayed glyphs. 
 	return pX + advance;
 }
@@ -20,10 +20,20 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <array>
 
 #include <assert.h>
 #include <signal.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 
 #include <linux/fb.h>
@@ -56,6 +66,20 @@
 	#include FT_FREETYPE_H
 #endif
 
+/**
+ * @brief Define USE_HUGE_PAGES to have large pixel buffers, 2MB and up so about a full screen, asked to be backed by huge pages. (madvise MADV_HUGEPAGE)
+ * Cuts down TLB misses when reading and writing a big image. Needs transparent huge pages enabled in the kernel, else it does nothing.
+ * Costs up to 2MB of address space per large buffer for the alignment. Off by default as small boards don't have memory to spare.
+ */
+//#define USE_HUGE_PAGES
+
+/**
+ * @brief Define USE_NON_TEMPORAL_FILLS to have Clear and FillRectangle write areas bigger than the cache with streaming stores. (SSE2 only)
+ * Stops a full screen clear pushing everything else out of the cache. Off by default as the pixels are often drawn over straight after,
+ * when it's better they are still in the cache. On NEON there is no equivalent so normal stores are used.
+ */
+//#define USE_NON_TEMPORAL_FILLS
+
 namespace tiny2d{	// Using a namespace to try to prevent name clashes as my class name is kind of obvious. :)
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -89,6 +113,10 @@ extern void TweenColoursRGB(uint8_t pFromRed,uint8_t pFromGreen, uint8_t pFromBl
 	
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 class FrameBuffer;
+class DrawBuffer;
+class SpanSprite;
+class PixelFont;
+class JobSystem;
 
 // This define allows me to play with the colour order of the offscreen buffer without having to keep search the source.
 // This is only to do with the format of the data in the buffer. Not RGB buffers passed in. These are always r[0],g[1]],b[2].
@@ -105,6 +133,413 @@ class FrameBuffer;
 	PIXEL_BUFFER[ BLUE_PIXEL_INDEX ] = BLUE_VALUE;							\
 }
 
+/**
+ * @brief The packed pixel formats below are read and written as native 16 / 32 bit values.
+ * That matches the byte order of the linux frame buffer on little endian CPUs, which is all the PI's and x86.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+	#error "Tiny2D pixel formats expect a little endian CPU."
+#endif
+
+/**
+ * @brief The layout of the pixels held in a DrawBuffer.
+ * The eight bit per channel formats all keep the B G R byte order of the linux frame buffer. See RED_PIXEL_INDEX.
+ */
+enum PixelFormat
+{
+	PIXEL_FORMAT_BGR888,	//!< Three bytes per pixel, no alpha. The original, and default, format.
+	PIXEL_FORMAT_BGRX8888,	//!< Four bytes per pixel, the fourth byte is not used and is written as 255. Same as most 32 bit displays.
+	PIXEL_FORMAT_BGRA8888,	//!< Four bytes per pixel with alpha. What images with transparency are held in.
+	PIXEL_FORMAT_RGB565,	//!< Two bytes per pixel, five bits of red in the top bits, six of green then five of blue. No alpha.
+	PIXEL_FORMAT_BGR565,	//!< Two bytes per pixel, five bits of blue in the top bits, six of green then five of red. Some SPI panels are wired this way.
+	PIXEL_FORMAT_A8			//!< One byte per pixel, alpha only. Reads back as black with that alpha. For masks and coverage.
+};
+
+/**
+ * @brief Compile time descriptions of each PixelFormat.
+ * The drawing code is written once as templates using these and DrawBuffer picks the right one once per call,
+ * so the per pixel code is just the stores for that format with no tests.
+ * Pack and Unpack convert to and from eight bit channels. Read and Write move a packed pixel in and out of memory.
+ * Alpha is ignored by Pack for formats without it, and Unpack returns 255 for them.
+ */
+struct PixelFormatBGR888
+{
+	typedef uint32_t PixelType;
+	static constexpr PixelFormat FORMAT = PIXEL_FORMAT_BGR888;
+	static constexpr size_t PIXEL_SIZE = 3;
+	static constexpr bool HAS_ALPHA = false;
+
+	static inline PixelType Pack(uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t){return (pRed << 16) | (pGreen << 8) | pBlue;}
+	static inline void Unpack(PixelType pPixel,uint8_t& rRed,uint8_t& rGreen,uint8_t& rBlue,uint8_t& rAlpha){rRed = pPixel >> 16;rGreen = pPixel >> 8;rBlue = pPixel;rAlpha = 255;}
+	static inline PixelType Read(const uint8_t* pPixel){return (pPixel[RED_PIXEL_INDEX] << 16) | (pPixel[GREEN_PIXEL_INDEX] << 8) | pPixel[BLUE_PIXEL_INDEX];}
+	static inline void Write(uint8_t* pPixel,PixelType pValue){WRITE_RGB_TO_PIXEL(pPixel,(uint8_t)(pValue >> 16),(uint8_t)(pValue >> 8),(uint8_t)pValue);}
+};
+
+struct PixelFormatBGRX8888
+{
+	typedef uint32_t PixelType;
+	static constexpr PixelFormat FORMAT = PIXEL_FORMAT_BGRX8888;
+	static constexpr size_t PIXEL_SIZE = 4;
+	static constexpr bool HAS_ALPHA = false;
+
+	static inline PixelType Pack(uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t){return 0xff000000 | (pRed << 16) | (pGreen << 8) | pBlue;}
+	static inline void Unpack(PixelType pPixel,uint8_t& rRed,uint8_t& rGreen,uint8_t& rBlue,uint8_t& rAlpha){rRed = pPixel >> 16;rGreen = pPixel >> 8;rBlue = pPixel;rAlpha = 255;}
+	static inline PixelType Read(const uint8_t* pPixel){PixelType v;memcpy(&v,pPixel,sizeof(v));return v;}
+	static inline void Write(uint8_t* pPixel,PixelType pValue){memcpy(pPixel,&pValue,sizeof(pValue));}
+};
+
+struct PixelFormatBGRA8888
+{
+	typedef uint32_t PixelType;
+	static constexpr PixelFormat FORMAT = PIXEL_FORMAT_BGRA8888;
+	static constexpr size_t PIXEL_SIZE = 4;
+	static constexpr bool HAS_ALPHA = true;
+
+	static inline PixelType Pack(uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha){return (pAlpha << 24) | (pRed << 16) | (pGreen << 8) | pBlue;}
+	static inline void Unpack(PixelType pPixel,uint8_t& rRed,uint8_t& rGreen,uint8_t& rBlue,uint8_t& rAlpha){rRed = pPixel >> 16;rGreen = pPixel >> 8;rBlue = pPixel;rAlpha = pPixel >> 24;}
+	static inline PixelType Read(const uint8_t* pPixel){PixelType v;memcpy(&v,pPixel,sizeof(v));return v;}
+	static inline void Write(uint8_t* pPixel,PixelType pValue){memcpy(pPixel,&pValue,sizeof(pValue));}
+};
+
+/**
+ * @brief The two sixteen bit layouts only differ in which end red and blue go, so share the code.
+ */
+template<PixelFormat FORMAT_,int RED_SHIFT,int BLUE_SHIFT> struct PixelFormat565
+{
+	typedef uint16_t PixelType;
+	static constexpr PixelFormat FORMAT = FORMAT_;
+	static constexpr size_t PIXEL_SIZE = 2;
+	static constexpr bool HAS_ALPHA = false;
+
+	static inline PixelType Pack(uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t){return ((pRed >> 3) << RED_SHIFT) | ((pGreen >> 2) << 5) | ((pBlue >> 3) << BLUE_SHIFT);}
+	static inline void Unpack(PixelType pPixel,uint8_t& rRed,uint8_t& rGreen,uint8_t& rBlue,uint8_t& rAlpha)
+	{// Replicate the top bits into the bottom so full on stays full on.
+		const uint8_t r = (pPixel >> RED_SHIFT) & 0x1f;
+		const uint8_t g = (pPixel >> 5) & 0x3f;
+		const uint8_t b = (pPixel >> BLUE_SHIFT) & 0x1f;
+		rRed = (r << 3) | (r >> 2);
+		rGreen = (g << 2) | (g >> 4);
+		rBlue = (b << 3) | (b >> 2);
+		rAlpha = 255;
+	}
+	static inline PixelType Read(const uint8_t* pPixel){PixelType v;memcpy(&v,pPixel,sizeof(v));return v;}
+	static inline void Write(uint8_t* pPixel,PixelType pValue){memcpy(pPixel,&pValue,sizeof(pValue));}
+};
+
+struct PixelFormatRGB565 : public PixelFormat565<PIXEL_FORMAT_RGB565,11,0>{};
+struct PixelFormatBGR565 : public PixelFormat565<PIXEL_FORMAT_BGR565,0,11>{};
+
+struct PixelFormatA8
+{
+	typedef uint8_t PixelType;
+	static constexpr PixelFormat FORMAT = PIXEL_FORMAT_A8;
+	static constexpr size_t PIXEL_SIZE = 1;
+	static constexpr bool HAS_ALPHA = true;
+
+	static inline PixelType Pack(uint8_t,uint8_t,uint8_t,uint8_t pAlpha){return pAlpha;}
+	static inline void Unpack(PixelType pPixel,uint8_t& rRed,uint8_t& rGreen,uint8_t& rBlue,uint8_t& rAlpha){rRed = rGreen = rBlue = 0;rAlpha = pPixel;}
+	static inline PixelType Read(const uint8_t* pPixel){return *pPixel;}
+	static inline void Write(uint8_t* pPixel,PixelType pValue){*pPixel = pValue;}
+};
+
+/**
+ * @brief Calls pFunction with a default constructed object of the PixelFormatXXXX type for pFormat.
+ * This is how the type erased DrawBuffer gets to the compile time code, one switch per call and not one per pixel.
+ * Use with a generic lambda. [&](auto pFormat){typedef decltype(pFormat) FORMAT; ....}
+ */
+template<class FUNCTION> inline void DispatchPixelFormat(PixelFormat pFormat,FUNCTION&& pFunction)
+{
+	switch( pFormat )
+	{
+	case PIXEL_FORMAT_BGR888:
+		pFunction(PixelFormatBGR888());
+		break;
+
+	case PIXEL_FORMAT_BGRX8888:
+		pFunction(PixelFormatBGRX8888());
+		break;
+
+	case PIXEL_FORMAT_BGRA8888:
+		pFunction(PixelFormatBGRA8888());
+		break;
+
+	case PIXEL_FORMAT_RGB565:
+		pFunction(PixelFormatRGB565());
+		break;
+
+	case PIXEL_FORMAT_BGR565:
+		pFunction(PixelFormatBGR565());
+		break;
+
+	case PIXEL_FORMAT_A8:
+		pFunction(PixelFormatA8());
+		break;
+	}
+}
+
+/**
+ * @brief Gets the number of bytes one pixel of the format takes.
+ */
+inline size_t GetPixelFormatSize(PixelFormat pFormat)
+{
+	size_t size = 0;
+	DispatchPixelFormat(pFormat,[&size](auto pFormat){size = decltype(pFormat)::PIXEL_SIZE;});
+	return size;
+}
+
+/**
+ * @brief Sub pixel positions, as used by the anti-aliased drawing, are fixed point with FIXED_POINT_SHIFT bits of fraction.
+ * So FIXED_POINT_ONE is one pixel. Whole numbers are the centres of pixels, the same as the integer drawing functions.
+ */
+constexpr int FIXED_POINT_SHIFT = 8;
+constexpr int FIXED_POINT_ONE = 1 << FIXED_POINT_SHIFT;
+
+/**
+ * @brief Converts to the fixed point used for sub pixel positions.
+ */
+inline int ToFixedPoint(int pValue){return pValue * FIXED_POINT_ONE;}
+inline int ToFixedPoint(double pValue){return (int)(pValue * FIXED_POINT_ONE + (pValue < 0.0 ? -0.5 : 0.5));}
+
+/**
+ * @brief How the ends of thick anti-aliased lines are drawn.
+ */
+enum LineCap
+{
+	LINE_CAP_BUTT,		//!< Stops flat at the end points.
+	LINE_CAP_SQUARE,	//!< Stops flat half the width past the end points, the mitered end of a line.
+	LINE_CAP_ROUND		//!< A half circle past each end point, lines that share end points join up smoothly.
+};
+
+/**
+ * @brief Which parts of a polygon that crosses its self, or has holes, are filled.
+ */
+enum FillRule
+{
+	FILL_RULE_EVEN_ODD,	//!< Inside if a line out from the point crosses an odd number of edges. Outlines inside others are holes.
+	FILL_RULE_NON_ZERO	//!< Inside unless the edges crossed going down cancel out those going up. Holes have to go round the other way.
+};
+
+/**
+ * @brief How the image pixels are picked when an image is drawn transformed.
+ */
+enum ImageFilter
+{
+	IMAGE_FILTER_NEAREST,	//!< The image pixel the draw buffer pixel lands on. Quick but blocky, and the edges jump about when rotating.
+	IMAGE_FILTER_BILINEAR,	//!< Mixes the four image pixels around where it lands, smooth when turning and scaling.
+	IMAGE_FILTER_BOX		//!< For BlitScaled shrinking by a whole number, averages all the image pixels under each draw buffer pixel. Else the same as bilinear.
+};
+
+/**
+ * @brief How Blend, BlitRGBA and the fill functions that take one mix the colour with what is already there.
+ * S is the colour times its alpha and D the draw buffer colour, so see through pixels leave D as it is whatever the mode.
+ * Dest alpha, if it has it, becomes the largest of the two as BlendPixel does.
+ */
+enum BlendMode
+{
+	BLEND_MODE_NORMAL,		//!< S + (D*(1-A)), what BlendPixel does.
+	BLEND_MODE_ADD,			//!< D + S, stopping at white. One pass of this does glows and highlights.
+	BLEND_MODE_MULTIPLY,	//!< D * (S + 1 - A), darkens. White leaves D as it is, for shadows and tinting.
+	BLEND_MODE_SCREEN,		//!< D + S - (D*S), lightens without going past white like add does.
+	BLEND_MODE_DARKEN,		//!< The smaller of D and the normal blend, for each channel.
+	BLEND_MODE_LIGHTEN,		//!< The larger of D and the normal blend, for each channel.
+	BLEND_MODE_XOR			//!< D xor S. Drawing the same again puts D back, for cursors and rubber band boxes.
+};
+
+/**
+ * @brief A rectangle of pixels. right and bottom are one past the last pixel, so the width is right - left.
+ */
+struct Rect
+{
+	int left = 0;
+	int top = 0;
+	int right = 0;
+	int bottom = 0;
+
+	Rect() = default;
+	Rect(int pLeft,int pTop,int pRight,int pBottom):left(pLeft),top(pTop),right(pRight),bottom(pBottom){}
+
+	int GetWidth()const{return right - left;}
+	int GetHeight()const{return bottom - top;}
+	bool GetIsEmpty()const{return right <= left || bottom <= top;}
+	bool GetContains(int pX,int pY)const{return pX >= left && pX < right && pY >= top && pY < bottom;}
+	bool GetContains(const Rect& pRect)const{return pRect.left >= left && pRect.right <= right && pRect.top >= top && pRect.bottom <= bottom;}
+
+	/**
+	 * @brief The area that is in both, can be empty.
+	 */
+	Rect Intersect(const Rect& pOther)const
+	{
+		return Rect(std::max(left,pOther.left),std::max(top,pOther.top),std::min(right,pOther.right),std::min(bottom,pOther.bottom));
+	}
+
+	/**
+	 * @brief The smallest rect that holds both. Empty rects are ignored.
+	 */
+	Rect Union(const Rect& pOther)const
+	{
+		if( pOther.GetIsEmpty() )
+			return *this;
+		if( GetIsEmpty() )
+			return pOther;
+		return Rect(std::min(left,pOther.left),std::min(top,pOther.top),std::max(right,pOther.right),std::max(bottom,pOther.bottom));
+	}
+
+	bool operator == (const Rect& pOther)const{return left == pOther.left && top == pOther.top && right == pOther.right && bottom == pOther.bottom;}
+	bool operator != (const Rect& pOther)const{return !(*this == pOther);}
+};
+
+/**
+ * @brief Outlines made of straight lines and curves, for DrawBuffer::FillPath.
+ * Points are in pixels, whole numbers are the centres of pixels. Curves are turned into lines as they are added,
+ * as many as it takes to be within GetTolerance of the real curve, so set the tolerance first.
+ * The calls return the path so they can be chained. Path().MoveTo(0,0).LineTo(10,0).QuadTo(10,10,0,10).Close();
+ */
+class Path
+{
+public:
+	typedef std::vector<std::array<float,2>> Outline;
+
+	/**
+	 * @brief Starts a new outline.
+	 */
+	Path& MoveTo(float pX,float pY);
+	Path& LineTo(float pX,float pY);
+
+	/**
+	 * @brief Adds a quadratic, one control point, bezier curve from the last point to pX,pY.
+	 */
+	Path& QuadTo(float pControlX,float pControlY,float pX,float pY);
+
+	/**
+	 * @brief Adds a cubic, two control points, bezier curve from the last point to pX,pY.
+	 */
+	Path& CubicTo(float pControlAX,float pControlAY,float pControlBX,float pControlBY,float pX,float pY);
+
+	/**
+	 * @brief Ends the outline, a line added after this starts a new one from where this one started.
+	 * Outlines are always filled as if they are closed.
+	 */
+	Path& Close();
+
+	void Clear();
+
+	/**
+	 * @brief How far, in pixels, the lines a curve is turned into can be from the real curve. Default is a quarter of a pixel.
+	 */
+	void SetTolerance(float pTolerance){assert(pTolerance > 0.0f);mTolerance = pTolerance;}
+	float GetTolerance()const{return mTolerance;}
+
+	const std::vector<Outline>& GetOutlines()const{return mOutlines;}
+
+	/**
+	 * @brief The pixels filling the path can touch, empty if there is nothing to fill.
+	 */
+	Rect GetBounds()const;
+
+private:
+	std::vector<Outline> mOutlines;
+	float mTolerance = 0.25f;
+	bool mClosed = true;	//!< When true the next line starts a new outline from mStart.
+	std::array<float,2> mStart = {0.0f,0.0f};	//!< Where the current outline started.
+
+	/**
+	 * @brief The last point, starts a new outline if the last one was closed.
+	 */
+	std::array<float,2> GetCurrentPoint();
+};
+
+/**
+ * @brief Paint for FillPath that goes from one colour to the other along the line between two points.
+ * Past the ends it stays the end colour. Points are in pixels, like the path.
+ */
+struct LinearGradient
+{
+	float fromX = 0.0f,fromY = 0.0f;
+	float toX = 0.0f,toY = 0.0f;
+	uint8_t fromRGBA[4] = {0,0,0,255};	//!< pRGBA[0] == red, pRGBA[1] == green, pRGBA[2] == blue, pRGBA[3] == alpha
+	uint8_t toRGBA[4] = {255,255,255,255};
+
+	LinearGradient() = default;
+	LinearGradient(float pFromX,float pFromY,float pToX,float pToY,const uint8_t pFromRGBA[4],const uint8_t pToRGBA[4]):
+		fromX(pFromX),fromY(pFromY),toX(pToX),toY(pToY)
+	{
+		memcpy(fromRGBA,pFromRGBA,4);
+		memcpy(toRGBA,pToRGBA,4);
+	}
+};
+
+/**
+ * @brief A 2D affine transform, for DrawBuffer::BlitTransformed. Takes x,y to (x * a) + (y * c) + tx, (x * b) + (y * d) + ty.
+ * The helpers add a step after the ones already in the matrix and return it so they can be chained.
+ * Matrix().Translate(-16,-16).Rotate(30).Translate(100,100) turns a 32 by 32 image 30 degrees about its centre and puts that at 100,100.
+ */
+struct Matrix
+{
+	float a = 1.0f,b = 0.0f;
+	float c = 0.0f,d = 1.0f;
+	float tx = 0.0f,ty = 0.0f;
+
+	Matrix() = default;
+	Matrix(float pA,float pB,float pC,float pD,float pTX,float pTY):a(pA),b(pB),c(pC),d(pD),tx(pTX),ty(pTY){}
+
+	Matrix& Translate(float pX,float pY){tx += pX;ty += pY;return *this;}
+	Matrix& Scale(float pX,float pY){return Then(Matrix(pX,0.0f,0.0f,pY,0.0f,0.0f));}
+
+	/**
+	 * @brief Turns clockwise about 0,0, the same way round as the angles of DrawBuffer::DrawArc. Multiples of 90 degrees are exact.
+	 */
+	Matrix& Rotate(float pDegrees);
+
+	/**
+	 * @brief Adds all of pThen after the steps in this matrix.
+	 */
+	Matrix& Then(const Matrix& pThen);
+
+	/**
+	 * @brief The matrix that undoes this one. Zero when there isn't one, which is when the determinant is zero.
+	 */
+	Matrix GetInverse()const;
+	float GetDeterminant()const{return (a * d) - (b * c);}
+
+	void Transform(float pX,float pY,float& rX,float& rY)const{rX = (pX * a) + (pY * c) + tx;rY = (pX * b) + (pY * d) + ty;}
+};
+
+/**
+ * @brief Gets cache line aligned memory for pixels. Throws std::bad_alloc if it can't, like new.
+ * With USE_HUGE_PAGES large blocks are aligned to and advised to use huge pages.
+ */
+extern void* AllocatePixelMemory(size_t pNumBytes);
+extern void FreePixelMemory(void* pMemory);
+
+/**
+ * @brief The allocator for the pixels of a DrawBuffer.
+ * Memory is aligned for vector loads and new pixels are left as they are, not zeroed.
+ * So a Resize is just the allocation, all the drawing code writes every pixel before using it anyway.
+ */
+template<class T> struct PixelAllocator
+{
+	typedef T value_type;
+
+	PixelAllocator() = default;
+	template<class U> PixelAllocator(const PixelAllocator<U>&){}
+
+	T* allocate(size_t pCount){return (T*)AllocatePixelMemory(pCount * sizeof(T));}
+	void deallocate(T* pMemory,size_t){FreePixelMemory(pMemory);}
+
+	// No arguments is what vector uses when growing, default initialise that, which for uint8_t is nothing. Saves a memset of the whole image.
+	template<class U> void construct(U* pObject){::new((void*)pObject) U;}
+	template<class U,class... ARGS> void construct(U* pObject,ARGS&&... pArgs){::new((void*)pObject) U(std::forward<ARGS>(pArgs)...);}
+
+	template<class U> bool operator == (const PixelAllocator<U>&)const{return true;}
+	template<class U> bool operator != (const PixelAllocator<U>&)const{return false;}
+};
+
+/**
+ * @brief How the pixels of a DrawBuffer are held.
+ * Was a plain std::vector<uint8_t>, code that takes mPixels as one of those needs to take this instead.
+ */
+typedef std::vector<uint8_t,PixelAllocator<uint8_t>> PixelStorage;
+
 /**
  * @brief Checks that the address passed, with pixel width, if written to, will not overlow the buffer.
  * has to be a define so that you get told where the error is.
@@ -113,35 +548,61 @@ class FrameBuffer;
 #ifdef	NDEBUG
 	#define AssertPixelIsInBuffer(pPixel)	(__ASSERT_VOID_CAST (0))
 #else
-	#define AssertPixelIsInBuffer(pPixel)	{ assert( pPixel >= mPixels.data() ); assert( pPixel <= mPixels.data() + mPixels.size() - mPixelSize ); }
+	#define AssertPixelIsInBuffer(pPixel)	{ assert( GetIsPixelInBuffer(pPixel) ); }
 #endif
 
+/**
+ * @brief A picture in an Atlas page, small enough to pass by value. Draw it with the DrawBuffer Blit and Blend that take a sprite.
+ * solid and clear are found when it is added, so Blend can copy a sprite with no see through pixels and skip one that is all see through.
+ */
+struct Sprite
+{
+	const DrawBuffer* page = nullptr;	//!< The atlas page it is in, owned by the atlas.
+	Rect rect;							//!< Where it is in the page.
+	bool solid = false;					//!< No see through pixels.
+	bool clear = false;					//!< Nothing but see through pixels.
+
+	int GetWidth()const{return rect.GetWidth();}
+	int GetHeight()const{return rect.GetHeight();}
+	bool GetIsValid()const{return page != nullptr;}
+};
+
 /**
  * @brief This is the main off screen drawing / image buffer.
  * This can be used to simply hold an image as well as creating new images from primitive calls.
  * This images can then be presented to the display buffer for viewing by the user.
  * This is the object that most of your interations will be with.
- * Buffer is always 8 bits per channel. So if your display is 16bit then present maybe slow because of the depth conversion on present.
+ * The layout of the pixels is set by a PixelFormat. By default it is three bytes per pixel, or four with alpha.
+ * If your display is 16bit then render to a buffer made with DrawBuffer(const FrameBuffer*), or in the format from FrameBuffer::GetNativePixelFormat,
+ * else present will be slow because of the depth conversion.
  */
 class DrawBuffer
 {
 public:
 	// For simplicity and flexibility all visable and modifiable. So don't be daft. :) 
-	std::vector<uint8_t> mPixels;
+	// Not used by a DrawBufferView, they draw to someone else's memory. Use GetPixelAddress and GetStride to be safe with both.
+	PixelStorage mPixels;
 
 	/**
 	 * @brief Construct a new Tiny Image object assumes stride is width * height * 3 or 4 bytes based on alpha.
+	 * The pixels are not cleared, see Resize.
 	 */
 	DrawBuffer(int pWidth, int pHeight,bool pHasAlpha = false,bool pPreMultipliedAlpha = false);
 
+	/**
+	 * @brief Construct a new draw buffer with the pixel format passed. Stride is width * the size of the format.
+	 */
+	DrawBuffer(int pWidth, int pHeight,PixelFormat pFormat,bool pPreMultipliedAlpha = false);
+
 	/**
 	 * @brief Construct a draw buffer that is suitable for use as a render target.
-	 * This makes it the same size as dest so in present we can do a memcpy, but only if frame buffer is 8 bits per channel. Gives us a four fold speed up.
+	 * This makes it the same size, pixel format and stride, row padding and all, as dest so in present we can do a memcpy. Gives us a four fold speed up.
+	 * If the display has a pixel layout that no PixelFormat matches then PIXEL_FORMAT_BGR888 is used and present will convert.
 	 * For most chips, don't matter. But when you get to low speed, 40Mhz chips, every little helps.
 	 * This is about the only optimisation I will do. I expect people to use this by creating offscreen buffers
 	 * that only get updated when something changes and composite the changes together at end of frame.
 	 * So most of the time all the rendering is done is to make sure the display has been updated. Just in case TTY had put something up.
-	 * If frame buffer is 16bit then a conversion per pixel is needed. That is slower.
+	 * If frame buffer is 16bit the buffer is made in the 565 layout of the display, so that is a memcpy too and half the memory.
 	 * @param pFB 
 	 */
 	DrawBuffer(const FrameBuffer* pFB);
@@ -154,17 +615,53 @@ public:
 	inline int GetWidth()const{return mWidth;}
 	inline int GetHeight()const{return mHeight;}
 	inline size_t GetPixelSize()const{return mPixelSize;}
-	inline size_t GetStride()const{return mStride;}
+	inline ptrdiff_t GetStride()const{return mStride;}	//!< Can be negative for a view that is upside down.
+	inline PixelFormat GetPixelFormat()const{return mFormat;}
+	inline bool GetHasAlpha()const{return mHasAlpha;}
+	inline bool GetPreMultipliedAlpha()const{return mPreMultipliedAlpha;}
+
+	/**
+	 * @brief True if the pixels are not held in mPixels, see DrawBufferView.
+	 */
+	inline bool GetIsView()const{return mViewPixels != nullptr;}
+
+	/**
+	 * @brief Get the index of the first byte of the pixel at x,y from the first byte of pixel 0,0.
+	 */
+	inline ptrdiff_t GetPixelIndex(int pX,int pY)const{return (pX * (ptrdiff_t)mPixelSize) + (pY * mStride);}
 
 	/**
-	 * @brief Get the index of the first byte of the pixel at x,y.
+	 * @brief Get the address of the first byte of the pixel at x,y. No bounds checking is done.
 	 */
-	inline size_t GetPixelIndex(int pX,int pY)const{return (pX * mPixelSize) + (pY * mStride);}
+	inline uint8_t* GetPixelAddress(int pX,int pY){return (mViewPixels ? mViewPixels : mPixels.data()) + GetPixelIndex(pX,pY);}
+	inline const uint8_t* GetPixelAddress(int pX,int pY)const{return (mViewPixels ? mViewPixels : mPixels.data()) + GetPixelIndex(pX,pY);}
+
+	/**
+	 * @brief For debugging, true if the pixel at the address is one of ours. Padding at the end of lines is not.
+	 */
+	bool GetIsPixelInBuffer(const uint8_t* pPixel)const
+	{
+		if( mWidth <= 0 || mHeight <= 0 )
+			return false;
+		const ptrdiff_t index = pPixel - GetPixelAddress(0,0);
+		const ptrdiff_t y = mStride > 0 ? index / mStride : (-mStride - 1 - index) / -mStride; // Lines go down memory when upside down.
+		const ptrdiff_t x = index - (y * mStride);
+		return y >= 0 && y < mHeight && x >= 0 && x <= (ptrdiff_t)((mWidth - 1) * mPixelSize);
+	}
 
 	/**
 	 * @brief Resets the image into a new different size / format.
 	 * Expect image pixels to vanish after calling. If they don't, it's luck!
+	 * New pixels are not cleared, so call Clear if you are not going to write all of them.
+	 * A view becomes a normal buffer with it's own pixels.
 	 * Does NOT scale the image!
+	 * @param pStride The number of bytes per scan line, 0 for width * pixel size. Can be more to match a display with padded lines, the padding is never drawn to.
+	 */
+	void Resize(int pWidth, int pHeight,PixelFormat pFormat,bool pPreMultipliedAlpha = false,size_t pStride = 0);
+
+	/**
+	 * @brief Resize picking the format from the pixel size. 4 bytes is PIXEL_FORMAT_BGRA8888 with alpha, else PIXEL_FORMAT_BGRX8888.
+	 * 3 is PIXEL_FORMAT_BGR888, 2 PIXEL_FORMAT_RGB565 and 1 PIXEL_FORMAT_A8.
 	 */
 	void Resize(int pWidth, int pHeight,size_t pPixelSize,bool pHasAlpha = false,bool pPreMultipliedAlpha = false);
 	void Resize(int pWidth, int pHeight,bool pHasAlpha = false,bool pPreMultipliedAlpha = false)
@@ -172,36 +669,91 @@ public:
 		Resize(pWidth,pHeight,pHasAlpha?4:3,pHasAlpha,pPreMultipliedAlpha);
 	}
 
+	/**
+	 * @brief Limits all drawing to pRect, within the current clip rect, until PopClipRect is called.
+	 * Every primitive, text, blit and blend honours it, clipping each span once. Pushes nest, so a widget can't draw outside its panel.
+	 * Resize forgets all the pushed rects.
+	 */
+	void PushClipRect(const Rect& pRect);
+
+	/**
+	 * @brief Puts back the clip rect that was in use before the last PushClipRect.
+	 */
+	void PopClipRect();
+
+	/**
+	 * @brief The area that drawing is limited to, always inside the buffer. With nothing pushed it is all of it.
+	 */
+	const Rect& GetClipRect()const{return mClip;}
+
+	/**
+	 * @brief Turns on, or off, recording of the areas drawn to. Then FrameBuffer::Present only copies those to the display.
+	 * Turning it on marks the whole buffer as dirty so the first present is complete.
+	 * Drawing done through a DrawBufferView is not seen by the buffer it looks at, use AddDirtyRect for that.
+	 */
+	void SetTrackDirtyRects(bool pTrack);
+	bool GetTrackDirtyRects()const{return mTrackDirtyRects;}
+
+	/**
+	 * @brief The areas changed since the last ClearDirtyRects, inside the buffer. Overlapping and close rects are merged so the list stays short.
+	 */
+	const std::vector<Rect>& GetDirtyRects()const{return mDirtyRects;}
+
+	/**
+	 * @brief Marks an area as changed, the primitives do this for you. Use it if you write to the pixels yourself.
+	 * Does nothing when not tracking dirty rects.
+	 */
+	void AddDirtyRect(const Rect& pRect);
+
+	/**
+	 * @brief Forgets the dirty rects, FrameBuffer::Present calls this once they are on the display.
+	 */
+	void ClearDirtyRects(){mDirtyRects.clear();}
+
+	/**
+	 * @brief Works out which 16 by 16 tiles of the image are see through, solid or a mix, so Blend can skip or copy whole tiles of it.
+	 * The first call looks at every pixel. After that drawing to the buffer marks the tiles it touches and only those are looked at again.
+	 * Worth it for images that are blended a lot, like big backgrounds with a few see through parts. PreMultiplyAlpha calls it.
+	 */
+	void UpdateOpacityTiles();
+
+	/**
+	 * @brief Marks the tiles in pRect as unknown until the next UpdateOpacityTiles, the primitives do this for you.
+	 * Use it if you write to the pixels yourself or draw to them through a DrawBufferView.
+	 */
+	void ForgetOpacityTiles(const Rect& pRect);
+
+	/**
+	 * @brief Lets big clears and fills be split over the threads of pJobs. nullptr, the default, does everything on the calling thread.
+	 */
+	void SetJobSystem(JobSystem* pJobs){mJobs = pJobs;}
+	JobSystem* GetJobSystem()const{return mJobs;}
+
 	/**
 	 * @brief Writes a single pixel with the passed red, green and blue values. 0 -> 255, 0 being off 255 being full on.
-	 * The pixel will not be written if it's outside the frame buffers bounds.
+	 * The pixel will not be written if it's outside the clip rect.
 	 * pAlpha is ignored if destination has no alpha channel.
 	 */
 	inline void WritePixel(int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255)
 	{
-		if( pX >= 0 && pX < mWidth && pY >= 0 && pY < mHeight )
+		if( mClip.GetContains(pX,pY) )
 		{
-			// When optimized by compiler these const vars will
-			// all move to generate the same code as if I made it all one line and unreadable!
-			// Trust your optimizer. :)
-			const size_t index = GetPixelIndex(pX,pY);
-			uint8_t* dst = mPixels.data() + index;
+			uint8_t* dst = GetPixelAddress(pX,pY);
 
 			AssertPixelIsInBuffer(dst);
 
-			WRITE_RGB_TO_PIXEL(dst,pRed,pGreen,pBlue);
-
-			if( mHasAlpha )
+			DispatchPixelFormat(mFormat,[&](auto pFormat)
 			{
-				assert( index + 3 < mPixels.size() );
-				dst[ 3 ] = pAlpha;
-			}
+				typedef decltype(pFormat) FORMAT;
+				FORMAT::Write(dst,FORMAT::Pack(pRed,pGreen,pBlue,pAlpha));
+			});
+			Touched(Rect(pX,pY,pX+1,pY+1));
 		}
 	}
 
 	/**
 	 * @brief Blends a single pixel with the frame buffer. does (S*A) + (D*(1-A))
-	 * The pixel will not be written if it's outside the frame buffers bounds.
+	 * The pixel will not be written if it's outside the clip rect.
 	 * 
 	 * @param pRGBA Four bytes, pRGBA[0] == red, pRGBA[1] == green, pRGBA[2] == blue, pRGBA[3] == alpha
 	 */
@@ -213,7 +765,7 @@ public:
 
 	/**
 	 * @brief Blends a single pixel with the frame buffer. does S + (D * A) Quicker but less flexable.
-	 * The pixel will not be written if it's outside the frame buffers bounds.
+	 * The pixel will not be written if it's outside the clip rect.
 	 * 
 	 * @param pRGBA Four bytes, pRGBA[0] == red, pRGBA[1] == green, pRGBA[2] == blue, pRGBA[3] == alpha
 	 */
@@ -224,13 +776,13 @@ public:
 	}
 	
 	/**
-	 * @brief Clears the entire screen to the passed colour.
+	 * @brief Clears the entire screen, or the clip rect if one is pushed, to the passed colour.
 	 * Alpha ignored it dest has no alpha channel
 	 */
 	void Clear(uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
 
 	/**
-	 * @brief sets all the pixels to one colour.
+	 * @brief sets all the pixels, or those in the clip rect, to one colour.
 	 * Does one fill with memset!
 	 */
 	void Clear(uint8_t pValue = 0);
@@ -255,9 +807,9 @@ public:
 	 * @brief Draws the entire image to the draw buffer,
 	 * Expects source to be 32bit, four 8 bit bytes in R G B A order.
 	 * IE pSourcePixels[0] is red, pSourcePixels[1] is green, pSourcePixels[2] is blue and pSourcePixels[3] is alpha.
-	 * Renders the image to pX,pY without scaling. Most basic blit.
+	 * Renders the image to pX,pY without scaling. Most basic blit. pMode sets how it is mixed with what is there, see BlendMode.
 	 */
-	void BlitRGBA(const uint8_t* pSourcePixels,int pX,int pY,int pSourceWidth,int pSourceHeight,bool pPreMultipliedAlpha = false);
+	void BlitRGBA(const uint8_t* pSourcePixels,int pX,int pY,int pSourceWidth,int pSourceHeight,bool pPreMultipliedAlpha = false,BlendMode pMode = BLEND_MODE_NORMAL);
 
 	/**
 	 * @brief Draws the sub rectangle of the image to the draw buffer,
@@ -265,19 +817,61 @@ public:
 	 * IE pSourcePixels[0] is red, pSourcePixels[1] is green, pSourcePixels[2] is blue and pSourcePixels[3] is alpha.
 	 * Renders the image to pX,pY without scaling. Most basic blit.
 	 */
-	void BlitRGBA(const uint8_t* pSourcePixels,int pX,int pY,int pWidth,int pHeight,int pSourceX,int pSourceY,int pSourceStride,bool pPreMultipliedAlpha = false);
+	void BlitRGBA(const uint8_t* pSourcePixels,int pX,int pY,int pWidth,int pHeight,int pSourceX,int pSourceY,int pSourceStride,bool pPreMultipliedAlpha = false,BlendMode pMode = BLEND_MODE_NORMAL);
 
 	/**
 	 * @brief Draws the entire image to the draw buffer.
 	 * Does a pixel for pixel copy, no alpha blending.
+	 * The image must not be a view of the same pixels, use ScrollBuffer to move pixels around.
 	 */
 	void Blit(const DrawBuffer& pImage,int pX,int pY);
 
 	/**
 	 * @brief Draws the entire image to the draw buffer, does alpha blending if source has alpha.
-	 * Does a pixel for pixel copy, no alpha blending.
+	 * With a pMode other than BLEND_MODE_NORMAL images without alpha are mixed in as if solid, else they are copied.
+	 */
+	void Blend(const DrawBuffer& pImage,int pX,int pY,BlendMode pMode = BLEND_MODE_NORMAL);
+
+	/**
+	 * @brief Draw the pSource part of the image, for sprite sheets. pSource must be inside the image.
+	 */
+	void Blit(const DrawBuffer& pImage,int pX,int pY,const Rect& pSource);
+	void Blend(const DrawBuffer& pImage,int pX,int pY,const Rect& pSource,BlendMode pMode = BLEND_MODE_NORMAL);
+
+	/**
+	 * @brief Draw a sprite from an Atlas. Blend copies solid sprites and skips clear ones. Invalid sprites draw nothing.
+	 */
+	void Blit(const Sprite& pSprite,int pX,int pY);
+	void Blend(const Sprite& pSprite,int pX,int pY);
+	void BlitScaled(const Sprite& pSprite,const Rect& pDest,ImageFilter pFilter = IMAGE_FILTER_BILINEAR,bool pBlend = false);
+
+	/**
+	 * @brief Draws a SpanSprite, the same as blending the image it was made from but only the part see through pixels are blended.
 	 */
-	void Blend(const DrawBuffer& pImage,int pX,int pY);
+	void Blend(const SpanSprite& pSprite,int pX,int pY);
+
+	/**
+	 * @brief Draws the image moved, turned, scaled or sheared by pTransform, which takes image pixels to draw buffer pixels.
+	 * Pixel centres are on whole numbers, so the image covers -0.5 to width - 0.5. Each row works out exactly which of its pixels
+	 * land on the image and only those are drawn, stepping through the image in fixed point.
+	 * With pBlend and an image with alpha it is blended as Blend does, else the pixels are copied.
+	 * The image must not be a view of the same pixels.
+	 */
+	void BlitTransformed(const DrawBuffer& pImage,const Matrix& pTransform,ImageFilter pFilter = IMAGE_FILTER_BILINEAR,bool pBlend = false);
+
+	/**
+	 * @brief Stretches the pSource part of the image to fill pDest.
+	 * Where each column and row of pDest comes from in the image is worked out once per call, and when growing an image
+	 * taller the image rows that were mixed for the line above are used again. IMAGE_FILTER_BOX is for shrinking by a whole
+	 * number, half, a third, and so on, and averages every image pixel, so thumbnails don't sparkle.
+	 * With pBlend and an image with alpha it is blended as Blend does, else the pixels are copied.
+	 * pSource must be inside the image. The image must not be a view of the same pixels.
+	 */
+	void BlitScaled(const DrawBuffer& pImage,const Rect& pDest,const Rect& pSource,ImageFilter pFilter = IMAGE_FILTER_BILINEAR,bool pBlend = false);
+	void BlitScaled(const DrawBuffer& pImage,const Rect& pDest,ImageFilter pFilter = IMAGE_FILTER_BILINEAR,bool pBlend = false)
+	{
+		BlitScaled(pImage,pDest,Rect(0,0,pImage.GetWidth(),pImage.GetHeight()),pFilter,pBlend);
+	}
 
 	/**
 	 * @brief Draws a horizontal line.
@@ -309,24 +903,112 @@ public:
 	void DrawLineList(const std::vector<std::array<int,2>>& pPoints,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue);
 
 	/**
-	 * @brief Draws a circle using the Midpoint algorithm.
+	 * @brief Draws an anti-aliased line one pixel wide using Xiaolin Wu's algorithm. The ends are in fixed point, see FIXED_POINT_SHIFT.
+	 * How much of each pixel the line covers, times pAlpha, is blended into the buffer.
+	 * https://en.wikipedia.org/wiki/Xiaolin_Wu%27s_line_algorithm
+	 */
+	void DrawLineAA(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
+	/**
+	 * @brief Draws an anti-aliased line pWidth wide with the ends drawn as pCap. The ends and width are in fixed point.
+	 * Filled as a rectangle a row at a time, so each pixel is only written once.
+	 */
+	void DrawLineAA(int pFromX,int pFromY,int pToX,int pToY,int pWidth,LineCap pCap,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
+	/**
+	 * @brief Draws a circle using the Midpoint algorithm, quicker than DrawEllipse for a one pixel outline.
+	 * FillCircle is FillEllipse with both radii the same.
 	 * https://en.wikipedia.org/wiki/Midpoint_circle_algorithm
 	 */
 	void DrawCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
 	void FillCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
 
+	/**
+	 * @brief Draws an ellipse one pixel wide or filled. A radius of r is 2r - 1 pixels across.
+	 * Each row is worked out once and written as one or two spans, so no pixel is written twice.
+	 */
+	void DrawEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
+	/**
+	 * @brief Draws the part of a circle from pFromAngle going clockwise to pToAngle, in degrees with 0 pointing right.
+	 * DrawArc is pWidth pixels wide, in from the edge, for dials. FillArc is a pie segment. 360 degrees or more apart is the whole circle.
+	 */
+	void DrawArc(int pCenterX,int pCenterY,int pRadius,int pWidth,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillArc(int pCenterX,int pCenterY,int pRadius,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
+	/**
+	 * @brief Anti-aliased ellipses, the centre, radii and width are in fixed point. The outline is pWidth wide centred on the radii.
+	 * How much of each edge pixel is covered, times pAlpha, is blended into the buffer. The pixels inside are filled as spans.
+	 */
+	void DrawEllipseAA(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillEllipseAA(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
+	/**
+	 * @brief Anti-aliased DrawArc and FillArc, in fixed point like DrawEllipseAA. The arc is pWidth wide centred on the radius.
+	 */
+	void DrawArcAA(int pCenterX,int pCenterY,int pRadius,int pWidth,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillArcAA(int pCenterX,int pCenterY,int pRadius,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
 	/**
 	 * @brief Draws a rectangle with the passed in RGB values either filled or not.
 	 */
 	void DrawRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
 	void FillRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
 
+	/**
+	 * @brief Fills mixing the colour with what is there using pMode, where the ones above write it.
+	 * BLEND_MODE_NORMAL blends as BlendPixel does. Each row is done by the vector kernel for the mode.
+	 */
+	void FillRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode);
+	void FillCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode);
+	void FillEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode);
+
 	/**
 	 * @brief Draws a rectangle with rounder corners in the passed in RGB values either filled or not.
 	 */
 	void DrawRoundedRectangle(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
 	void FillRoundedRectangle(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
 
+	/**
+	 * @brief Anti-aliased rounded rectangles, the corners are blended from how much of each pixel they cover and the rest is filled as spans.
+	 * The coverage of a corner is worked out once for each radius and the last few used are kept, so redrawing buttons and the like is quick.
+	 * The radius is reduced to fit the rectangle. DrawRoundedRectangleAA's outline is pWidth pixels wide, in from the edge.
+	 */
+	void DrawRoundedRectangleAA(int pFromX,int pFromY,int pToX,int pToY,int pRadius,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillRoundedRectangleAA(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
+	/**
+	 * @brief Fills a triangle, the points are in fixed point, see FIXED_POINT_SHIFT.
+	 * A pixel is filled if its centre is inside, or on a left or top edge, so shapes that share an edge don't overlap or leave a gap.
+	 */
+	void FillTriangle(int pX0,int pY0,int pX1,int pY1,int pX2,int pY2,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
+	/**
+	 * @brief Fills a convex polygon, the points are in fixed point. Quicker than FillPolygon as each row is one span.
+	 * If it's not convex each row is filled from the left most edge to the right most.
+	 */
+	void FillConvexPolygon(const std::vector<std::array<int,2>>& pPoints,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
+	/**
+	 * @brief Fills any polygon, it can cross its self. pRule sets which parts are inside. The points are in fixed point.
+	 * Uses an active edge table, each row is filled with one write per span.
+	 */
+	void FillPolygon(const std::vector<std::array<int,2>>& pPoints,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
+	/**
+	 * @brief Fills a polygon made of many outlines, like a shape with holes in it.
+	 */
+	void FillPolygon(const std::vector<std::vector<std::array<int,2>>>& pOutlines,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+
+	/**
+	 * @brief Fills the path anti-aliased. How much of each pixel is covered is found by adding up the signed area under each edge
+	 * and then running along each row, the way font-rs and stb_truetype draw glyphs. So the cost is the area, not the edges times the area.
+	 * The colour, times the coverage and pAlpha, is blended into the buffer. Where edges cross inside a pixel its coverage is only close.
+	 */
+	void FillPath(const Path& pPath,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillPath(const Path& pPath,FillRule pRule,const LinearGradient& pPaint);
+
 	/**
 	 * @brief Fills a rect tangle based on count * size starting at pos with the two passed colours
 	 * So if count is 8 and size is 16 pixel width will be 128
@@ -351,26 +1033,84 @@ public:
 	 * @brief Shifts the pixels in the X and Y direction by their magnitude. The area that is uncovered by this shit is filled with the values passed in.
 	 * This is used to easily create data plots. You just scroll then add the new pixel.
 	 * Means you don't have to keep redrawing the entire graph.
+	 * If a clip rect is pushed only the pixels inside it are scrolled.
 	 */
 	void ScrollBuffer(int pXDirection,int pYDirection,int8_t pRedFill = 0,uint8_t pGreenFill = 0,uint8_t pBlueFill = 0,uint8_t pAlphaFill = 255);
 
 	/**
-	 * @brief Makes the pixels pre multiplied, sets RGB to RGB*A then inverts A.
+	 * @brief Makes the pixels pre multiplied, sets RGB to RGB*A then inverts A. Only for PIXEL_FORMAT_BGRA8888.
  	 * Speeds up rending when alpha is not being modified from (S*A) + (D*(1-A)) to S + (D*A)
  	 * For a simple 2D rendering system that's built for portablity that is an easy speed up.
- 	 * Tiny2D goal is portablity and small code base. Not and epic SIMD / NEON / GL / DX / Volcan monster. :)
+ 	 * Blending pre multiplied images uses the SSE2 or NEON row kernels when the compiler has them, else the portable code.
 	 */
 	void PreMultiplyAlpha();
 
+protected:
+	/**
+	 * @brief Points the buffer at pixels it does not own, for DrawBufferView. mPixels is emptied.
+	 */
+	void SetViewPixels(uint8_t* pPixels,int pWidth,int pHeight,ptrdiff_t pStride,PixelFormat pFormat,bool pPreMultipliedAlpha);
+
+	/**
+	 * @brief For a view of another buffer, what is drawn is passed on to pParent so its dirty rects and opacity tiles are kept right.
+	 * pX,pY is where pixel 0,0 of the view is in the parent, with pFlipped the view's lines go up the parent from there.
+	 */
+	void SetViewParent(DrawBuffer* pParent,int pX,int pY,bool pFlipped);
+
 private:
 	int mWidth;
 	int mHeight;
+	PixelFormat mFormat;
 	size_t mPixelSize;	//!< The number of bytes per pixel.
-	size_t mStride;	//!< The number of bytes per scan line.
-	size_t mLastlineOffset; //!< The first pixel of the last line.
+	ptrdiff_t mStride;	//!< The number of bytes per scan line.
+	uint8_t* mViewPixels = nullptr; //!< When not null pixel 0,0 of someone else's memory, else the pixels are in mPixels.
+	DrawBuffer* mViewParent = nullptr; //!< The buffer a view is of, told what is drawn through the view. Null if not a view or a view of your own memory.
+	int mViewX = 0,mViewY = 0;	//!< Where pixel 0,0 of the view is in mViewParent.
+	bool mViewFlipped = false;	//!< The view's lines go up mViewParent, for FlipVertical.
+	Rect mClip;	//!< All drawing is clipped to this, it is always inside the buffer.
+	std::vector<Rect> mClipStack; //!< The rects to go back to on PopClipRect.
+	bool mTrackDirtyRects = false;
+	std::vector<Rect> mDirtyRects; //!< Areas drawn to since ClearDirtyRects, only added to when mTrackDirtyRects is true.
+	JobSystem* mJobs = nullptr;	//!< When set large areas are drawn on all it's threads.
 	bool mHasAlpha;
 	bool mPreMultipliedAlpha;
 
+	enum TileOpacity : uint8_t
+	{
+		TILE_UNKNOWN,
+		TILE_SEE_THROUGH,
+		TILE_SOLID,
+		TILE_MIXED
+	};
+	static const int OPACITY_TILE_SIZE = 16;
+	std::vector<TileOpacity> mOpacityTiles; //!< Row by row, empty until UpdateOpacityTiles is called.
+
+	/**
+	 * @brief Called by the primitives with the area they have drawn to, already clipped.
+	 */
+	inline void Touched(const Rect& pRect)
+	{
+		if( mTrackDirtyRects )
+			AddDirtyRect(pRect);
+		if( mOpacityTiles.size() > 0 )
+			ForgetOpacityTiles(pRect);
+		if( mViewParent )
+			TouchParent(pRect);
+	}
+
+	/**
+	 * @brief Passes an area drawn through a view on to the buffer it is a view of, in that buffer's coordinates.
+	 * Views of the same buffer can be drawn to on different threads, so the parent is updated under a lock.
+	 */
+	void TouchParent(const Rect& pRect);
+
+	/**
+	 * @brief Clips a blit of pWidth by pHeight pixels at rX,rY against the clip rect.
+	 * rSourceX and rSourceY are moved by the amount clipped off the top left so they still line up.
+	 * @return true if there is something left to draw.
+	 */
+	bool ClipBlit(int& rX,int& rY,int& rSourceX,int& rSourceY,int& rWidth,int& rHeight)const;
+
 	/*
 		Draws an arbitrary line.
 		Using Bresenham's line algorithm
@@ -379,6 +1119,394 @@ private:
 	void DrawLineBresenham(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue);
 };
 
+/**
+ * @brief A DrawBuffer that draws to pixels it does not own. A rectangle of another buffer, another buffer upside down or memory you have.
+ * Nothing is copied, and as it is a DrawBuffer all the drawing functions, blits and blends work with it as source or dest.
+ * Good for sprite sheets, drawing parts of the screen on different threads and updating a panel in place.
+ * The memory must out live the view. Copies of a view are views of the same pixels.
+ * Drawing through a view of another buffer adds to that buffer's dirty rects and keeps its opacity tiles right. A view of your own memory has no buffer to tell.
+ * Blit and Blend work when the source and dest share pixels, a view into its own parent say. BlitScaled and BlitTransformed need them apart.
+ */
+class DrawBufferView : public DrawBuffer
+{
+public:
+	/**
+	 * @brief A view of the pWidth by pHeight rectangle at pX,pY in pParent. The rectangle is clipped to the parent.
+	 */
+	DrawBufferView(DrawBuffer& pParent,int pX,int pY,int pWidth,int pHeight);
+
+	/**
+	 * @brief A view of memory you own. pPixels is the first byte of pixel 0,0.
+	 * @param pStride The bytes from one line to the next, negative for images stored bottom line first.
+	 */
+	DrawBufferView(uint8_t* pPixels,int pWidth,int pHeight,ptrdiff_t pStride,PixelFormat pFormat,bool pPreMultipliedAlpha = false);
+
+	/**
+	 * @brief A view of all of pParent upside down, line 0 of the view is the last line of the parent.
+	 */
+	static DrawBufferView FlipVertical(DrawBuffer& pParent);
+};
+
+/**
+ * @brief Keeps hold of scratch draw buffers so that ones used every frame are not freed and allocated again each time.
+ * Acquire a buffer, draw with it, then give it back with Release. You own it in between.
+ * A released buffer of the same size and format is handed out first, then any that is big enough, so no memory is allocated.
+ * Pixels are not cleared, what was there last time will still be there. The job system and dirty rect tracking are turned off.
+ * Thread safe, can be shared by worker threads.
+ */
+class DrawBufferPool
+{
+public:
+	/**
+	 * @param pMaxFree The number of released buffers kept for reuse, more than this and they are deleted.
+	 */
+	DrawBufferPool(size_t pMaxFree = 8);
+	~DrawBufferPool();
+
+	/**
+	 * @brief Gets a buffer of the size and format, from the pool if there is one that will do, else a new one.
+	 */
+	DrawBuffer* Acquire(int pWidth,int pHeight,PixelFormat pFormat);
+
+	/**
+	 * @brief Hands a buffer from Acquire back to the pool. Can be any DrawBuffer made with new.
+	 */
+	void Release(DrawBuffer* pBuffer);
+
+	/**
+	 * @brief Deletes all the buffers being held for reuse. Does not affect ones that are acquired.
+	 */
+	void Trim();
+
+private:
+	const size_t mMaxFree;
+	std::vector<DrawBuffer*> mFree;
+	std::mutex mLock;
+};
+
+/**
+ * @brief An image for button and panel skins that can be drawn at any size without stretching its corners.
+ * It is cut into nine when made. The corners are drawn as they are, the top and bottom edges are stretched across, the left and right
+ * edges down and the middle both ways, by repeating image pixels. Parts with no see through pixels are copied, the rest are blended.
+ */
+class NinePatch
+{
+public:
+	/**
+	 * @brief Takes an Android style nine patch. It has a one pixel border, that is not drawn, where marks along the top and left give
+	 * the part that stretches and marks along the bottom and right the content area. With no content marks it is the stretched part.
+	 * A mark is any solid pixel, or black in an image without alpha. Each way stretches from the first mark to the last.
+	 */
+	NinePatch(const DrawBuffer& pNinePatch);
+
+	/**
+	 * @brief Takes an image with no border. The stretched part, and the content area, are pLeft, pTop, pRight and pBottom in from each edge.
+	 */
+	NinePatch(const DrawBuffer& pImage,int pLeft,int pTop,int pRight,int pBottom);
+
+	/**
+	 * @brief The size of the image, without the border.
+	 */
+	int GetWidth()const{return mColumns[3];}
+	int GetHeight()const{return mRows[3];}
+
+	/**
+	 * @brief Where text or icons go when it is drawn into pRect.
+	 */
+	Rect GetContentRect(const Rect& pRect)const;
+
+	/**
+	 * @brief Draws it stretched to fill pRect. When pRect is smaller than the corners they are shrunk to fit.
+	 */
+	void Draw(DrawBuffer& pDest,const Rect& pRect)const;
+
+private:
+	int mColumns[4];			//!< Where the slices start and end across the image, the last is the width.
+	int mRows[4];				//!< Where the slices start and end down the image, the last is the height.
+	Rect mContentInsets;		//!< How far in from each edge the content area is.
+	DrawBuffer mSlices[3][3];	//!< Indexed by row then column.
+	bool mSolid[3][3];			//!< True if the slice has no see through pixels.
+
+	void Slice(const DrawBuffer& pImage,int pBorder);
+};
+
+/**
+ * @brief Packs lots of small images into a few big pages, so hundreds of icons are a few allocations next to each other in memory.
+ * Add the images, keep the Sprite returned for each and draw with that, the images can be freed once added.
+ * Each image goes where it leaves the lowest top edge, a skyline packer. Adding them all in one go packs tighter, as the tallest go first.
+ * The atlas must out live its sprites. Images with pre multiplied alpha can not be added.
+ */
+class Atlas
+{
+public:
+	/**
+	 * @param pPageWidth pPageHeight The size of each page. An image bigger than this gets a page of its own.
+	 * @param pFormat The pixel format of the pages, images are converted to it as they are added.
+	 */
+	Atlas(int pPageWidth = 1024,int pPageHeight = 1024,PixelFormat pFormat = PIXEL_FORMAT_BGRA8888);
+
+	/**
+	 * @brief Copies the image into a page. An empty image gives an invalid sprite.
+	 */
+	Sprite Add(const DrawBuffer& pImage);
+
+	/**
+	 * @brief Adds them all, tallest first. The sprites are in the same order as the images.
+	 */
+	std::vector<Sprite> Add(const std::vector<const DrawBuffer*>& pImages);
+
+	size_t GetPageCount()const{return mPages.size();}
+	const DrawBuffer& GetPage(size_t pIndex)const{return *mPages[pIndex].pixels;}
+
+private:
+	/**
+	 * @brief A run of the page's skyline, the lowest free row from x to x + width.
+	 */
+	struct Segment
+	{
+		int x,y,width;
+	};
+
+	struct Page
+	{
+		std::unique_ptr<DrawBuffer> pixels;	// Sprites point at it, so it must not move when more pages are added.
+		std::vector<Segment> skyline;
+	};
+
+	const int mPageWidth;
+	const int mPageHeight;
+	const PixelFormat mFormat;
+	std::vector<Page> mPages;
+
+	bool Place(Page& rPage,int pWidth,int pHeight,int& rX,int& rY);
+};
+
+/**
+ * @brief An image with alpha made ready for quick blending, for UI art that is mostly see through or solid.
+ * Each line is kept as spans of solid pixels, which are copied, and part see through pixels, which are blended.
+ * See through pixels are not kept at all, so cost nothing. Clipping cuts the spans, so a sprite half off screen costs half.
+ * Draw it with DrawBuffer::Blend. The image can be freed once it is made.
+ */
+class SpanSprite
+{
+public:
+	struct Span
+	{
+		int x;			//!< From the left of the sprite.
+		int count;
+		bool solid;		//!< Solid spans are in GetSolidPixels, else GetBlendPixels.
+		size_t offset;	//!< Where the first pixel is, in bytes, in the pixels for the span.
+	};
+
+	/**
+	 * @param pFormat The format solid pixels are kept in. Use the format of the draw buffer it will be drawn to and they are a memcpy.
+	 */
+	SpanSprite(const DrawBuffer& pImage,PixelFormat pFormat);
+
+	int GetWidth()const{return mWidth;}
+	int GetHeight()const{return mHeight;}
+	PixelFormat GetSolidFormat()const{return mFormat;}
+
+	/**
+	 * @brief The part that is not see through, from the top left of the sprite.
+	 */
+	const Rect& GetBounds()const{return mBounds;}
+
+	/**
+	 * @brief The spans of line pY, left to right.
+	 */
+	const Span* GetSpansBegin(int pY)const{return mSpans.data() + mLines[pY];}
+	const Span* GetSpansEnd(int pY)const{return mSpans.data() + mLines[pY + 1];}
+
+	const uint8_t* GetSolidPixels()const{return mSolidPixels.data();}
+	const uint8_t* GetBlendPixels()const{return mBlendPixels.data();}	//!< Always PIXEL_FORMAT_BGRA8888, not pre multiplied.
+
+private:
+	const int mWidth;
+	const int mHeight;
+	const PixelFormat mFormat;
+	Rect mBounds;
+	std::vector<Span> mSpans;
+	std::vector<size_t> mLines;		//!< The first span of each line, and one more for the end of the last.
+	std::vector<uint8_t> mSolidPixels;
+	std::vector<uint8_t> mBlendPixels;
+};
+
+/**
+ * @brief Persistent worker threads for splitting work over all the cores, without making threads every frame.
+ * Each thread has a queue of jobs. It takes from the front of its own and, when that is empty, steals from the back of the others,
+ * so uneven work, like the mandelbrot set, still keeps all the cores busy.
+ * The thread calling ParallelFor works on the jobs too, so one less worker is made than the thread count.
+ */
+class JobSystem
+{
+public:
+	/**
+	 * @param pNumThreads The number of threads doing the work including the caller, 0 for one per core.
+	 * @param pPinToCores Locks each worker to its own core so the OS does not move it about, and it's cache, mid frame.
+	 */
+	JobSystem(size_t pNumThreads = 0,bool pPinToCores = false);
+	~JobSystem();
+
+	/**
+	 * @brief The shared job system, one thread per core, made the first time it is asked for.
+	 */
+	static JobSystem& Get();
+
+	size_t GetNumThreads()const{return mQueues.size();}
+
+	/**
+	 * @brief Calls pFunction(from,to) for pieces of pGrain, or less for the last, from pBegin up to pEnd on all the threads.
+	 * Returns when all are done. Safe to call from in a job, the caller helps rather than wait.
+	 */
+	void ParallelFor(int pBegin,int pEnd,int pGrain,const std::function<void(int pFrom,int pTo)>& pFunction);
+
+	/**
+	 * @brief ParallelFor over the rows of the buffer's clip rect, pGrain rows at a time. pToY is one past the last row.
+	 * For shaders and the like that work out the pixels of a line at a time.
+	 */
+	void ParallelForRows(const DrawBuffer& pBuffer,int pGrain,const std::function<void(int pFromY,int pToY)>& pFunction);
+
+private:
+	struct Job
+	{
+		const std::function<void(int pFrom,int pTo)>* mFunction;
+		int mFrom,mTo;
+		std::atomic<int>* mNumLeft;	//!< Jobs of the ParallelFor call not yet finished.
+	};
+
+	struct Queue
+	{
+		std::mutex mLock;
+		std::deque<Job> mJobs;
+	};
+
+	/**
+	 * @brief Takes the next job from the front of queue pQueue or, if it's empty, steals one from the back of another.
+	 */
+	bool GetJob(size_t pQueue,Job& rJob);
+	void WorkerMain(size_t pQueue);
+
+	std::vector<std::unique_ptr<Queue>> mQueues;	//!< One per thread, 0 is for the threads that are not workers.
+	std::vector<std::thread> mWorkers;
+	std::atomic<int> mNumQueued;	//!< Workers sleep when there is nothing to take.
+	std::mutex mLock;
+	std::condition_variable mWake;
+	bool mQuit = false;
+};
+
+/**
+ * @brief JobSystem::Get().ParallelForRows, splits a shader or other per line work over all the cores.
+ */
+extern void ParallelForRows(DrawBuffer& pBuffer,int pGrain,const std::function<void(int pFromY,int pToY)>& pFunction);
+
+/**
+ * @brief Records drawing to do later, then does it with all the cores.
+ * The target is cut into square tiles, each call is put in the tiles its bounds touch and the tiles are drawn in parallel,
+ * each through its own view clipped to the tile. Calls are done in the order recorded within a tile, so the result is
+ * exactly the same as drawing them straight to the buffer.
+ * Images, pixels and fonts passed in must stay as they are until Execute is done. Fonts are copied, so their colours are as when recorded.
+ * The target must not be the source of a recorded blit.
+ */
+class DisplayList
+{
+public:
+	/**
+	 * @param pTileSize The width and height of a tile in pixels. Smaller spreads the work better, bigger means less time binning.
+	 * @param pJobs The threads that draw the tiles, nullptr for the shared JobSystem::Get().
+	 */
+	DisplayList(int pTileSize = 64,JobSystem* pJobs = nullptr);
+
+	/**
+	 * @brief Draws all the recorded calls into pTarget, honouring its clip rect and dirty rect tracking. The list is kept, so can be drawn again.
+	 */
+	void Execute(DrawBuffer& pTarget);
+
+	/**
+	 * @brief Forgets all the recorded calls, ready for the next frame.
+	 */
+	void Reset(){mCommands.clear();}
+
+	size_t GetNumCommands()const{return mCommands.size();}
+	int GetTileSize()const{return mTileSize;}
+
+	// These record the DrawBuffer function of the same name, see DrawBuffer for what they do.
+	void Clear(uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void WritePixel(int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void BlendPixel(int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha);
+	void BlitRGB(const uint8_t* pSourcePixels,int pX,int pY,int pSourceWidth,int pSourceHeight);
+	void BlitRGBA(const uint8_t* pSourcePixels,int pX,int pY,int pSourceWidth,int pSourceHeight,bool pPreMultipliedAlpha = false,BlendMode pMode = BLEND_MODE_NORMAL);
+	void Blit(const DrawBuffer& pImage,int pX,int pY);
+	void Blend(const DrawBuffer& pImage,int pX,int pY,BlendMode pMode = BLEND_MODE_NORMAL);
+	void Blit(const Sprite& pSprite,int pX,int pY);
+	void Blend(const Sprite& pSprite,int pX,int pY);
+	void Blend(const SpanSprite& pSprite,int pX,int pY);
+	void BlitTransformed(const DrawBuffer& pImage,const Matrix& pTransform,ImageFilter pFilter = IMAGE_FILTER_BILINEAR,bool pBlend = false);
+	void BlitScaled(const DrawBuffer& pImage,const Rect& pDest,const Rect& pSource,ImageFilter pFilter = IMAGE_FILTER_BILINEAR,bool pBlend = false);
+	void DrawLineH(int pFromX,int pFromY,int pToX,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void DrawLineV(int pFromX,int pFromY,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void DrawLine(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue);
+	void DrawLine(int pFromX,int pFromY,int pToX,int pToY,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue);
+	void DrawLineAA(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void DrawLineAA(int pFromX,int pFromY,int pToX,int pToY,int pWidth,LineCap pCap,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void DrawCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillCircle(int pCenterX,int pCenterY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode);
+	void DrawEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillEllipse(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode);
+	void DrawArc(int pCenterX,int pCenterY,int pRadius,int pWidth,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillArc(int pCenterX,int pCenterY,int pRadius,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void DrawEllipseAA(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillEllipseAA(int pCenterX,int pCenterY,int pRadiusX,int pRadiusY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void DrawArcAA(int pCenterX,int pCenterY,int pRadius,int pWidth,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillArcAA(int pCenterX,int pCenterY,int pRadius,float pFromAngle,float pToAngle,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void DrawRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillRectangle(int pFromX,int pFromY,int pToX,int pToY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha,BlendMode pMode);
+	void DrawRoundedRectangle(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillRoundedRectangle(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void DrawRoundedRectangleAA(int pFromX,int pFromY,int pToX,int pToY,int pRadius,int pWidth,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillRoundedRectangleAA(int pFromX,int pFromY,int pToX,int pToY,int pRadius,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillTriangle(int pX0,int pY0,int pX1,int pY1,int pX2,int pY2,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillConvexPolygon(const std::vector<std::array<int,2>>& pPoints,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillPolygon(const std::vector<std::array<int,2>>& pPoints,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillPolygon(const std::vector<std::vector<std::array<int,2>>>& pOutlines,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillPath(const Path& pPath,FillRule pRule,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,uint8_t pAlpha = 255);
+	void FillPath(const Path& pPath,FillRule pRule,const LinearGradient& pPaint);
+	void FillCheckerBoard(int pX,int pY,int pXCount,int pYCount,int pXSize,int pYSize,const uint8_t pRGBA[2][4]);
+	void DrawGradient(int pFromX,int pFromY,int pToX,int pToY,uint8_t pFormRed,uint8_t pFormGreen,uint8_t pFormBlue,uint8_t pToRed,uint8_t pToGreen,uint8_t pToBlue);
+
+	/**
+	 * @brief Records pFont.Print(target,...)
+	 */
+	void Print(const PixelFont& pFont,int pX,int pY,uint8_t pRed,uint8_t pGreen,uint8_t pBlue,const std::string& pText);
+
+private:
+	struct Command
+	{
+		Rect mBounds;	//!< Holds every pixel the call can write, can be bigger.
+		std::function<void(DrawBuffer& pTile)> mDraw;
+	};
+
+	/**
+	 * @brief Adds a call to the list. pBounds does not have to be in the target.
+	 */
+	void Record(const Rect& pBounds,std::function<void(DrawBuffer& pTile)> pDraw);
+
+	/**
+	 * @brief Draws the tile's commands through a view of pTarget clipped to the tile and pArea.
+	 */
+	void DrawTile(DrawBuffer& pTarget,const Rect& pArea,uint32_t pTile)const;
+
+	const int mTileSize;
+	JobSystem& mJobs;
+	std::vector<Command> mCommands;
+	int mTilesAcross = 0;
+	std::vector<std::vector<uint32_t>> mBins;	//!< For each tile the commands that touch it, in order.
+	std::vector<uint32_t> mTilesToDraw;	//!< The tiles with something in their bin.
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 struct X11FrameBufferEmulation;
 
@@ -422,7 +1550,8 @@ struct SystemEventData
  * @brief Represents the linux frame buffer display.
  * Is able to deal with and abstract out the various pixel formats. 
  * For a simple 2D rendering system that's built for portablity that is an easy speed up.
- * Tiny2D goal is portablity and small code base. Not and epic SIMD / NEON / GL / DX / Volcan monster. :)
+ * The alpha blend and BlendMode rows use SSE2 or NEON when the compiler has them, and USE_NON_TEMPORAL_FILLS fills with SSE2 stores.
+ * The rest, including the copy to the display, is portable C++ left for the compiler to vectorise. Still no GL / DX / Vulkan.
  */
 class FrameBuffer
 {
@@ -487,14 +1616,40 @@ public:
 	 */
 	int GetStride()const{return mDisplayBufferStride;}
 
+	/**
+	 * @brief Returns true if the display is being rotated by present. Then the image can't be memcpy'd to the display.
+	 */
+	bool GetIsRotated()const{return mRotation != FRAME_BUFFER_ROTATION_0;}
+
+	/**
+	 * @brief Gets the draw buffer pixel format that has the same bit layout as the display.
+	 * @return false if the display does not match any of them, then present will always convert.
+	 */
+	bool GetNativePixelFormat(PixelFormat& rFormat)const
+	{
+		rFormat = mNativePixelFormat;
+		return mHasNativePixelFormat;
+	}
+
+	/**
+	 * @brief Returns true if pixels in this format can be copied to the display as they are, no conversion.
+	 * A BGRA buffer can go to a BGRX display, the alpha lands in the unused byte.
+	 */
+	bool GetIsNativePixelFormat(PixelFormat pFormat)const
+	{
+		return	mHasNativePixelFormat &&
+				(pFormat == mNativePixelFormat || (mNativePixelFormat == PIXEL_FORMAT_BGRX8888 && pFormat == PIXEL_FORMAT_BGRA8888));
+	}
+
 	/**
 	 * @brief Will return true if the presentation of the draw buffer to the display can take an optimal route. (memcpy the fastest!)
 	 */
 	bool GetIsNativeFormat(const DrawBuffer& pBuffer)const
 	{
-		return	mDisplayBufferPixelSize == pBuffer.GetPixelSize() &&
-				mDisplayBufferStride == pBuffer.GetStride() &&
-				mDisplayBufferSize <= pBuffer.mPixels.size() &&
+		return	GetIsNativePixelFormat(pBuffer.GetPixelFormat()) &&
+				mDisplayBufferPixelSize == pBuffer.GetPixelSize() &&
+				(ptrdiff_t)mDisplayBufferStride == pBuffer.GetStride() &&
+				pBuffer.GetWidth() >= mWidth && pBuffer.GetHeight() >= mHeight &&
 				mRotation == FRAME_BUFFER_ROTATION_0;
 	}
 
@@ -530,6 +1685,17 @@ public:
 	 */
 	void Present(const DrawBuffer& pImage);
 
+	/**
+	 * @brief As above, but if the draw buffer is tracking dirty rects only those areas are copied to the display.
+	 * The dirty rects are then cleared ready for the next frame. If not tracking the whole image is presented.
+	 */
+	void Present(DrawBuffer& pImage);
+
+	/**
+	 * @brief Lets present split the pixel format conversion and rotation over the threads of pJobs. nullptr, the default, is single threaded.
+	 */
+	void SetJobSystem(JobSystem* pJobs){mJobs = pJobs;}
+
 private:
 	enum FrameBufferRotation
 	{
@@ -549,6 +1715,11 @@ private:
 	 */
 	void ProcessSystemEvents();
 
+	/**
+	 * @brief Copies an area of the image to the display, converting and rotating as needed.
+	 */
+	void PresentRect(const DrawBuffer& pImage,const Rect& pRect);
+
 	/**
 	 * @brief Handle ctrl + c event.
 	 */
@@ -600,13 +1771,17 @@ private:
 	const size_t mDisplayBufferStride;	// Num bytes between each line.
 	const size_t mDisplayBufferPixelSize;	// The byte count of each pixel. So to move in the x by one pixel.
 	const size_t mDisplayBufferSize;
+	const size_t mDisplayVisibleSize;	// The bytes from the first pixel on screen to the last. Drivers can give more memory than that, for page flipping.
 	const int mDisplayBufferFile;
 	uint8_t*  mDisplayBuffer;
 
 	const struct fb_var_screeninfo mVariableScreenInfo;
 	const bool mVerbose;
 	const FrameBufferRotation mRotation;
+	bool mHasNativePixelFormat = false;	//!< True if one of the DrawBuffer pixel formats has the exact same layout as the display.
+	PixelFormat mNativePixelFormat = PIXEL_FORMAT_BGR888; //!< If mHasNativePixelFormat is true, the format that matches the display.
 	bool mReportedPresentSpeed = false; //!< Used for verbose mode, will tell you the present screen route taken when on using linux frame buffer device.
+	JobSystem* mJobs = nullptr; //!< If set, used to convert the image to the display on all cores.
 
 	/**
 	 * @brief Information about the mouse driver
@@ -0,0 +1,342 @@
+/*
+	Checks the BlendMode code against a simple one pixel at a time version of the maths.
+	Does every mode for every dest format through Blend, BlitRGBA and the fills, with odd sizes and clipping so the ends of the SIMD rows are hit.
+	Build it as is for the SSE2 or NEON kernels, and with the portable config, which defines DISABLE_SIMD_KERNELS, for the plain C++ ones.
+	Both should say all passed. Needs no display.
+*/
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include "Tiny2D.h"
+
+using namespace tiny2d;
+
+static const PixelFormat DEST_FORMATS[] = {PIXEL_FORMAT_BGR888,PIXEL_FORMAT_BGRX8888,PIXEL_FORMAT_BGRA8888,PIXEL_FORMAT_RGB565,PIXEL_FORMAT_A8};
+static const BlendMode MODES[] = {BLEND_MODE_ADD,BLEND_MODE_MULTIPLY,BLEND_MODE_SCREEN,BLEND_MODE_DARKEN,BLEND_MODE_LIGHTEN,BLEND_MODE_XOR};
+
+static int Div255(int pValue)
+{
+	return (int)std::lround(pValue / 255.0);
+}
+
+/**
+ * @brief One channel. pS is the colour times alpha and pInvAlpha is 255 - alpha, as pre multiplied images hold it.
+ */
+static int ReferenceChannel(BlendMode pMode,int pD,int pS,int pInvAlpha)
+{
+	const int normal = std::min(255,pS + Div255(pD * pInvAlpha));
+	switch( pMode )
+	{
+	case BLEND_MODE_ADD:
+		return std::min(255,pD + pS);
+
+	case BLEND_MODE_MULTIPLY:
+		return Div255(pD * std::min(255,pS + pInvAlpha));
+
+	case BLEND_MODE_SCREEN:
+		return pD + pS - Div255(pD * pS);
+
+	case BLEND_MODE_DARKEN:
+		return std::min(pD,normal);
+
+	case BLEND_MODE_LIGHTEN:
+		return std::max(pD,normal);
+
+	case BLEND_MODE_XOR:
+		return pD ^ pS;
+
+	default:
+		return normal;
+	}
+}
+
+static void ReferencePixel(DrawBuffer& pDest,int pX,int pY,BlendMode pMode,int pRed,int pGreen,int pBlue,int pInvAlpha)
+{
+	DispatchPixelFormat(pDest.GetPixelFormat(),[&](auto pFormat)
+	{
+		typedef decltype(pFormat) FORMAT;
+		uint8_t* pixel = pDest.GetPixelAddress(pX,pY);
+		uint8_t r,g,b,a;
+		FORMAT::Unpack(FORMAT::Read(pixel),r,g,b,a);
+		r = ReferenceChannel(pMode,r,pRed,pInvAlpha);
+		g = ReferenceChannel(pMode,g,pGreen,pInvAlpha);
+		b = ReferenceChannel(pMode,b,pBlue,pInvAlpha);
+		a = std::max(a,(uint8_t)(255 - pInvAlpha));
+		FORMAT::Write(pixel,FORMAT::Pack(r,g,b,a));
+	});
+}
+
+static void ReferenceStraightPixel(DrawBuffer& pDest,int pX,int pY,BlendMode pMode,int pRed,int pGreen,int pBlue,int pAlpha)
+{
+	ReferencePixel(pDest,pX,pY,pMode,Div255(pRed * pAlpha),Div255(pGreen * pAlpha),Div255(pBlue * pAlpha),255 - pAlpha);
+}
+
+static void Randomise(DrawBuffer& pBuffer)
+{
+	for( int y = 0 ; y < pBuffer.GetHeight() ; y++ )
+	{
+		uint8_t* row = pBuffer.GetPixelAddress(0,y);
+		for( int x = 0 ; x < pBuffer.GetWidth() * (int)pBuffer.GetPixelSize() ; x++ )
+			row[x] = rand();
+	}
+}
+
+/**
+ * @brief Random pixels with blocks of see through and solid alpha so the opacity tile and all see through / all solid paths get used.
+ */
+static void RandomiseImage(DrawBuffer& pImage)
+{
+	Randomise(pImage);
+	if( pImage.GetPixelFormat() == PIXEL_FORMAT_BGRA8888 )
+	{
+		for( int y = 0 ; y < pImage.GetHeight() ; y++ )
+		{
+			for( int x = 0 ; x < pImage.GetWidth() ; x++ )
+			{
+				const int block = (x/16 + y/16) % 4;
+				if( block < 2 )
+					pImage.GetPixelAddress(x,y)[3] = block == 0 ? 0 : 255;
+			}
+		}
+	}
+}
+
+static bool GetIsSame(const DrawBuffer& pA,const DrawBuffer& pB)
+{
+	const bool padded = pA.GetPixelFormat() == PIXEL_FORMAT_BGRX8888;
+	for( int y = 0 ; y < pA.GetHeight() ; y++ )
+	{
+		const uint8_t* a = pA.GetPixelAddress(0,y);
+		const uint8_t* b = pB.GetPixelAddress(0,y);
+		for( int x = 0 ; x < pA.GetWidth() * (int)pA.GetPixelSize() ; x++ )
+		{
+			if( a[x] != b[x] && (padded == false || (x&3) != 3) )
+				return false;
+		}
+	}
+	return true;
+}
+
+static int numFailed = 0;
+static int numTests = 0;
+
+static void Check(const DrawBuffer& pResult,const DrawBuffer& pReference,const char* pWhat,PixelFormat pDest,BlendMode pMode,int pCase)
+{
+	numTests++;
+	if( GetIsSame(pResult,pReference) == false )
+	{
+		numFailed++;
+		std::cout << pWhat << " differs, dest format " << pDest << " mode " << pMode << " case " << pCase << "\n";
+	}
+}
+
+static void TestBlend()
+{
+	// Straight alpha, pre multiplied, with opacity tiles and the formats that are converted to B G R A first.
+	const int NUM_SOURCES = 7;
+	for( PixelFormat destFormat : DEST_FORMATS )
+	{
+		for( BlendMode mode : MODES )
+		{
+			for( int source = 0 ; source < NUM_SOURCES ; source++ )
+			{
+				const PixelFormat sourceFormats[NUM_SOURCES] = {PIXEL_FORMAT_BGRA8888,PIXEL_FORMAT_BGRA8888,PIXEL_FORMAT_BGRA8888,PIXEL_FORMAT_BGR888,PIXEL_FORMAT_A8,PIXEL_FORMAT_RGB565,PIXEL_FORMAT_BGRX8888};
+				DrawBuffer image(5 + rand()%70,1 + rand()%50,sourceFormats[source]);
+				RandomiseImage(image);
+				if( source == 1 )
+					image.PreMultiplyAlpha();
+				else if( source == 2 )
+					image.UpdateOpacityTiles();
+
+				DrawBuffer result(90,70,destFormat);
+				Randomise(result);
+				DrawBuffer reference(result);
+
+				// The whole image then parts of it, some hanging off the edges.
+				for( int n = 0 ; n < 3 ; n++ )
+				{
+					const int x = rand()%100 - 20;
+					const int y = rand()%80 - 20;
+					Rect part(0,0,image.GetWidth(),image.GetHeight());
+					if( n > 0 )
+					{
+						part.left = rand()%image.GetWidth();
+						part.top = rand()%image.GetHeight();
+						part.right = part.left + 1 + rand()%(image.GetWidth() - part.left);
+						part.bottom = part.top + 1 + rand()%(image.GetHeight() - part.top);
+					}
+
+					result.Blend(image,x,y,part,mode);
+
+					for( int sy = part.top ; sy < part.bottom ; sy++ )
+					{
+						for( int sx = part.left ; sx < part.right ; sx++ )
+						{
+							const int dx = x + sx - part.left;
+							const int dy = y + sy - part.top;
+							if( dx < 0 || dy < 0 || dx >= reference.GetWidth() || dy >= reference.GetHeight() )
+								continue;
+
+							const uint8_t* pixel = image.GetPixelAddress(sx,sy);
+							if( image.GetPreMultipliedAlpha() )
+							{
+								ReferencePixel(reference,dx,dy,mode,pixel[2],pixel[1],pixel[0],pixel[3]);
+							}
+							else
+							{
+								DispatchPixelFormat(image.GetPixelFormat(),[&](auto pFormat)
+								{
+									typedef decltype(pFormat) FORMAT;
+									uint8_t r,g,b,a;
+									FORMAT::Unpack(FORMAT::Read(pixel),r,g,b,a);
+									ReferenceStraightPixel(reference,dx,dy,mode,r,g,b,a);
+								});
+							}
+						}
+					}
+				}
+				Check(result,reference,"Blend",destFormat,mode,source);
+			}
+		}
+	}
+}
+
+static void TestBlitRGBA()
+{
+	const int WIDTH = 37;
+	const int HEIGHT = 23;
+	for( PixelFormat destFormat : DEST_FORMATS )
+	{
+		for( BlendMode mode : MODES )
+		{
+			for( int preMultiplied = 0 ; preMultiplied < 2 ; preMultiplied++ )
+			{
+				std::vector<uint8_t> pixels(WIDTH * HEIGHT * 4);
+				for( auto& c : pixels )
+					c = rand();
+
+				if( preMultiplied )
+				{// Pre multiplied RGBA holds colour times alpha and 255 - alpha.
+					for( size_t n = 0 ; n < pixels.size() ; n += 4 )
+					{
+						for( int c = 0 ; c < 3 ; c++ )
+							pixels[n+c] = Div255(pixels[n+c] * (255 - pixels[n+3]));
+					}
+				}
+
+				DrawBuffer result(60,40,destFormat);
+				Randomise(result);
+				DrawBuffer reference(result);
+
+				const int x = rand()%50 - 10;
+				const int y = rand()%30 - 5;
+				result.BlitRGBA(pixels.data(),x,y,WIDTH,HEIGHT,preMultiplied != 0,mode);
+
+				for( int sy = 0 ; sy < HEIGHT ; sy++ )
+				{
+					for( int sx = 0 ; sx < WIDTH ; sx++ )
+					{
+						const int dx = x + sx;
+						const int dy = y + sy;
+						if( dx < 0 || dy < 0 || dx >= reference.GetWidth() || dy >= reference.GetHeight() )
+							continue;
+
+						const uint8_t* p = &pixels[(sy * WIDTH + sx) * 4];
+						if( preMultiplied )
+							ReferencePixel(reference,dx,dy,mode,p[0],p[1],p[2],p[3]);
+						else
+							ReferenceStraightPixel(reference,dx,dy,mode,p[0],p[1],p[2],p[3]);
+					}
+				}
+				Check(result,reference,"BlitRGBA",destFormat,mode,preMultiplied);
+			}
+		}
+	}
+}
+
+static void TestFills()
+{
+	for( PixelFormat destFormat : DEST_FORMATS )
+	{
+		for( BlendMode mode : MODES )
+		{
+			// Solid, see through and part see through, the last one clipped.
+			for( int n = 0 ; n < 3 ; n++ )
+			{
+				const uint8_t r = rand();
+				const uint8_t g = rand();
+				const uint8_t b = rand();
+				const uint8_t a = n == 0 ? 255 : (n == 1 ? 0 : rand());
+
+				DrawBuffer result(130,90,destFormat);
+				Randomise(result);
+				DrawBuffer reference(result);
+				// The same shape drawn in to this says which pixels the fill should change.
+				DrawBuffer mask(130,90,PIXEL_FORMAT_A8);
+				mask.Clear(0);
+
+				if( n == 2 )
+				{
+					result.PushClipRect(Rect(7,3,120,80));
+					mask.PushClipRect(Rect(7,3,120,80));
+				}
+
+				if( rand()&1 )
+				{
+					const int fromX = rand()%150 - 10;
+					const int fromY = rand()%100 - 10;
+					const int toX = rand()%150 - 10;
+					const int toY = rand()%100 - 10;
+					result.FillRectangle(fromX,fromY,toX,toY,r,g,b,a,mode);
+					mask.FillRectangle(fromX,fromY,toX,toY,255,255,255);
+				}
+				else
+				{
+					const int x = rand()%150 - 10;
+					const int y = rand()%100 - 10;
+					const int radiusX = 1 + rand()%60;
+					const int radiusY = 1 + rand()%40;
+					result.FillEllipse(x,y,radiusX,radiusY,r,g,b,a,mode);
+					mask.FillEllipse(x,y,radiusX,radiusY,255,255,255);
+				}
+
+				for( int y = 0 ; y < reference.GetHeight() ; y++ )
+				{
+					for( int x = 0 ; x < reference.GetWidth() ; x++ )
+					{
+						if( *mask.GetPixelAddress(x,y) )
+							ReferenceStraightPixel(reference,x,y,mode,r,g,b,a);
+					}
+				}
+				Check(result,reference,"Fill",destFormat,mode,n);
+			}
+		}
+	}
+}
+
+int main()
+{
+	srand(1);
+
+#ifdef DISABLE_SIMD_KERNELS
+	std::cout << "Testing the scalar reference path of the blend mode code, DISABLE_SIMD_KERNELS is defined so no SSE2 or NEON\n";
+#else
+	std::cout << "Testing the blend mode code, SSE2 or NEON if the compiler has them\n";
+#endif
+
+	TestBlend();
+	TestBlitRGBA();
+	TestFills();
+
+	if( numFailed > 0 )
+	{
+		std::cout << numFailed << " of " << numTests << " failed\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "All " << numTests << " passed\n";
+	return EXIT_SUCCESS;
+}
@@ -59,6 +59,12 @@ int main(int argc, char *argv[])
     LoadPNG(debug2,"../data/debug2.png");
     LoadPNG(ball,"../data/foot-ball.png");
 
+    // The small images go in an atlas, one allocation for them all. Only the sprites are needed after this.
+    tiny2d::Atlas Sprites;
+    const std::vector<tiny2d::Sprite> sprites = Sprites.Add({&create,&plant,&debug1,&debug2,&ball});
+    const tiny2d::Sprite& createSprite = sprites[0];
+    const tiny2d::Sprite& plantSprite = sprites[1];
+
 
 	RT.Clear(0,0,0);
 
@@ -130,8 +136,8 @@ int main(int argc, char *argv[])
 			}
 		}
 
-        RT.Blend(create,500,60);
-        RT.Blend(plant,RT.GetWidth() - plant.GetWidth(),RT.GetHeight() - plant.GetHeight());
+        RT.Blend(createSprite,500,60);
+        RT.Blend(plantSprite,RT.GetWidth() - plantSprite.GetWidth(),RT.GetHeight() - plantSprite.GetHeight());
 
 		FB->Present(RT);
 	}
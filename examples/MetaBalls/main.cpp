@@ -102,7 +102,7 @@ void RenderScanLine(tiny2d::DrawBuffer& RT,int pFromY,int pToY,const std::vector
 				TotalDist += ball.GetMeta(x,y);
 
 			uint8_t c = (uint8_t)(std::min(255,(int)(TotalDist*3000)));
-			RT.FillRectangle(x,y,x+PixelSize,y+PixelSize,RED[c],GREEN[c],BLUE[c]);
+			RT.FillRectangle(x,y,x+PixelSize-1,y+PixelSize-1,RED[c],GREEN[c],BLUE[c]);
 		}
 	}
 }
@@ -135,31 +135,16 @@ int main(int argc, char *argv[])
 	for(int n = 0 ; n < 15 ; n++ )
 		TheBalls.emplace_back(Width,Height,160 + (rand()&127));
 
-	const int HeightSplit = Height/4;
-
 	while( FB->GetKeepGoing() )
 	{
 		for( auto &ball : TheBalls )
 			ball.Update(Width,Height);
 		
-//		for( int y = 0 ; y < Height ; y+=PixelSize )
-		int y = 0;
-
-		std::vector<std::thread>threads(4);
-		for( int n = 0 ; n < 4 ; n++ )
-		{
-			threads[n] = std::thread([&RT,y,HeightSplit,TheBalls]()
-			{
-				RenderScanLine(RT,y,y+HeightSplit,TheBalls);
-			});
-			y += HeightSplit;
-		}
-
-		// Wait till all done.
-		for( auto& t : threads )
+		// Pieces are whole rows of blocks, so no two threads write the same pixels.
+		tiny2d::ParallelForRows(RT,PixelSize * 4,[&RT,&TheBalls](int pFromY,int pToY)
 		{
-			t.join();
-		}
+			RenderScanLine(RT,pFromY,pToY,TheBalls);
+		});
 
 		FB->Present(RT);
 	};
@@ -0,0 +1,64 @@
+/*
+	Checks that a buffer handed back to a DrawBufferPool comes out again like a new one.
+	Released with a job system and dirty rect tracking set, the next Acquire must have both off, the job system may have been deleted by then.
+	Says all passed and returns zero if it's right. Needs no display.
+*/
+#include <iostream>
+#include <cstdlib>
+
+#include "Tiny2D.h"
+
+using namespace tiny2d;
+
+static int numTests = 0;
+static int numFailed = 0;
+
+static void Check(bool pPassed,const char* pWhat)
+{
+	numTests++;
+	if( !pPassed )
+	{
+		numFailed++;
+		std::cout << "Failed: " << pWhat << "\n";
+	}
+}
+
+static void TestReuse(int pWidth,int pHeight,PixelFormat pFormat)
+{
+	DrawBufferPool pool;
+	DrawBuffer* first = pool.Acquire(64,48,PIXEL_FORMAT_BGRA8888);
+	{
+		JobSystem jobs(2);
+		first->SetJobSystem(&jobs);
+		first->SetTrackDirtyRects(true);
+		first->FillRectangle(0,0,64,48,255,0,0);
+		pool.Release(first);
+	}// jobs is gone now, the pool must not hand out a buffer still pointing at it.
+
+	DrawBuffer* second = pool.Acquire(pWidth,pHeight,pFormat);
+	Check(second == first,"pool did not reuse the released buffer");
+	Check(second->GetJobSystem() == nullptr,"job system still set after Acquire");
+	Check(second->GetTrackDirtyRects() == false,"dirty rect tracking still on after Acquire");
+
+	// Big enough that it would have gone to the job system, would crash if the old one was still set.
+	second->FillRectangle(0,0,pWidth,pHeight,0,255,0);
+	pool.Release(second);
+}
+
+int main()
+{
+	std::cout << "Testing DrawBufferPool reuse\n";
+
+	// Same geometry, then a smaller one that fits in the released buffer's memory.
+	TestReuse(64,48,PIXEL_FORMAT_BGRA8888);
+	TestReuse(32,16,PIXEL_FORMAT_RGB565);
+
+	if( numFailed > 0 )
+	{
+		std::cout << numFailed << " of " << numTests << " failed\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "All " << numTests << " passed\n";
+	return EXIT_SUCCESS;
+}
@@ -2,7 +2,7 @@
 #include <iostream>
 #include "Tiny2D.h"
 
-const void Fill(std::vector<uint8_t>& pTestPattern,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
+const void Fill(tiny2d::PixelStorage& pTestPattern,uint8_t pRed,uint8_t pGreen,uint8_t pBlue)
 {
     pTestPattern.resize(256*256*4);
 
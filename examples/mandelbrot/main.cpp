@@ -28,12 +28,12 @@ public:
 	{
 	}
 
-	void Update(tiny2d::DrawBuffer& RT,int pYStart,int pYStep,double pZoom)
+	void Update(tiny2d::DrawBuffer& RT,int pFromY,int pToY,double pZoom)
 	{
 		double fy = -1 + ((pZoom - 1.0)*0.2001401);
 
-		fy += (fyInc*pYStart);
-		for(int y = pYStart ; y < RT.GetHeight() && KeepGoing ;y += pYStep , fy += (fyInc*pYStep))
+		fy += (fyInc*pFromY);
+		for(int y = pFromY ; y < pToY && KeepGoing ;y++ , fy += fyInc)
 		{
 			double fx = -2.5 + ((pZoom - 1.0) * xMul);
 
@@ -71,22 +71,12 @@ private:
 
 void Render(double pZoom,tiny2d::DrawBuffer& RT)
 {
-	const int numThreads = std::thread::hardware_concurrency();
-	std::vector<std::thread> threads;
-
-	for(int y = 0 ; y < numThreads ; y++ )
-	{
-		threads.emplace_back([pZoom,&RT,y,numThreads](){
-			Mandelbrot Cool;
-			Cool.Update(RT,y,numThreads,pZoom);
-		});
-	}
-
-	// Wait till all done.
-	for( auto &t : threads )
+	// Rows in the set take far longer than those outside it, small pieces let threads that finish early take work from the others.
+	tiny2d::ParallelForRows(RT,4,[pZoom,&RT](int pFromY,int pToY)
 	{
-		t.join();
-	}
+		Mandelbrot Cool;
+		Cool.Update(RT,pFromY,pToY,pZoom);
+	});
 }
 
 int main(int argc, char *argv[])